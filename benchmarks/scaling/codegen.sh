@@ -0,0 +1,52 @@
+#!/bin/sh
+# Monga
+# Author: Gabriel de Quadros Ligneul
+
+# Measures the native code generation with 1 to 32 threads (-j) in a
+# generated program with many functions, and checks that the objects are
+# the same for any number of threads.
+
+monga=${1:-./bin/monga}
+functions=${2:-4000}
+opt=${opt:--O2}
+dir=`mktemp -d`
+
+i=0
+while [ $i -lt $functions ]; do
+    cat <<MNG
+int f$i(int n)
+{
+    int i;
+    int s;
+    i = 0;
+    s = $i;
+    while (i < n) {
+        if (s > 1000)
+            s = s - 1000;
+        else
+            s = s + i * $i;
+        i = i + 1;
+    }
+    print "f$i(", n, ") = ", s, "\n";
+    return s;
+}
+
+MNG
+    i=`expr $i + 1`
+done > $dir/program.mng
+
+echo "Code generation of $functions functions ($opt)"
+for threads in 1 2 4 8 16 32; do
+    start=`date +%s.%N`
+    $monga $opt -no-execution -j $threads -c $dir/$threads.o \
+        < $dir/program.mng || exit 1
+    end=`date +%s.%N`
+    printf "%-16s%f s\n" "-j $threads" `echo "$start $end" | awk '{ print $2 - $1 }'`
+    if ! cmp -s $dir/1.o $dir/$threads.o; then
+        echo "the object of -j $threads differs from -j 1"
+        exit 1
+    fi
+done
+
+rm -rf $dir
+
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Monga
+# Author: Gabriel de Quadros Ligneul
+
+# Counts the phis and measures the IR generation of a generated function
+# with many locals, where each if and while assigns only a few of them.
+
+monga=${1:-./bin/monga}
+locals=${2:-500}
+dir=`mktemp -d`
+
+{
+    echo "int main()"
+    echo "{"
+    i=0
+    while [ $i -lt $locals ]; do
+        echo "    int v$i;"
+        i=`expr $i + 1`
+    done
+    echo "    int i;"
+    i=0
+    while [ $i -lt $locals ]; do
+        cat <<MNG
+    v$i = $i;
+    if (v$i > 10)
+        v$i = v$i - 10;
+    i = 0;
+    while (i < 3) {
+        v$i = v$i + i;
+        i = i + 1;
+    }
+MNG
+        i=`expr $i + 1`
+    done
+    cat <<'MNG'
+    print v0, "\n";
+    return 0;
+}
+MNG
+} > $dir/program.mng
+
+echo "IR generation of a function with $locals locals"
+$monga -no-execution -dump -time-phases < $dir/program.mng \
+    > $dir/program.ll 2> $dir/phases || exit 1
+printf "%-16s%d\n" "phis" `grep -c " = phi " $dir/program.ll`
+awk '$2 == "ir" || $2 == "verify" { printf "%-16s%s ms\n", $2, $3 }' \
+    $dir/phases
+
+rm -rf $dir
+
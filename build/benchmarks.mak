@@ -6,6 +6,12 @@
 cflags=-std=c99 -Wall -Wextra -Werror
 opt=-O2
 
+# CPU of the generated code, like march=-march=native
+march=
+
+# Extra monga options, like mflags=-fwrapv
+mflags=
+
 runs=$(wildcard benchmarks/*.sh)
 binaries=$(patsubst %.sh,%.bin,$(runs))
 benchmarks=$(patsubst %.sh,%.benchmark,$(runs))
@@ -13,27 +19,23 @@ benchmarks=$(patsubst %.sh,%.benchmark,$(runs))
 all: $(benchmarks)
 
 %.o: %.c
-	gcc $(cflags) $(opt) -c -o $@ $<
+	gcc $(cflags) $(opt) $(march) -c -o $@ $<
 
 %_gcc.o: %.c
-	gcc -DCC=Gcc $(cflags) $(opt) -c -o $@ $<
+	gcc -DCC=Gcc $(cflags) $(opt) $(march) -c -o $@ $<
 
 %_clang.o: %.c
-	clang -DCC=Clang $(cflags) $(opt) -c -o $@ $<
+	clang -DCC=Clang $(cflags) $(opt) $(march) -c -o $@ $<
 
 %_clang_llc.o: %.c
 	clang -DCC=ClangLlc $(cflags) -O0 -emit-llvm -S -o temp.ll $<
 	opt $(opt) temp.ll -o temp.bc
-	llc temp.bc -o temp.s
+	llc $(patsubst -march=%,-mcpu=%,$(march)) temp.bc -o temp.s
 	gcc temp.s -c -o $@
 	rm temp.ll temp.bc temp.s
 
 %_mng.o: %.mng
-	./bin/monga -dump -no-execution < $< >& temp.ll
-	opt $(opt) temp.ll -o temp.bc
-	llc temp.bc -o temp.s
-	gcc temp.s -c -o $@
-	rm temp.ll temp.bc temp.s
+	./bin/monga $(opt) $(march) $(mflags) -c $@ < $<
 
 %.bin: %_main.o %_gcc.o %_clang.o %_clang_llc.o %_mng.o
 	gcc $(opt) -o $@ $^
@@ -41,3 +43,7 @@ all: $(benchmarks)
 %.benchmark: %.sh %.bin
 	./$^
 
+scaling:
+	./benchmarks/scaling/codegen.sh ./bin/monga
+	./benchmarks/scaling/phis.sh ./bin/monga
+
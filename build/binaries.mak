@@ -3,13 +3,15 @@
 
 # This makefile creates the executables
 
-LDFLAGS=`llvm-config --cxxflags --ldflags --libs core executionengine jit interpreter analysis native bitwriter --system-libs`
+LDFLAGS=`llvm-config --cxxflags --ldflags --libs core executionengine mcjit perfjitevents analysis native bitreader bitwriter ipo linker --system-libs` -ldl
 
 all: \
 	bin/scanner_test \
 	bin/parser_test \
 	bin/ast_test \
 	bin/semantic_test \
+	bin/compiler_test \
+	bin/monga_client \
     bin/monga
 
 bin/scanner_test: \
@@ -57,20 +59,66 @@ bin/semantic_test: \
 	obj/util/table.o \
 	obj/util/vector.o
 
+bin/compiler_test: \
+	obj/ast/ast.o \
+	obj/ast/ast_print.o \
+	obj/ast/type.o \
+	obj/backend/extension.o \
+	obj/backend/ir.o \
+	obj/backend/runtime.o \
+	obj/compiler/compiler.o \
+	obj/compiler/compiler_test.o \
+	obj/parser/parser.tab.o \
+	obj/scanner/scanner.o \
+	obj/semantic/effects.o \
+	obj/semantic/escape.o \
+	obj/semantic/fold.o \
+	obj/semantic/semantic.o \
+	obj/semantic/symbols.o \
+	obj/util/error.o \
+	obj/util/new.o \
+	obj/util/phase.o \
+	obj/util/table.o \
+	obj/util/timer.o \
+	obj/util/vector.o
+
 bin/monga: \
     obj/monga.o \
 	obj/ast/ast.o \
 	obj/ast/ast_print.o \
 	obj/ast/type.o \
+	obj/backend/cache.o \
+	obj/backend/extension.o \
 	obj/backend/ir.o \
+	obj/backend/jit.o \
+	obj/backend/optimize.o \
+	obj/backend/parallel.o \
+	obj/backend/runtime.o \
+	obj/backend/target.o \
+	obj/compiler/compiler.o \
 	obj/parser/parser.tab.o \
 	obj/scanner/scanner.o \
+	obj/semantic/effects.o \
+	obj/semantic/escape.o \
+	obj/semantic/fold.o \
 	obj/semantic/semantic.o \
 	obj/semantic/symbols.o \
+	obj/server/server.o \
 	obj/util/error.o \
 	obj/util/new.o \
+	obj/util/phase.o \
 	obj/util/table.o \
+	obj/util/timer.o \
+	obj/util/vector.o
+
+bin/monga_client: \
+	obj/server/monga_client.o \
+	obj/server/server.o \
+	obj/util/error.o \
+	obj/util/new.o \
+	obj/util/timer.o \
 	obj/util/vector.o
+	clang -o $@ $^
 
 bin/%:
 	clang++ -o $@ $^ $(LDFLAGS) 
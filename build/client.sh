@@ -0,0 +1,7 @@
+#!/bin/sh
+# Monga
+# Author: Gabriel de Quadros Ligneul
+
+# Compiles through the server at $MONGA_SERVER, it replaces bin/monga in the
+# test folders run by build/test_server.sh
+exec ./bin/monga_client $MONGA_SERVER "$@"
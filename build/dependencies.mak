@@ -5,8 +5,13 @@
 
 CFLAGS=-iquotesrc `llvm-config --cflags`
 
-all: $(patsubst src/%.c,obj/%.d,$(shell find src -name "*.c"))
+CXXFLAGS=-iquotesrc `llvm-config --cxxflags`
+
+all: $(patsubst src/%.c,obj/%.d,$(shell find src -name "*.c")) \
+	 $(patsubst src/%.cpp,obj/%.d,$(shell find src -name "*.cpp"))
 
 obj/%.d: src/%.c
 	clang $(CFLAGS) -MM $< -MT $(patsubst %.d,%.o,$@) -o $@
 
+obj/%.d: src/%.cpp
+	clang++ $(CXXFLAGS) -MM $< -MT $(patsubst %.d,%.o,$@) -o $@
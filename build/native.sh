@@ -0,0 +1,15 @@
+#!/bin/sh
+# Monga
+# Author: Gabriel de Quadros Ligneul
+
+# Builds the standard input into a temporary executable with -o and runs it,
+# it replaces bin/monga in the test folders run by build/test_native.sh
+executable=$( mktemp /tmp/monga_native.XXXXXX )
+./bin/monga "$@" -o $executable
+status=$?
+if [ $status -eq 0 ]; then
+    $executable
+    status=$?
+fi
+rm -f $executable
+exit $status
@@ -6,7 +6,11 @@
 CFLAGS=-iquotesrc -std=c99 -Wall -Wextra -Wshadow -Werror -g \
 	 `llvm-config --cflags | sed 's/-O./-O0/'`
 
-all: $(patsubst src/%.c,obj/%.o,$(shell find src -name "*.c"))
+CXXFLAGS=-iquotesrc -Wall -Werror -g \
+	 `llvm-config --cxxflags | sed 's/-O./-O0/'`
+
+all: $(patsubst src/%.c,obj/%.o,$(shell find src -name "*.c")) \
+	 $(patsubst src/%.cpp,obj/%.o,$(shell find src -name "*.cpp"))
 
 include $(shell find obj -name "*.d")
 
@@ -16,3 +20,6 @@ obj/parser/parser.tab.o: src/parser/parser.tab.c
 
 obj/%.o: src/%.c
 	clang $(CFLAGS) -c -o $@ $<
+
+obj/%.o: src/%.cpp
+	clang++ $(CXXFLAGS) -c -o $@ $<
@@ -1,4 +1,4 @@
-#!/bin/sh
+#!/bin/bash
 # Monga
 # Author: Gabriel de Quadros Ligneul
 
@@ -9,28 +9,45 @@ if [[ $3 == "-v" ]]; then
     verbose=true
 fi
 
+# Options passed to the test binary, read from the folder's options file
+if [ -e $test_folder/options ]; then
+    test_options=$(cat $test_folder/options)
+fi
+
+# Runs the folder's tests with the options
+run_tests() {
+    for test_in in $( find $test_folder -name "*.in" | sort ); do
+        test_out=$( echo $test_in | sed -e "s/in$/out/" )
+        test_exp=$( echo $test_in | sed -e "s/in$/exp/" )
+        if [ ! -e $test_exp ]; then
+            continue
+        fi
+        if [ "$verbose" = true ]; then
+            echo "$test_in"
+        fi
+
+        ./$test_bin $1 < $test_in &> $test_out
+        if ! cmp --silent $test_exp $test_out; then
+            echo "----------------------------------------"
+            echo "Test failed: $test_in $2"
+            echo "diff -u $test_exp $test_out"
+            diff -u $test_exp $test_out
+            echo "----------------------------------------"
+            exit 1
+        fi
+        rm $test_out
+    done
+}
+
 echo "Test: $test_folder"
+run_tests "$test_options"
 
-for test_in in $( find $test_folder -name "*.in" | sort ); do
-    test_out=$( echo $test_in | sed -e "s/in$/out/" )
-    test_exp=$( echo $test_in | sed -e "s/in$/exp/" )
-    if [ ! -e $test_exp ]; then
-        continue
-    fi
-    if [ "$verbose" = true ]; then
-        echo "$test_in"
-    fi
-    
-    ./$test_bin < $test_in &> $test_out
-    if ! cmp --silent $test_exp $test_out; then
-        echo "----------------------------------------"
-        echo "Test failed: $test_in"
-        echo "diff -u $test_exp $test_out"
-        diff -u $test_exp $test_out
-        echo "----------------------------------------"
-        exit 1
-    fi
-    rm $test_out
-done
+# Each line of the folder's variants file runs the tests again, adding the
+# line's options to the folder's options
+if [ -e $test_folder/variants ]; then
+    while read -r test_variant; do
+        echo "Test: $test_folder ($test_variant)"
+        run_tests "$test_options $test_variant" "($test_variant)"
+    done < $test_folder/variants
+fi
 echo "Test succeeded!"
-
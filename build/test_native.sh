@@ -0,0 +1,54 @@
+#!/bin/sh
+# Monga
+# Author: Gabriel de Quadros Ligneul
+
+# Runs the native tests, the programs are built into executables with -o,
+# -c and -S, linked by $CC or cc
+
+test_options=$1
+
+output_directory=$( mktemp -d /tmp/monga_native.XXXXXX )
+linker=${CC:-cc}
+
+# Compares the value with the expected one
+check() {
+    if [ "$2" != "$3" ]; then
+        echo "----------------------------------------"
+        echo "Test failed: $1"
+        echo "expected '$3', got '$2'"
+        echo "----------------------------------------"
+        rm -rf $output_directory
+        exit 1
+    fi
+}
+
+if ! build/test.sh tests/native build/native.sh $test_options; then
+    rm -rf $output_directory
+    exit 1
+fi
+
+# The executable exits with the program's exit code
+echo "Test: native exit code"
+./build/native.sh < tests/native/exit.in > /dev/null
+check tests/native/exit.in $? 3
+
+# The object and the assembly are linked by the C compiler
+echo "Test: native object and assembly"
+expected=$( cat tests/native/squares.exp )
+./bin/monga -c $output_directory/squares.o < tests/native/squares.in &&
+$linker -o $output_directory/squares $output_directory/squares.o
+output=$( $output_directory/squares )
+check "tests/native/squares.in (-c)" "$output" "$expected"
+./bin/monga -S $output_directory/squares.s < tests/native/squares.in &&
+$linker -o $output_directory/squares $output_directory/squares.s
+output=$( $output_directory/squares )
+check "tests/native/squares.in (-S)" "$output" "$expected"
+
+# The lazy compilation has no native outputs
+echo "Test: native lazy error"
+output=$( ./bin/monga -lazy -o $output_directory/exit < tests/native/exit.in \
+        2>&1 )
+check "tests/native/exit.in (-lazy)" "$output" \
+        "monga: error, -lazy can't be used with native outputs"
+rm -rf $output_directory
+echo "Test succeeded!"
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Monga
+# Author: Gabriel de Quadros Ligneul
+
+# Runs the monga and server tests through a compile server started at a
+# temporary socket
+
+test_options=$1
+
+server_pid=
+MONGA_SERVER=$( mktemp -u /tmp/monga_server.XXXXXX )
+export MONGA_SERVER
+
+# Starts the server with the options and waits for its socket
+start_server() {
+    ./bin/monga -server $MONGA_SERVER "$@" 2> /dev/null &
+    server_pid=$!
+    for i in $( seq 50 ); do
+        if [ -S $MONGA_SERVER ]; then
+            return
+        fi
+        sleep 0.1
+    done
+    echo "Test failed: the server didn't start"
+    exit 1
+}
+
+stop_server() {
+    kill $server_pid
+    wait $server_pid 2> /dev/null
+}
+
+# Compares the value with the expected one
+check() {
+    if [ "$2" != "$3" ]; then
+        echo "----------------------------------------"
+        echo "Test failed: $1"
+        echo "expected '$3', got '$2'"
+        echo "----------------------------------------"
+        stop_server
+        exit 1
+    fi
+}
+
+start_server
+if ! build/test.sh tests/monga build/client.sh $test_options ||
+   ! build/test.sh tests/server build/client.sh $test_options; then
+    stop_server
+    exit 1
+fi
+
+# The client exits with the program's exit code, a compile error exits
+# only the request's worker
+echo "Test: server exit codes"
+./build/client.sh < tests/server/exit.in > /dev/null
+check tests/server/exit.in $? 3
+./build/client.sh < tests/server/error.in 2> /dev/null
+check tests/server/error.in $? 1
+./build/client.sh < tests/server/exit.in > /dev/null
+check "request after an error" $? 3
+stop_server
+
+# The server's options are part of the requests' cache keys, so the plain
+# runs and the server's requests don't share their programs
+echo "Test: server options in the cache"
+cache_directory=$( mktemp -d /tmp/monga_cache.XXXXXX )
+cache_options="-O2 -cache -cache-dir $cache_directory"
+start_server -fwrapv -fbounds-check
+output=$( ./bin/monga $cache_options < tests/server/wrapv.mng )
+check tests/server/wrapv.mng "$output" grows
+output=$( ./build/client.sh $cache_options < tests/server/wrapv.mng )
+check "tests/server/wrapv.mng (server)" "$output" wraps
+output=$( ./bin/monga $cache_options < tests/server/wrapv.mng )
+check tests/server/wrapv.mng "$output" grows
+stop_server
+rm -rf $cache_directory
+echo "Test succeeded!"
@@ -5,18 +5,48 @@
 
 all: \
 	tests/ast/done \
+	tests/bounds/done \
+	tests/cache/done \
+	tests/compiler/done \
+	tests/debug/done \
+	tests/dump/done \
+	tests/link/done \
 	tests/monga/done \
+	tests/native/done \
+	tests/optimization/done \
 	tests/parser/done \
 	tests/scanner/done \
 	tests/semantic/return/done \
-	tests/semantic_test/done
+	tests/semantic_test/done \
+	tests/server/done \
+	tests/wrapv/done
 
 tests/ast/done: bin/ast_test
+tests/bounds/done: bin/monga
+tests/compiler/done: bin/compiler_test
+tests/debug/done: bin/monga
+tests/dump/done: bin/monga
+tests/link/done: bin/monga
 tests/monga/done: bin/monga
+tests/optimization/done: bin/monga
 tests/parser/done: bin/parser_test
 tests/scanner/done: bin/scanner_test
 tests/semantic/return/done: bin/semantic_test
 tests/semantic_test/done: bin/semantic_test
+tests/wrapv/done: bin/monga
+
+# The first pass starts with an empty cache
+tests/cache/done: bin/monga
+	@rm -rf tests/cache/entries && build/test.sh $(@D) $< $(TEST_OPTIONS) && \
+		touch $@
+
+# Builds the native tests into executables and runs them
+tests/native/done: bin/monga
+	@build/test_native.sh $(TEST_OPTIONS) && touch $@
+
+# Runs the monga and server tests through the compile server
+tests/server/done: bin/monga bin/monga_client
+	@build/test_server.sh $(TEST_OPTIONS) && touch $@
 
 tests/%:
 	@build/test.sh $(@D) $< $(TEST_OPTIONS) && touch $@
@@ -16,10 +16,13 @@ AstDeclaration* AstDeclarationVariable(Type type, char* identifier, int line)
     node->type = type;
     node->identifier = identifier;
     node->line = line;
+    node->external = false;
     node->next = NULL;
     node->last = node;
     node->u.variable_.global = false;
     node->u.variable_.offset = 0;
+    node->u.variable_.captured = true;
+    node->u.variable_.written = true;
     return node;
 }
 
@@ -31,6 +34,7 @@ AstDeclaration* AstDeclarationFunction(Type type, char* identifier, int line,
     node->type = type;
     node->identifier = identifier;
     node->line = line;
+    node->external = false;
     node->next = NULL;
     node->last = node;
     node->u.function_.parameters = parameters;
@@ -41,6 +45,10 @@ AstDeclaration* AstDeclarationFunction(Type type, char* identifier, int line,
     }
     node->u.function_.block = block;
     node->u.function_.space = 0;
+    node->u.function_.effect = AST_EFFECT_WRITE;
+    node->u.function_.recursive = true;
+    node->u.function_.tail_recursive = false;
+    node->u.function_.annotations = NULL;
     return node;
 }
 
@@ -84,6 +92,7 @@ AstStatement* AstStatementWhile(AstExpression* expression,
     node->last = node;
     node->u.while_.expression = expression;
     node->u.while_.statement = statement;
+    node->u.while_.annotations = NULL;
     return node;
 }
 
@@ -110,6 +119,7 @@ AstStatement* AstStatementDelete(AstExpression* expression, int line)
     node->next = NULL;
     node->last = node;
     node->u.delete_.expression = expression;
+    node->u.delete_.stack = false;
     return node;
 }
 
@@ -220,6 +230,7 @@ AstExpression* AstExpressionCall(char* identifier, AstExpression* expressions,
     node->u.call_.is_declaration = false;
     node->u.call_.u.identifier_ = identifier;
     node->u.call_.expressions = expressions;
+    node->u.call_.tail = false;
     return node;
 }
 
@@ -245,6 +256,7 @@ AstExpression* AstExpressionNew(Type type, AstExpression* expression, int line)
     node->last = node;
     node->u.new_.type = type;
     node->u.new_.expression = expression;
+    node->u.new_.stack = false;
     return node;
 }
 
@@ -313,3 +325,14 @@ AstVariable* AstVariableArray(AstExpression* location, AstExpression* offset,
     return node;
 }
 
+AstAnnotation* AstAnnotationCreate(int tag, int value, int line)
+{
+    AstAnnotation* node = NEW(AstAnnotation);
+    node->tag = tag;
+    node->value = value;
+    node->line = line;
+    node->next = NULL;
+    node->last = node;
+    return node;
+}
+
@@ -29,6 +29,14 @@ typedef struct AstDeclaration AstDeclaration;
 typedef struct AstStatement AstStatement;
 typedef struct AstExpression AstExpression;
 typedef struct AstVariable AstVariable;
+typedef struct AstAnnotation AstAnnotation;
+
+/* Memory effects of a function, from the weakest to the strongest */
+typedef enum {
+    AST_EFFECT_NONE,        /* doesn't access memory */
+    AST_EFFECT_READ,        /* only reads memory */
+    AST_EFFECT_WRITE        /* may write memory or do I/O */
+} AstEffect;
 
 /* AstDeclaration */
 struct AstDeclaration {
@@ -48,6 +56,9 @@ struct AstDeclaration {
     /* Line in source file */
     int line;
 
+    /* True if declared with extern, it is defined in other file */
+    bool external;
+
     /* List representation */
     AstDeclaration* next;
     AstDeclaration* last;
@@ -57,15 +68,23 @@ struct AstDeclaration {
         /* AST_DECLARATION_VARIABLE */
         struct {
             bool global;
-            int offset;
+            int offset;             /* slot in the function, if local */
+            bool captured;          /* parameter that may outlive the call */
+            bool written;           /* parameter whose elements may be
+                                       written by the call */
         } variable_;
 
         /* AST_DECLARATION_FUNCTION */
         struct {
             AstDeclaration* parameters;
             int n_parameters;
-            AstStatement* block;
-            int space;
+            AstStatement* block;    /* NULL if external */
+            int space;              /* number of slots of the locals */
+            AstEffect effect;       /* memory effect, calls included */
+            bool recursive;         /* true if it may call itself */
+            bool tail_recursive;    /* true if it calls itself in a tail
+                                       position */
+            AstAnnotation* annotations;
         } function_;
     } u;
 };
@@ -114,6 +133,7 @@ struct AstStatement {
         struct {
             AstExpression* expression;
             AstStatement* statement;
+            AstAnnotation* annotations;
         } while_;
 
         /* AST_STATEMENT_ASSIGN */
@@ -125,6 +145,8 @@ struct AstStatement {
         /* AST_STATEMENT_DELETE */
         struct {
             AstExpression* expression;
+            bool stack;             /* true if the array is in the function's
+                                       frame, so nothing is freed */
         } delete_;
 
         /* AST_STATEMENT_PRINT */
@@ -220,6 +242,7 @@ struct AstExpression {
                 AstDeclaration* declaration_;
             } u;
             AstExpression* expressions;
+            bool tail;              /* true if it is followed by return */
         } call_;
 
         /* AST_EXPRESSION_VARIABLE */
@@ -229,6 +252,8 @@ struct AstExpression {
         struct {
             Type type;
             AstExpression* expression;
+            bool stack;             /* true if the array doesn't escape and
+                                       is allocated in the function's frame */
         } new_;
 
         /* AST_EXPRESSION_UNARY */
@@ -286,6 +311,32 @@ struct AstVariable {
     } u;
 };
 
+/* AstAnnotation, optimization hint written before a while, like @unroll(4),
+ * or before a function definition, like @fastmath
+ * The later annotations override the earlier ones */
+struct AstAnnotation {
+
+    /* Types of annotations (tags) */
+    enum {
+        AST_ANNOTATION_UNROLL,
+        AST_ANNOTATION_NOUNROLL,
+        AST_ANNOTATION_VECTORIZE,
+        AST_ANNOTATION_NOVECTORIZE,
+        AST_ANNOTATION_INTERLEAVE,
+        AST_ANNOTATION_FASTMATH
+    } tag;
+
+    /* Unroll count, vector width or interleave count, 0 if not given */
+    int value;
+
+    /* Line in source file */
+    int line;
+
+    /* List representation */
+    AstAnnotation* next;
+    AstAnnotation* last;
+};
+
 /* Functions for creating the nodes */
 AstDeclaration* AstDeclarationVariable(Type type, char* identifier, int line);
 AstDeclaration* AstDeclarationFunction(Type type, char* identifier, int line,
@@ -325,5 +376,7 @@ AstVariable* AstVariableReference(char* identifier, int line);
 AstVariable* AstVariableArray(AstExpression* location, AstExpression* offset,
         int line);
 
+AstAnnotation* AstAnnotationCreate(int tag, int value, int line);
+
 #endif
 
@@ -16,6 +16,7 @@ static void printStatement(int spaces, AstStatement* node);
 static void printExpression(int space, AstExpression* node);
 static void printCast(AstCastTag tag);
 static void printVariable(AstVariable* var);
+static void printAnnotation(AstAnnotation* node);
 
 void AstPrintTree(AstDeclaration* tree)
 {
@@ -65,9 +66,13 @@ static void printDeclaration(int spaces, AstDeclaration* node)
     printIndentation(spaces);
     printf("(");
 
+    if (node->external)
+        printf("extern ");
+
     switch (node->tag) {
     case AST_DECLARATION_FUNCTION:
         printf("func");
+        printAnnotation(node->u.function_.annotations);
         break;
     case AST_DECLARATION_VARIABLE:
         printf("var");
@@ -114,6 +119,7 @@ static void printStatement(int spaces, AstStatement* node)
         break;
     case AST_STATEMENT_WHILE:
         printf("while");
+        printAnnotation(node->u.while_.annotations);
         printExpression(1, node->u.while_.expression);
         printStatement(spaces + 2, node->u.while_.statement);
         break;
@@ -248,3 +254,21 @@ static void printVariable(AstVariable* node)
     }
 }
 
+static void printAnnotation(AstAnnotation* node)
+{
+    if (!node) return;
+
+    switch (node->tag) {
+    case AST_ANNOTATION_UNROLL:      printf(" @unroll"); break;
+    case AST_ANNOTATION_NOUNROLL:    printf(" @nounroll"); break;
+    case AST_ANNOTATION_VECTORIZE:   printf(" @vectorize"); break;
+    case AST_ANNOTATION_NOVECTORIZE: printf(" @novectorize"); break;
+    case AST_ANNOTATION_INTERLEAVE:  printf(" @interleave"); break;
+    case AST_ANNOTATION_FASTMATH:    printf(" @fastmath"); break;
+    }
+    if (node->value)
+        printf("(%d)", node->value);
+
+    printAnnotation(node->next);
+}
+
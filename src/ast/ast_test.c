@@ -11,8 +11,9 @@
 
 int main()
 {
-    if (!yyparse())
-        AstPrintTree(parser_ast);
+    Scanner* scanner = ScannerCreate(stdin, NULL, NULL);
+    AstPrintTree(ParserParse(scanner));
+    ScannerDestroy(scanner);
     return 0;
 }
 
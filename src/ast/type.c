@@ -17,6 +17,7 @@ Type TypeCreate(TypeTag tag, int pointers)
     Type type;
     type.tag = tag;
     type.pointers = pointers;
+    type.restricted = false;
     return type;
 }
 
@@ -27,7 +28,8 @@ bool TypeEquals(Type a, Type b)
 
 char* TypeToString(Type type)
 {
-    size_t size = 6 + 2 * type.pointers;
+    size_t size = sizeof("undefined") + 2 * type.pointers +
+            sizeof(" restrict");
     char* buffer = NEW_ARRAY(char, size);
     int len = 0;
     int i = 0;
@@ -45,6 +47,10 @@ char* TypeToString(Type type)
         sprintf(buffer + len, "[]");
         len += 2;
     }
+    if (type.restricted) {
+        sprintf(buffer + len, " restrict");
+        len += strlen(" restrict");
+    }
     buffer[len] = '\0';
     return buffer;
 }
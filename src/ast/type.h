@@ -25,12 +25,16 @@ typedef enum {
 typedef struct {
     TypeTag tag;
     int pointers;
+
+    /* True if the array's elements are only accessed through the variable
+     * of this type in its function (restrict qualifier) */
+    bool restricted;
 } Type;
 
 /* Creates a type struct */
 Type TypeCreate(TypeTag tag, int pointers);
 
-/* Returns true if both types are equal */
+/* Returns true if both types are equal, the qualifiers are ignored */
 bool TypeEquals(Type a, Type b);
 
 /* Creates a string representation of the type
@@ -0,0 +1,465 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * cache.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+
+#include "cache.h"
+
+#include "backend/target.h"
+#include "util/error.h"
+#include "util/new.h"
+
+/* Max length of the cache paths */
+#define CACHE_MAX_PATH 4096
+
+/* Number of words of the key stored in the entries */
+#define CACHE_KEY_WORDS 3
+
+/* Entry in the cache directory, used by the eviction */
+typedef struct CacheEntry {
+    char name[256];
+    long size;
+    time_t last_use;
+} CacheEntry;
+
+/* Files in the cache directory */
+static const char* PROGRAM_SUFFIX = ".so";
+static const char* MODULE_SUFFIX = ".bc";
+static const char* LOCK_FILE = "lock";
+static const char* STATISTICS_FILE = "statistics";
+
+/* Symbol of the key in the programs, it isn't a valid Monga name */
+static const char* KEY_SYMBOL = "monga.cache.key";
+
+/* Cache configuration */
+static char cache_directory[CACHE_MAX_PATH] = "";
+static long cache_max_size = CACHE_DEFAULT_SIZE;
+
+/* Creates the directory and its parents */
+static void createDirectory(const char* path);
+
+/* Obtains the path of a file in the cache directory */
+static void getCachePath(const char* name, char* path);
+
+/* Obtains the path of the entry, the suffix tells its kind */
+static void getEntryPath(CacheKey key, const char* suffix, char* path);
+
+/* Returns true if the stored words are the key's hash, check and size */
+static bool isStoredKey(const void* words, CacheKey key);
+
+/* Adds the key to the program as a global, it is verified by the load */
+static void addKeyGlobal(LLVMModuleRef module, CacheKey key);
+
+/* Returns true if the file is a program or a module entry */
+static bool isEntry(const char* name);
+
+/* Renames the temporary file to the entry and evicts the old entries
+ * Returns false if the rename fails */
+static bool commitEntry(const char* temporary_path, const char* entry_path);
+
+/* Locks the cache among the processes, returns the lock file descriptor */
+static int lockCache();
+
+/* Unlocks the cache */
+static void unlockCache(int lock);
+
+/* Reads and writes the statistics file, must be called with the lock */
+static void readStatistics(CacheStatistics* statistics);
+static void writeStatistics(CacheStatistics* statistics);
+
+/* Lists the entries, must be called with the lock */
+static CacheEntry* listEntries(int* n_entries);
+
+/* Removes the least recently used entries until the size limit is reached,
+ * must be called with the lock */
+static void evictEntries();
+
+/* Orders the entries by last use */
+static int compareEntries(const void* a, const void* b);
+
+void CacheOpen(const char* directory, long max_size)
+{
+    int length = 0;
+    if (directory != NULL) {
+        length = snprintf(cache_directory, CACHE_MAX_PATH, "%s", directory);
+    } else if (getenv("XDG_CACHE_HOME") != NULL) {
+        length = snprintf(cache_directory, CACHE_MAX_PATH, "%s/monga",
+                getenv("XDG_CACHE_HOME"));
+    } else if (getenv("HOME") != NULL) {
+        length = snprintf(cache_directory, CACHE_MAX_PATH, "%s/.cache/monga",
+                getenv("HOME"));
+    } else {
+        Error("unable to find the cache directory, set XDG_CACHE_HOME");
+    }
+
+    if (length >= CACHE_MAX_PATH)
+        Error("cache directory path is too long");
+
+    cache_max_size = max_size;
+    createDirectory(cache_directory);
+}
+
+CacheKey CacheHash(CacheKey key, const void* data, size_t size)
+{
+    // The check hash mixes the bytes differently, the collisions of both
+    // hashes are unrelated
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        key.hash ^= bytes[i];
+        key.hash *= 0x100000001b3ULL;
+        key.check = (key.check + bytes[i]) * 0xff51afd7ed558ccdULL;
+        key.check ^= key.check >> 29;
+    }
+    key.size += size;
+    return key;
+}
+
+CacheMainFunction CacheLoad(CacheKey key)
+{
+    char path[CACHE_MAX_PATH];
+    getEntryPath(key, PROGRAM_SUFFIX, path);
+
+    // The entry may be evicted by other process, then it is a miss
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL)
+        return NULL;
+
+    // An entry of other data with the same hash is a miss
+    void* main_function = dlsym(handle, "main");
+    void* stored_key = dlsym(handle, KEY_SYMBOL);
+    if (main_function == NULL || stored_key == NULL ||
+        !isStoredKey(stored_key, key)) {
+        dlclose(handle);
+        return NULL;
+    }
+
+    // Touches the entry, the modification time is used as the last use
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return (CacheMainFunction)(intptr_t)main_function;
+}
+
+bool CacheStore(CacheKey key, LLVMModuleRef module, int level)
+{
+    char entry_path[CACHE_MAX_PATH];
+    getEntryPath(key, PROGRAM_SUFFIX, entry_path);
+
+    // Creates the entry with names exclusive for this process
+    char object_path[CACHE_MAX_PATH + 32];
+    char temporary_path[CACHE_MAX_PATH + 32];
+    sprintf(object_path, "%s.%ld.o", entry_path, (long)getpid());
+    sprintf(temporary_path, "%s.%ld.tmp", entry_path, (long)getpid());
+
+    addKeyGlobal(module, key);
+    TargetEmitFile(module, object_path, LLVMObjectFile, level);
+    bool linked = TargetLinkSharedObject(object_path, temporary_path);
+    remove(object_path);
+    if (!linked) {
+        remove(temporary_path);
+        return false;
+    }
+
+    return commitEntry(temporary_path, entry_path);
+}
+
+LLVMModuleRef CacheLoadModule(CacheKey key, LLVMContextRef context)
+{
+    char path[CACHE_MAX_PATH];
+    getEntryPath(key, MODULE_SUFFIX, path);
+
+    LLVMMemoryBufferRef buffer = NULL;
+    char* error_msg = NULL;
+    if (LLVMCreateMemoryBufferWithContentsOfFile(path, &buffer,
+            &error_msg) != 0) {
+        LLVMDisposeMessage(error_msg);
+        return NULL;
+    }
+
+    // The key precedes the bitcode, an entry of other data with the same
+    // hash is a miss
+    const char* start = LLVMGetBufferStart(buffer);
+    size_t header_size = CACHE_KEY_WORDS * sizeof(uint64_t);
+    if (LLVMGetBufferSize(buffer) < header_size ||
+        !isStoredKey(start, key)) {
+        LLVMDisposeMemoryBuffer(buffer);
+        return NULL;
+    }
+
+    // A corrupted entry is a miss, it will be replaced
+    LLVMMemoryBufferRef bitcode = LLVMCreateMemoryBufferWithMemoryRange(
+            start + header_size, LLVMGetBufferSize(buffer) - header_size,
+            path, false);
+    LLVMModuleRef module = NULL;
+    bool failed = LLVMParseBitcodeInContext2(context, bitcode,
+            &module) != 0;
+    LLVMDisposeMemoryBuffer(bitcode);
+    LLVMDisposeMemoryBuffer(buffer);
+    if (failed)
+        return NULL;
+
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return module;
+}
+
+bool CacheStoreModule(CacheKey key, LLVMModuleRef module)
+{
+    char entry_path[CACHE_MAX_PATH];
+    getEntryPath(key, MODULE_SUFFIX, entry_path);
+
+    char temporary_path[CACHE_MAX_PATH + 32];
+    sprintf(temporary_path, "%s.%ld.tmp", entry_path, (long)getpid());
+    FILE* file = fopen(temporary_path, "wb");
+    if (file == NULL)
+        return false;
+
+    uint64_t words[CACHE_KEY_WORDS] = {key.hash, key.check, key.size};
+    LLVMMemoryBufferRef bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+    size_t bitcode_size = LLVMGetBufferSize(bitcode);
+    bool written = fwrite(words, sizeof(words), 1, file) == 1 &&
+            fwrite(LLVMGetBufferStart(bitcode), 1, bitcode_size, file) ==
+                bitcode_size;
+    LLVMDisposeMemoryBuffer(bitcode);
+    if (fclose(file) != 0 || !written) {
+        remove(temporary_path);
+        return false;
+    }
+
+    return commitEntry(temporary_path, entry_path);
+}
+
+void CacheRecordAccess(bool hit)
+{
+    int lock = lockCache();
+    CacheStatistics statistics;
+    readStatistics(&statistics);
+    if (hit)
+        statistics.hits++;
+    else
+        statistics.misses++;
+    writeStatistics(&statistics);
+    unlockCache(lock);
+}
+
+void CacheGetStatistics(CacheStatistics* statistics)
+{
+    int lock = lockCache();
+    readStatistics(statistics);
+    int n_entries = 0;
+    CacheEntry* entries = listEntries(&n_entries);
+    statistics->entries = n_entries;
+    statistics->size = 0;
+    for (int i = 0; i < n_entries; ++i)
+        statistics->size += entries[i].size;
+    free(entries);
+    unlockCache(lock);
+}
+
+static void createDirectory(const char* path)
+{
+    char partial[CACHE_MAX_PATH];
+    size_t length = strlen(path);
+    for (size_t i = 1; i <= length; ++i) {
+        if (path[i] == '/' || path[i] == '\0') {
+            memcpy(partial, path, i);
+            partial[i] = '\0';
+            if (mkdir(partial, 0755) != 0 && errno != EEXIST)
+                Error("unable to create the cache directory '%s'", partial);
+        }
+    }
+}
+
+static void getCachePath(const char* name, char* path)
+{
+    if (snprintf(path, CACHE_MAX_PATH, "%s/%s", cache_directory, name) >=
+            CACHE_MAX_PATH)
+        Error("cache path is too long");
+}
+
+static void getEntryPath(CacheKey key, const char* suffix, char* path)
+{
+    char name[32];
+    sprintf(name, "%016llx%s", (unsigned long long)key.hash, suffix);
+    getCachePath(name, path);
+}
+
+static bool isStoredKey(const void* words, CacheKey key)
+{
+    // The words may be unaligned in the file
+    uint64_t stored[CACHE_KEY_WORDS];
+    memcpy(stored, words, sizeof(stored));
+    return stored[0] == key.hash && stored[1] == key.check &&
+           stored[2] == key.size;
+}
+
+static void addKeyGlobal(LLVMModuleRef module, CacheKey key)
+{
+    LLVMContextRef context = LLVMGetModuleContext(module);
+    LLVMTypeRef word_type = LLVMInt64TypeInContext(context);
+    LLVMValueRef words[CACHE_KEY_WORDS] = {
+        LLVMConstInt(word_type, key.hash, false),
+        LLVMConstInt(word_type, key.check, false),
+        LLVMConstInt(word_type, key.size, false)
+    };
+    LLVMValueRef value = LLVMConstArray(word_type, words, CACHE_KEY_WORDS);
+    LLVMValueRef global = LLVMAddGlobal(module, LLVMTypeOf(value),
+            KEY_SYMBOL);
+    LLVMSetInitializer(global, value);
+    LLVMSetGlobalConstant(global, true);
+}
+
+static bool isEntry(const char* name)
+{
+    size_t length = strlen(name);
+    const char* suffixes[] = {PROGRAM_SUFFIX, MODULE_SUFFIX};
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        size_t suffix_length = strlen(suffixes[i]);
+        if (length > suffix_length &&
+            strcmp(name + length - suffix_length, suffixes[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool commitEntry(const char* temporary_path, const char* entry_path)
+{
+    // Rename is atomic, so other processes never load a partial entry
+    int lock = lockCache();
+    bool stored = rename(temporary_path, entry_path) == 0;
+    if (stored)
+        evictEntries();
+    else
+        remove(temporary_path);
+    unlockCache(lock);
+    return stored;
+}
+
+static int lockCache()
+{
+    char path[CACHE_MAX_PATH];
+    getCachePath(LOCK_FILE, path);
+    int lock = open(path, O_RDWR | O_CREAT, 0644);
+    if (lock < 0)
+        Error("unable to open the cache lock '%s'", path);
+
+    struct flock region;
+    memset(&region, 0, sizeof(region));
+    region.l_type = F_WRLCK;
+    region.l_whence = SEEK_SET;
+    while (fcntl(lock, F_SETLKW, &region) != 0) {
+        if (errno != EINTR)
+            Error("unable to lock the cache '%s'", path);
+    }
+    return lock;
+}
+
+static void unlockCache(int lock)
+{
+    // Closing the descriptor releases the lock
+    close(lock);
+}
+
+static void readStatistics(CacheStatistics* statistics)
+{
+    memset(statistics, 0, sizeof(CacheStatistics));
+    char path[CACHE_MAX_PATH];
+    getCachePath(STATISTICS_FILE, path);
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return;
+    if (fscanf(file, "hits %ld misses %ld", &statistics->hits,
+            &statistics->misses) != 2)
+        memset(statistics, 0, sizeof(CacheStatistics));
+    fclose(file);
+}
+
+static void writeStatistics(CacheStatistics* statistics)
+{
+    char path[CACHE_MAX_PATH];
+    getCachePath(STATISTICS_FILE, path);
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return;
+    fprintf(file, "hits %ld\nmisses %ld\n", statistics->hits,
+            statistics->misses);
+    fclose(file);
+}
+
+static CacheEntry* listEntries(int* n_entries)
+{
+    DIR* directory = opendir(cache_directory);
+    if (directory == NULL)
+        Error("unable to read the cache directory '%s'", cache_directory);
+
+    int capacity = 16;
+    CacheEntry* entries = NEW_ARRAY(CacheEntry, capacity);
+    *n_entries = 0;
+
+    struct dirent* file;
+    while ((file = readdir(directory)) != NULL) {
+        if (!isEntry(file->d_name))
+            continue;
+
+        char path[CACHE_MAX_PATH];
+        getCachePath(file->d_name, path);
+        struct stat status;
+        if (stat(path, &status) != 0)
+            continue;
+
+        if (*n_entries == capacity) {
+            capacity *= 2;
+            entries = NewRealloc(entries, sizeof(CacheEntry) * capacity);
+        }
+        CacheEntry* entry = &entries[(*n_entries)++];
+        snprintf(entry->name, sizeof(entry->name), "%s", file->d_name);
+        entry->size = (long)status.st_size;
+        entry->last_use = status.st_mtime;
+    }
+
+    closedir(directory);
+    return entries;
+}
+
+static void evictEntries()
+{
+    int n_entries = 0;
+    CacheEntry* entries = listEntries(&n_entries);
+    long size = 0;
+    for (int i = 0; i < n_entries; ++i)
+        size += entries[i].size;
+
+    qsort(entries, n_entries, sizeof(CacheEntry), compareEntries);
+    for (int i = 0; i < n_entries && size > cache_max_size; ++i) {
+        char path[CACHE_MAX_PATH];
+        getCachePath(entries[i].name, path);
+        if (remove(path) == 0)
+            size -= entries[i].size;
+    }
+
+    free(entries);
+}
+
+static int compareEntries(const void* a, const void* b)
+{
+    const CacheEntry* entry_a = a;
+    const CacheEntry* entry_b = b;
+    if (entry_a->last_use != entry_b->last_use)
+        return entry_a->last_use < entry_b->last_use ? -1 : 1;
+    return strcmp(entry_a->name, entry_b->name);
+}
+
@@ -0,0 +1,84 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * cache.h
+ * Persistent cache of compiled programs and modules. Programs are shared
+ * objects and modules are the LLVM bitcode of each source file. Entries
+ * are named by the hash of the source, the compiler version and the options.
+ * Each entry also stores the size of the hashed data and a second hash of it,
+ * which are compared on load, so a collision of the names is a miss.
+ * Entries are written to temporary files and renamed, so many processes
+ * can share the cache. The least recently used entries are evicted when
+ * the cache gets bigger than its size limit.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <llvm-c/Core.h>
+
+/* Initial value of a cache key */
+#define CACHE_KEY_INIT ((CacheKey){0xcbf29ce484222325ULL, \
+        0x9e3779b97f4a7c15ULL, 0})
+
+/* Default size limit, in bytes */
+#define CACHE_DEFAULT_SIZE (64L * 1024 * 1024)
+
+/* Key of a cache entry */
+typedef struct CacheKey {
+    /* FNV-1a hash of the data, it names the entry */
+    uint64_t hash;
+
+    /* Independent hash of the data, verified on load */
+    uint64_t check;
+
+    /* Number of bytes hashed, verified on load */
+    uint64_t size;
+} CacheKey;
+
+/* Signature of the cached main function */
+typedef int (*CacheMainFunction)();
+
+/* Cache measures */
+typedef struct CacheStatistics {
+    long hits;
+    long misses;
+    long entries;
+    long size;
+} CacheStatistics;
+
+/* Opens the cache at the directory, creating it if necessary
+ * If directory is NULL, uses $XDG_CACHE_HOME/monga or ~/.cache/monga */
+void CacheOpen(const char* directory, long max_size);
+
+/* Combines the key with the data */
+CacheKey CacheHash(CacheKey key, const void* data, size_t size);
+
+/* Loads the main function of the entry, returns NULL if it isn't cached */
+CacheMainFunction CacheLoad(CacheKey key);
+
+/* Compiles the module to native code and stores it in the cache
+ * Returns false if the entry couldn't be created */
+bool CacheStore(CacheKey key, LLVMModuleRef module, int level);
+
+/* Loads the module of the entry in the context
+ * Returns NULL if it isn't cached */
+LLVMModuleRef CacheLoadModule(CacheKey key, LLVMContextRef context);
+
+/* Stores the module's bitcode in the cache
+ * Returns false if the entry couldn't be created */
+bool CacheStoreModule(CacheKey key, LLVMModuleRef module);
+
+/* Counts a cache hit or a cache miss */
+void CacheRecordAccess(bool hit);
+
+/* Obtains the cache measures */
+void CacheGetStatistics(CacheStatistics* statistics);
+
+#endif
+
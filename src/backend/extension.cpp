@@ -0,0 +1,208 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * extension.cpp
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/Object/SymbolSize.h>
+#if LLVM_VERSION_MAJOR >= 14
+#include <llvm/MC/TargetRegistry.h>
+#else
+#include <llvm/Support/TargetRegistry.h>
+#endif
+
+#include <llvm/Analysis/ScopedNoAliasAA.h>
+#include <llvm/Analysis/TypeBasedAliasAnalysis.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Scalar/SimpleLoopUnswitch.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+
+#include "extension.h"
+
+namespace {
+
+/* Appends the functions of the loaded objects to /tmp/perf-<pid>.map, the
+ * symbol table that perf reads for the code without a file */
+class PerfMapListener : public llvm::JITEventListener {
+public:
+    void notifyObjectLoaded(ObjectKey, const llvm::object::ObjectFile& object,
+            const llvm::RuntimeDyld::LoadedObjectInfo& info) override
+    {
+        // The debug object has the sections at their load addresses
+        llvm::object::OwningBinary<llvm::object::ObjectFile> debug_object =
+                info.getObjectForDebug(object);
+        if (debug_object.getBinary() == nullptr)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string name =
+                "/tmp/perf-" + std::to_string(getpid()) + ".map";
+        FILE* file = fopen(name.c_str(), "a");
+        if (file == nullptr)
+            return;
+        for (const auto& symbol_size :
+                llvm::object::computeSymbolSizes(*debug_object.getBinary())) {
+            const llvm::object::SymbolRef& symbol = symbol_size.first;
+            llvm::Expected<llvm::object::SymbolRef::Type> type =
+                    symbol.getType();
+            llvm::Expected<llvm::StringRef> symbol_name = symbol.getName();
+            llvm::Expected<uint64_t> address = symbol.getAddress();
+            if (type && symbol_name && address &&
+                *type == llvm::object::SymbolRef::ST_Function) {
+                fprintf(file, "%" PRIx64 " %" PRIx64 " %s\n", *address,
+                        symbol_size.second, symbol_name->str().c_str());
+            }
+            llvm::consumeError(type.takeError());
+            llvm::consumeError(symbol_name.takeError());
+            llvm::consumeError(address.takeError());
+        }
+        fclose(file);
+    }
+
+private:
+    /* The engines of the compile server load objects in many threads */
+    std::mutex mutex;
+};
+
+}
+
+bool ExtensionIsCpuValid(const char* triple, const char* cpu)
+{
+    std::string error_msg;
+    const llvm::Target* target =
+            llvm::TargetRegistry::lookupTarget(triple, error_msg);
+    if (target == nullptr)
+        return false;
+
+    std::unique_ptr<llvm::MCSubtargetInfo> subtarget(
+            target->createMCSubtargetInfo(triple, "", ""));
+    return subtarget != nullptr && subtarget->isCPUStringValid(cpu);
+}
+
+void ExtensionSplitModule(LLVMModuleRef module, int n_parts,
+        ExtensionPartCallback callback, void* data)
+{
+    int index = 0;
+    auto receivePart = [&](std::unique_ptr<llvm::Module> part) {
+        callback(llvm::wrap(part.release()), index++, data);
+    };
+
+#if LLVM_VERSION_MAJOR >= 13
+    llvm::SplitModule(*llvm::unwrap(module), n_parts, receivePart);
+#else
+    // Older versions consume the module, so a copy is split
+    llvm::SplitModule(llvm::CloneModule(*llvm::unwrap(module)), n_parts,
+            receivePart);
+#endif
+}
+
+LLVMMetadataRef ExtensionCreateAliasDomain(LLVMContextRef context,
+        const char* name)
+{
+    llvm::MDBuilder builder(*llvm::unwrap(context));
+    return llvm::wrap(builder.createAnonymousAliasScopeDomain(name));
+}
+
+LLVMMetadataRef ExtensionCreateAliasScope(LLVMContextRef context,
+        LLVMMetadataRef domain, const char* name)
+{
+    llvm::MDBuilder builder(*llvm::unwrap(context));
+    llvm::MDNode* domain_node = llvm::unwrap<llvm::MDNode>(domain);
+    return llvm::wrap(builder.createAnonymousAliasScope(domain_node, name));
+}
+
+void ExtensionSetFastMathFlags(LLVMValueRef instruction, unsigned flags)
+{
+    llvm::Value* value = llvm::unwrap(instruction);
+    if (!llvm::isa<llvm::Instruction>(value) ||
+        !llvm::isa<llvm::FPMathOperator>(value))
+        return;
+
+    llvm::FastMathFlags fast_math;
+    fast_math.setAllowReassoc(flags & (1 << 0));
+    fast_math.setNoNaNs(flags & (1 << 1));
+    fast_math.setNoInfs(flags & (1 << 2));
+    fast_math.setNoSignedZeros(flags & (1 << 3));
+    fast_math.setAllowReciprocal(flags & (1 << 4));
+    fast_math.setAllowContract(flags & (1 << 5));
+    fast_math.setApproxFunc(flags & (1 << 6));
+    llvm::cast<llvm::Instruction>(value)->setFastMathFlags(fast_math);
+}
+
+LLVMMetadataRef ExtensionCreateLoopId(LLVMContextRef context,
+        LLVMMetadataRef* properties, unsigned n_properties)
+{
+    // The first operand is replaced by the node, after it is created
+    std::vector<llvm::Metadata*> operands(1, nullptr);
+    for (unsigned i = 0; i < n_properties; ++i)
+        operands.push_back(llvm::unwrap(properties[i]));
+    llvm::MDNode* loop_id =
+            llvm::MDNode::getDistinct(*llvm::unwrap(context), operands);
+    loop_id->replaceOperandWith(0, loop_id);
+    return llvm::wrap(loop_id);
+}
+
+void ExtensionSetMustTailCall(LLVMValueRef call)
+{
+    llvm::unwrap<llvm::CallInst>(call)->setTailCallKind(
+            llvm::CallInst::TCK_MustTail);
+}
+
+void ExtensionAddRangeCheckElimination(LLVMPassManagerBuilderRef builder)
+{
+    // The checks must be eliminated before the induction variables are
+    // simplified, since they become exit conditions that IRCE doesn't
+    // recognize. The invariant checks are unswitched, so LICM can hoist the
+    // lengths that they guard, then each IRCE removes the checks against
+    // the lengths hoisted so far.
+    auto add_passes = [](const llvm::PassManagerBuilder&,
+            llvm::legacy::PassManagerBase& passes) {
+        passes.add(llvm::createTypeBasedAAWrapperPass());
+        passes.add(llvm::createScopedNoAliasAAWrapperPass());
+        passes.add(llvm::createCFGSimplificationPass());
+        passes.add(llvm::createEarlyCSEPass());
+        passes.add(llvm::createLoopRotatePass());
+        passes.add(llvm::createLICMPass());
+        passes.add(llvm::createSimpleLoopUnswitchLegacyPass());
+        passes.add(llvm::createLICMPass());
+        passes.add(llvm::createInductiveRangeCheckEliminationPass());
+        passes.add(llvm::createLICMPass());
+        passes.add(llvm::createInductiveRangeCheckEliminationPass());
+    };
+    llvm::unwrap(builder)->addExtension(
+            llvm::PassManagerBuilder::EP_EarlyAsPossible, add_passes);
+}
+
+void ExtensionRegisterPerfListeners(LLVMExecutionEngineRef engine)
+{
+    // The listeners outlive the engines, they are shared by all of them
+    static PerfMapListener perf_map;
+    llvm::ExecutionEngine* execution_engine = llvm::unwrap(engine);
+    execution_engine->RegisterJITEventListener(&perf_map);
+    llvm::JITEventListener* perf_jit =
+            llvm::JITEventListener::createPerfJITEventListener();
+    if (perf_jit != nullptr)
+        execution_engine->RegisterJITEventListener(perf_jit);
+}
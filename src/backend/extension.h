@@ -0,0 +1,73 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * extension.h
+ * LLVM features that the C API doesn't expose, implemented over the C++ API.
+ */
+
+#ifndef EXTENSION_H
+#define EXTENSION_H
+
+#include <stdbool.h>
+
+#include <llvm-c/Core.h>
+#include <llvm-c/ExecutionEngine.h>
+#include <llvm-c/Transforms/PassManagerBuilder.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns true if the target of the triple knows the CPU */
+bool ExtensionIsCpuValid(const char* triple, const char* cpu);
+
+/* Receives a part of a split module, the callback owns the part */
+typedef void (*ExtensionPartCallback)(LLVMModuleRef part, int index,
+        void* data);
+
+/* Splits the module's definitions in n_parts modules, the parts reference
+ * each other's definitions by external hidden symbols. The module's local
+ * symbols are externalized too. The split depends only on the module. */
+void ExtensionSplitModule(LLVMModuleRef module, int n_parts,
+        ExtensionPartCallback callback, void* data);
+
+/* Creates a distinct alias scope domain, used by the alias.scope and noalias
+ * metadata */
+LLVMMetadataRef ExtensionCreateAliasDomain(LLVMContextRef context,
+        const char* name);
+
+/* Creates a distinct alias scope in the domain */
+LLVMMetadataRef ExtensionCreateAliasScope(LLVMContextRef context,
+        LLVMMetadataRef domain, const char* name);
+
+/* Sets the fast math flags of the instruction, the bits are the same of
+ * llvm::FastMathFlags. Values that aren't float operations are ignored,
+ * like the constants folded by the builder. */
+void ExtensionSetFastMathFlags(LLVMValueRef instruction, unsigned flags);
+
+/* Creates a distinct llvm.loop node with the properties, its first operand
+ * is the node itself */
+LLVMMetadataRef ExtensionCreateLoopId(LLVMContextRef context,
+        LLVMMetadataRef* properties, unsigned n_properties);
+
+/* Marks the call as musttail, the caller and the callee must have the same
+ * prototype and the call must be followed by the return of its value */
+void ExtensionSetMustTailCall(LLVMValueRef call);
+
+/* Adds the inductive range check elimination to the start of the builder's
+ * function pipeline. The pass splits the loops, so the iterations that are
+ * known to be in the bounds run without the checks. */
+void ExtensionAddRangeCheckElimination(LLVMPassManagerBuilderRef builder);
+
+/* Registers the listeners that make the engine's code visible to perf. The
+ * functions of each loaded object are appended to /tmp/perf-<pid>.map, and
+ * the perf JIT interface, which has the lines, is used if LLVM has it. */
+void ExtensionRegisterPerfListeners(LLVMExecutionEngineRef engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
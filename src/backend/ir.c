@@ -5,16 +5,26 @@
  * ir.c
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <llvm-c/Analysis.h>
+#include <llvm-c/DebugInfo.h>
 
 #include "ir.h"
 
-#include "scanner/scanner.h"
+#include "backend/extension.h"
+#include "backend/runtime.h"
 #include "util/new.h"
+#include "util/phase.h"
 #include "util/table.h"
+#include "util/vector.h"
 
 /* 
  * SECTION: Declarations
@@ -25,20 +35,90 @@ typedef struct IRState {
     /* The module that contains the compiled program */
     LLVMModuleRef module;
 
+    /* Context of the module, each compilation has its own */
+    LLVMContextRef context;
+
+    /* Types of the context */
+    LLVMTypeRef void_type;
+    LLVMTypeRef bool_type;
+    LLVMTypeRef char_type;
+    LLVMTypeRef int_type;
+    LLVMTypeRef float_type;
+    LLVMTypeRef string_type;
+
     /* LLVM Builder */
     LLVMBuilderRef builder;
 
-    /* Printf prototype reference */
-    LLVMValueRef printf;
-
-    /* Boolean strings for printf */
-    LLVMValueRef bool_strings;
+    /* Output runtime of the print statement */
+    Runtime runtime;
 
     /* Maps literal strings to LLVMValueRef */
     TableRef strings;
 
-    /* Current function */
+    /* Current function and its declaration */
     LLVMValueRef function;
+    AstDeclaration* declaration;
+
+    /* True if the current function is main, it flushes the output before
+     * returning */
+    bool main;
+
+    /* Maps the if and while statements of the current function to the
+     * vector of local variables that they may assign */
+    TableRef assigned_variables;
+
+    /* Current values of the function's locals, indexed by their slots
+     * The slots of the locals that aren't visible are NULL */
+    LLVMValueRef* locals;
+
+    /* Alias metadata of the restrict arrays' accesses, indexed by the slots
+     * of the locals, NULL if the local isn't restrict. The accesses of the
+     * other arrays receive the list with all the function's scopes. */
+    LLVMValueRef* alias_scopes;
+    LLVMValueRef* noalias_scopes;
+    LLVMValueRef all_scopes;
+
+    /* Metadata kinds of the alias scopes */
+    unsigned alias_scope_kind;
+    unsigned noalias_kind;
+
+    /* Root of the type based alias metadata and its kind */
+    LLVMMetadataRef tbaa_root;
+    unsigned tbaa_kind;
+
+    /* Metadata kind of the loops' annotations */
+    unsigned loop_kind;
+
+    /* True if the functions are called through their address variables */
+    bool lazy;
+
+    /* Fast math flags of the current function's float instructions */
+    unsigned fast_math;
+
+    /* Current function if its self tail calls are jumps to the recursion
+     * block, otherwise NULL. The block's phis replace the parameters. */
+    AstDeclaration* recursion;
+    LLVMBasicBlockRef recursion_block;
+    LLVMValueRef* recursion_phis;
+
+    /* Block of the current function that traps when an array access is out
+     * of the bounds, NULL until the first checked access */
+    LLVMBasicBlockRef bounds_trap;
+
+    /* Metadata kind of the invariant loads */
+    unsigned invariant_load_kind;
+
+    /* Metadata kind of the flushes before the calls to extern functions */
+    unsigned extern_flush_kind;
+
+    /* Debug information builder and the file's compile unit, NULL if the
+     * debug information is disabled */
+    LLVMDIBuilderRef debug_builder;
+    LLVMMetadataRef debug_file;
+    LLVMMetadataRef debug_unit;
+
+    /* Subprogram of the current function, the scope of its lines */
+    LLVMMetadataRef debug_scope;
 } IRState;
 
 /* Pair with basic block and value, used as return value */
@@ -50,8 +130,28 @@ typedef struct IRBlockValue {
 /* Max number of parameters for in a function call */
 const int MAX_N_PARAMETERS = 64;
 
-/* Max number of elements printed with print statement */
-const int MAX_FORMAT = 1024;
+/* True if the signed overflow wraps, otherwise it is undefined */
+static bool ir_wrapv = false;
+
+/* True if the restrict arguments are verified on the function's entry */
+static bool ir_check_restrict = false;
+
+/* True if the array accesses are checked */
+static bool ir_bounds_check = false;
+
+/* Size of the array header, it has the length in its last int. The size
+ * keeps the elements aligned. */
+static const int ARRAY_HEADER_SIZE = 8;
+
+/* Fast math flags of the float instructions, besides the annotated ones */
+static unsigned ir_fast_math = 0;
+
+/* True if the modules have debug information */
+static bool ir_debug_info = false;
+
+/* Metadata of the flushes before the calls to extern functions, the ones
+ * whose callee is defined by a linked module are removed */
+static const char* EXTERN_FLUSH_METADATA = "monga.extern.flush";
 
 /* Verifies if the LLVM module is correct */
 static void verifyModule(LLVMModuleRef module);
@@ -62,44 +162,126 @@ static IRState* createState(LLVMModuleRef module);
 /* Destroys the state */
 static void destroyState(IRState* state);
 
-/* Creates the equivalent llvm type */
-static LLVMTypeRef createType(Type type);
+/* Creates the compile unit of the file, if the debug information is
+ * enabled. The file name is NULL for the standard input. */
+static void createDebugUnit(const char* file_name, IRState* state);
 
-/* Creates the equivalent llvm function type */
-static LLVMTypeRef createFunctionType(AstDeclaration* function);
+/* Creates the subprogram of the current function, its scope line is the
+ * function's line */
+static void createDebugFunction(AstDeclaration* function, IRState* state);
 
-/* Creates the printf prototype */
-static LLVMValueRef createPrintfPrototype(LLVMModuleRef module);
+/* Sets the line of the next instructions of the current function */
+static void setDebugLocation(int line, IRState* state);
 
-/* Creates an array with {"false", "true"} */
-static LLVMValueRef createBooleanStrings(LLVMModuleRef module);
+/* Creates the equivalent llvm type */
+static LLVMTypeRef createType(Type type, IRState* state);
 
-/* Creates the format function based on a list of expressions */
-static LLVMValueRef createPrintfFormat(AstExpression* expressions,
+/* Creates the equivalent llvm function type */
+static LLVMTypeRef createFunctionType(AstDeclaration* function,
         IRState* state);
 
-/* Remove declarations from the table */
-static void removeDeclarations(AstDeclaration* variables,
-        TableRef declarations);
+/* Appends a basic block to the current function */
+static LLVMBasicBlockRef appendBlock(const char* name, IRState* state);
 
-/* Create hidden global variables for each literal string */
-static void compileStrings(IRState* state);
+/* Clears the slots of the locals that aren't visible anymore */
+static void removeLocals(AstDeclaration* variables, IRState* state);
 
-/* Create global variables */
+/* Obtains the hidden global variable of the literal string, it is created
+ * on the first use */
+static LLVMValueRef getString(char* string, IRState* state);
+
+/* Create global variables
+ * If define is false, the variables are declared as external symbols */
 static void compileGlobalVariables(AstDeclaration* tree,
-        TableRef declarations, IRState* state);
+        TableRef declarations, bool define, IRState* state);
 
 /* Compiles functions declarations */
 static void compileFunctionsDeclarations(AstDeclaration* tree,
         TableRef declarations, IRState* state);
 
-/* Compiles functions parameters references */
-static void compileParameters(AstDeclaration* parameters, TableRef declarations,
+/* Compiles the lazy stubs and the functions' address variables */
+static void compileFunctionsStubs(AstDeclaration* tree,
+        TableRef declarations, IRState* state);
+
+/* Declares the functions' address variables defined in the lazy module */
+static void compileFunctionsAddresses(AstDeclaration* tree,
+        TableRef declarations, IRState* state);
+
+/* Declares a function defined in other module */
+static void compileExternalFunction(AstDeclaration* function,
+        TableRef declarations, IRState* state);
+
+/* Adds the function's parameters attributes, restrict arrays are noalias
+ * The llvm function may be a call to the function */
+static void setParametersAttributes(AstDeclaration* function,
+        LLVMValueRef llvm_function, IRState* state);
+
+/* Adds the attributes found by the effect analysis to the definition or to
+ * a call to it */
+static void setEffectsAttributes(AstDeclaration* function,
+        LLVMValueRef llvm_function, IRState* state);
+
+/* Adds the attribute to the function or to the call, the parameters start
+ * at index 1 */
+static void addAttribute(LLVMValueRef function, LLVMAttributeIndex index,
+        const char* name, IRState* state);
+
+/* Compiles the body of the current function */
+static void compileFunction(AstDeclaration* function, TableRef declarations,
+        IRState* state);
+
+/* Finds the local variables that the statements may assign, the ones of the
+ * if and while statements are kept in the state */
+static void findAssignedVariables(AstStatement* statements, Vector* assigned,
+        TableRef found, IRState* state);
+
+/* Adds the variable to the vector, if it wasn't found before */
+static void addAssignedVariable(AstDeclaration* variable, Vector* assigned,
+        TableRef found);
+
+/* Finds the restrict arrays declared by the variables and the statements */
+static void findRestrictVariables(AstDeclaration* variables,
+        AstStatement* statements, Vector* found);
+
+/* Creates the alias scopes of the function's restrict arrays */
+static void createAliasScopes(AstDeclaration* function, IRState* state);
+
+/* Adds the alias metadata to the load or store of the array's element */
+static void setAliasMetadata(LLVMValueRef access, AstVariable* variable,
+        IRState* state);
+
+/* Adds the type based alias metadata to the load or store of a memory
+ * location of the type, locations of different types never alias */
+static void setTypeMetadata(LLVMValueRef access, Type type, IRState* state);
+
+/* Traps if a restrict argument is equal to other argument, returns the block
+ * where the function continues */
+static LLVMBasicBlockRef compileRestrictCheck(AstDeclaration* function,
+        LLVMBasicBlockRef in_block, IRState* state);
+
+/* Prints that the arguments overlap and traps */
+static void compileRestrictTrap(AstDeclaration* function,
+        AstDeclaration* parameter, AstDeclaration* other, IRState* state);
+
+/* Prints the message in stderr and traps */
+static void compileTrap(const char* message, IRState* state);
+
+/* Returns the block that traps when an array access is out of the bounds,
+ * it is shared by the current function's accesses */
+static LLVMBasicBlockRef getBoundsTrap(IRState* state);
+
+/* Returns the address of the array's length, in its header */
+static LLVMValueRef buildArrayLengthAddress(LLVMValueRef array,
         IRState* state);
 
+/* Loads the array's length, it never changes, so the load is invariant */
+static LLVMValueRef buildArrayLength(LLVMValueRef array, IRState* state);
+
+/* Compiles functions parameters references */
+static void compileParameters(AstDeclaration* parameters, IRState* state);
+
 /* Compiles the variables by initializing them with empty values */
-static void compileLocalVariables(AstDeclaration* variables,
-        TableRef declarations);
+static void compileLocalVariables(AstDeclaration* variables, IRState* state);
 
 /* Compiles the statements
  * Receiveis the input basic block and returns the output basic block */
@@ -115,6 +297,15 @@ static LLVMBasicBlockRef compileStatementIf(AstStatement* statement,
 static LLVMBasicBlockRef compileStatementWhile(AstStatement* statement, 
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
 
+/* Attaches the while's annotations to the branches that go back to the
+ * loop's beginning (llvm.loop metadata) */
+static void setLoopMetadata(AstAnnotation* annotations, Vector* latches,
+        IRState* state);
+
+/* Creates a property of the llvm.loop metadata, the value may be NULL */
+static LLVMMetadataRef createLoopProperty(const char* name,
+        LLVMValueRef value, IRState* state);
+
 static LLVMBasicBlockRef compileStatementAssign(AstStatement* statement, 
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
 
@@ -124,25 +315,54 @@ static LLVMBasicBlockRef compileStatementDelete(AstStatement* statement,
 static LLVMBasicBlockRef compileStatementPrint(AstStatement* statement, 
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
 
+/* Writes the literal string, its length is known */
+static void compileWriteBytes(char* string, LLVMBasicBlockRef block,
+        IRState* state);
+
 static LLVMBasicBlockRef compileStatementReturn(AstStatement* statement, 
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
 
-/* Merges two blocks into one block */
-static void mergeBlocks(LLVMBasicBlockRef left_block,
-        TableRef left_declarations, LLVMBasicBlockRef right_block,
-        TableRef right_declarations, LLVMBasicBlockRef out_block,
-        TableRef declarations, IRState* state);
+/* Returns true if the self tail recursion can become a loop, the restrict
+ * parameters' scopes don't hold across the iterations */
+static bool isRecursionConvertible(AstDeclaration* function);
 
-/* Returns the local declarations */
-static TablePair* getLocalDeclarations(TableRef declarations, int* n);
+/* Creates the recursion block, its phis become the parameters, returns it */
+static LLVMBasicBlockRef compileRecursionBlock(AstDeclaration* function,
+        LLVMBasicBlockRef in_block, IRState* state);
 
-/* Assign all other declarations to declarations */
-static void updateDeclarations(TableRef declarations, TableRef other);
+/* Returns true if the expression is a self tail call of the current function
+ * and it is compiled as a jump */
+static bool isTailRecursion(AstExpression* expression, IRState* state);
+
+/* Compiles the self tail call as a jump to the recursion block, the
+ * arguments are the new values of the parameters */
+static LLVMBasicBlockRef compileTailRecursion(AstExpression* call,
+        LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
+
+/* Merges two blocks into one block, only the locals may need phis
+ * The values of the locals before the blocks are in the state */
+static void mergeBlocks(AstDeclaration** locals, int n_locals,
+        LLVMBasicBlockRef left_block, LLVMValueRef* left_values,
+        LLVMBasicBlockRef right_block, LLVMValueRef* right_values,
+        LLVMBasicBlockRef out_block, IRState* state);
+
+/* Returns the local variables assigned by the if or while statement that
+ * are visible before it */
+static AstDeclaration** getAssignedLocals(AstStatement* statement, int* n,
+        IRState* state);
+
+/* Copies the current values of the locals to the array */
+static void saveLocals(AstDeclaration** locals, int n_locals,
+        LLVMValueRef* values, IRState* state);
+
+/* Sets the current values of the locals from the array */
+static void restoreLocals(AstDeclaration** locals, int n_locals,
+        LLVMValueRef* values, IRState* state);
 
 /* Links the phis variables */
-static void linkPhis(TablePair* locals, int n_locals, LLVMValueRef* phis,
-        TableRef left_declarations, Vector* left_arrives,
-        TableRef right_declarations, Vector* right_arrives);
+static void linkPhis(int n_locals, LLVMValueRef* phis,
+        LLVMValueRef* left_values, Vector* left_arrives,
+        LLVMValueRef* right_values, Vector* right_arrives);
 
 /* Compiles expressions */
 static IRBlockValue compileExpression(AstExpression* expression,
@@ -160,6 +380,11 @@ static IRBlockValue compileExpressionVariable(AstExpression* expression,
 static IRBlockValue compileExpressionNew(AstExpression* expression,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
 
+/* Allocates the array that doesn't escape in the function's entry block,
+ * its size is a constant */
+static LLVMValueRef compileStackArray(AstExpression* expression,
+        IRState* state);
+
 static IRBlockValue compileExpressionUnary(AstExpression* expression,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
 
@@ -182,6 +407,9 @@ static LLVMValueRef compileExpressionBinaryIntCmp(AstBinaryOperator operator,
 static LLVMValueRef compileExpressionBinaryFloatCmp(AstBinaryOperator operator,
         LLVMValueRef lhs, LLVMValueRef rhs, IRState* state);
 
+/* Sets the current function's fast math flags in the float instruction */
+static void setFastMathFlags(LLVMValueRef instruction, IRState* state);
+
 static IRBlockValue compileExpressionCast(AstExpression* expression,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
 
@@ -205,7 +433,8 @@ static void compileJumpBinary(AstExpression* expression,
         Vector* arrive_at_true, Vector* arrive_at_false);
 
 
-/* Returns the pointer to the array's element */
+/* Returns the pointer to the array's element, the index is checked if
+ * ir_bounds_check is set */
 static IRBlockValue compileVariableArray(AstVariable* variable,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state);
 
@@ -213,17 +442,72 @@ static IRBlockValue compileVariableArray(AstVariable* variable,
  * SECTION: Implementation
  */
 
-LLVMModuleRef IRCompileModule(AstDeclaration* tree)
+void IRSelectWrapv(bool wrapv)
+{
+    ir_wrapv = wrapv;
+}
+
+void IRSelectCheckRestrict(bool check)
+{
+    ir_check_restrict = check;
+}
+
+void IRSelectBoundsCheck(bool check)
 {
-    LLVMModuleRef module = LLVMModuleCreateWithName("monga-executable");
+    ir_bounds_check = check;
+}
+
+void IRSelectFastMath(unsigned flags)
+{
+    ir_fast_math = flags;
+}
+
+void IRSelectDebugInfo(bool debug)
+{
+    ir_debug_info = debug;
+}
+
+LLVMModuleRef IRCompileModule(AstDeclaration* tree, const char* file_name,
+        LLVMContextRef context)
+{
+    LLVMModuleRef module =
+            LLVMModuleCreateWithNameInContext("monga-executable", context);
 
     TableRef declarations = TableCreateDummy();
     IRState* state = createState(module);
+    createDebugUnit(file_name, state);
+    RuntimeDeclare(module, &state->runtime);
 
-    compileStrings(state);
-    compileGlobalVariables(tree, declarations, state);
+    compileGlobalVariables(tree, declarations, true, state);
     compileFunctionsDeclarations(tree, declarations, state);
 
+    // The modules linked together share the runtime, so it is linkonce_odr
+    if (RuntimeIsUsed(&state->runtime))
+        RuntimeDefine(module, LLVMLinkOnceODRLinkage, &state->runtime);
+    else
+        RuntimeRemove(&state->runtime);
+
+    TableDestroy(declarations);
+    destroyState(state);
+
+    verifyModule(module);
+    return module;
+}
+
+LLVMModuleRef IRCompileLazyModule(AstDeclaration* tree,
+        LLVMContextRef context)
+{
+    LLVMModuleRef module =
+            LLVMModuleCreateWithNameInContext("monga-lazy", context);
+
+    TableRef declarations = TableCreateDummy();
+    IRState* state = createState(module);
+    RuntimeDeclare(module, &state->runtime);
+    RuntimeDefine(module, LLVMExternalLinkage, &state->runtime);
+
+    compileGlobalVariables(tree, declarations, true, state);
+    compileFunctionsStubs(tree, declarations, state);
+
     TableDestroy(declarations);
     destroyState(state);
 
@@ -231,50 +515,215 @@ LLVMModuleRef IRCompileModule(AstDeclaration* tree)
     return module;
 }
 
+LLVMModuleRef IRCompileLazyFunction(AstDeclaration* tree,
+        AstDeclaration* function, const char* file_name,
+        LLVMContextRef context, LLVMValueRef* body)
+{
+    LLVMModuleRef module =
+            LLVMModuleCreateWithNameInContext(function->identifier, context);
+
+    TableRef declarations = TableCreateDummy();
+    IRState* state = createState(module);
+    createDebugUnit(file_name, state);
+    RuntimeDeclare(module, &state->runtime);
+    state->lazy = true;
+
+    compileGlobalVariables(tree, declarations, false, state);
+    compileFunctionsAddresses(tree, declarations, state);
+
+    size_t length = strlen(function->identifier);
+    char name[length + sizeof(".body")];
+    sprintf(name, "%s.body", function->identifier);
+    state->function = LLVMAddFunction(module, name,
+            createFunctionType(function, state));
+    setParametersAttributes(function, state->function, state);
+    setEffectsAttributes(function, state->function, state);
+    compileFunction(function, declarations, state);
+    *body = state->function;
+
+    TableDestroy(declarations);
+    destroyState(state);
+
+    verifyModule(module);
+    return module;
+}
+
+void IRRemoveLinkedFlushes(LLVMModuleRef module)
+{
+    unsigned kind = LLVMGetMDKindIDInContext(LLVMGetModuleContext(module),
+            EXTERN_FLUSH_METADATA, strlen(EXTERN_FLUSH_METADATA));
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    for (; function != NULL; function = LLVMGetNextFunction(function)) {
+        LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function);
+        for (; block != NULL; block = LLVMGetNextBasicBlock(block)) {
+            LLVMValueRef instruction = LLVMGetFirstInstruction(block);
+            while (instruction != NULL) {
+                // The extern call follows its flush
+                LLVMValueRef next = LLVMGetNextInstruction(instruction);
+                if (LLVMGetMetadata(instruction, kind) != NULL &&
+                    LLVMIsACallInst(next)) {
+                    LLVMValueRef callee = LLVMGetCalledValue(next);
+                    if (LLVMIsAFunction(callee) && !LLVMIsDeclaration(callee))
+                        LLVMInstructionEraseFromParent(instruction);
+                }
+                instruction = next;
+            }
+        }
+    }
+}
+
 static void verifyModule(LLVMModuleRef module)
 {
+    PhaseBegin("verify");
     char *error = NULL;
     LLVMVerifyModule(module, LLVMPrintMessageAction, &error);
     LLVMDisposeMessage(error);
+    PhaseEnd();
 }
 
 static IRState* createState(LLVMModuleRef module)
 {
     IRState* state = NEW(IRState);
     state->module = module;
-    state->builder = LLVMCreateBuilder();
-    state->printf = createPrintfPrototype(module);
-    state->bool_strings = createBooleanStrings(module);
+    state->context = LLVMGetModuleContext(module);
+    state->void_type = LLVMVoidTypeInContext(state->context);
+    state->bool_type = LLVMInt1TypeInContext(state->context);
+    state->char_type = LLVMInt8TypeInContext(state->context);
+    state->int_type = LLVMInt32TypeInContext(state->context);
+    state->float_type = LLVMFloatTypeInContext(state->context);
+    state->string_type = LLVMPointerType(state->char_type, 0);
+    state->builder = LLVMCreateBuilderInContext(state->context);
     state->strings = TableCreateDummy();
     state->function = NULL;
+    state->declaration = NULL;
+    state->main = false;
+    state->assigned_variables = NULL;
+    state->locals = NULL;
+    state->alias_scopes = NULL;
+    state->noalias_scopes = NULL;
+    state->all_scopes = NULL;
+    state->alias_scope_kind = LLVMGetMDKindIDInContext(state->context,
+            "alias.scope", strlen("alias.scope"));
+    state->noalias_kind = LLVMGetMDKindIDInContext(state->context,
+            "noalias", strlen("noalias"));
+    const char* root_name = "Monga TBAA";
+    LLVMMetadataRef root_string = LLVMMDStringInContext2(state->context,
+            root_name, strlen(root_name));
+    state->tbaa_root = LLVMMDNodeInContext2(state->context, &root_string, 1);
+    state->tbaa_kind = LLVMGetMDKindIDInContext(state->context, "tbaa",
+            strlen("tbaa"));
+    state->loop_kind = LLVMGetMDKindIDInContext(state->context, "llvm.loop",
+            strlen("llvm.loop"));
+    state->lazy = false;
+    state->fast_math = 0;
+    state->recursion = NULL;
+    state->recursion_block = NULL;
+    state->recursion_phis = NULL;
+    state->bounds_trap = NULL;
+    state->invariant_load_kind = LLVMGetMDKindIDInContext(state->context,
+            "invariant.load", strlen("invariant.load"));
+    state->extern_flush_kind = LLVMGetMDKindIDInContext(state->context,
+            EXTERN_FLUSH_METADATA, strlen(EXTERN_FLUSH_METADATA));
+    state->debug_builder = NULL;
+    state->debug_file = NULL;
+    state->debug_unit = NULL;
+    state->debug_scope = NULL;
     return state;
 }
 
 static void destroyState(IRState* state)
 {
+    // The subprograms are only complete after the finalization
+    if (state->debug_builder != NULL) {
+        LLVMDIBuilderFinalize(state->debug_builder);
+        LLVMDisposeDIBuilder(state->debug_builder);
+    }
     LLVMDisposeBuilder(state->builder);
     TableDestroy(state->strings);
     free(state);
 }
 
-static LLVMTypeRef createType(Type type)
+static void createDebugUnit(const char* file_name, IRState* state)
+{
+    if (!ir_debug_info)
+        return;
+
+    // The relative names are found from the compilation directory
+    const char* name = file_name != NULL ? file_name : "<stdin>";
+    char directory[PATH_MAX];
+    if (getcwd(directory, sizeof(directory)) == NULL)
+        strcpy(directory, ".");
+
+    state->debug_builder = LLVMCreateDIBuilder(state->module);
+    state->debug_file = LLVMDIBuilderCreateFile(state->debug_builder, name,
+            strlen(name), directory, strlen(directory));
+
+    // Monga has no DWARF language code, C99 is the closest one
+    const char* producer = "monga";
+    state->debug_unit = LLVMDIBuilderCreateCompileUnit(state->debug_builder,
+            LLVMDWARFSourceLanguageC99, state->debug_file, producer,
+            strlen(producer), false, "", 0, 0, "", 0,
+            LLVMDWARFEmissionFull, 0, false, false, "", 0, "", 0);
+
+    const char* version_key = "Debug Info Version";
+    LLVMAddModuleFlag(state->module, LLVMModuleFlagBehaviorWarning,
+            version_key, strlen(version_key), LLVMValueAsMetadata(
+                    LLVMConstInt(state->int_type, LLVMDebugMetadataVersion(),
+                            false)));
+    const char* dwarf_key = "Dwarf Version";
+    LLVMAddModuleFlag(state->module, LLVMModuleFlagBehaviorWarning,
+            dwarf_key, strlen(dwarf_key), LLVMValueAsMetadata(
+                    LLVMConstInt(state->int_type, 4, false)));
+}
+
+static void createDebugFunction(AstDeclaration* function, IRState* state)
+{
+    // The lazy bodies keep the function's name, their symbols have a suffix
+    size_t linkage_length = 0;
+    const char* linkage_name = LLVMGetValueName2(state->function,
+            &linkage_length);
+    if (strcmp(linkage_name, function->identifier) == 0)
+        linkage_length = 0;
+    LLVMMetadataRef type = LLVMDIBuilderCreateSubroutineType(
+            state->debug_builder, state->debug_file, NULL, 0,
+            LLVMDIFlagZero);
+    state->debug_scope = LLVMDIBuilderCreateFunction(state->debug_builder,
+            state->debug_file, function->identifier,
+            strlen(function->identifier), linkage_name, linkage_length,
+            state->debug_file, function->line, type, false, true,
+            function->line, LLVMDIFlagZero, false);
+    LLVMSetSubprogram(state->function, state->debug_scope);
+}
+
+static void setDebugLocation(int line, IRState* state)
+{
+    // The statements added by the analysis, like the implicit return, have
+    // no line, so they keep the previous one
+    if (state->debug_scope == NULL || line < 0)
+        return;
+    LLVMSetCurrentDebugLocation2(state->builder,
+            LLVMDIBuilderCreateDebugLocation(state->context, line, 0,
+                    state->debug_scope, NULL));
+}
+
+static LLVMTypeRef createType(Type type, IRState* state)
 {
     LLVMTypeRef llvm_type;
     switch (type.tag) {
         case TYPE_VOID:
-            llvm_type = LLVMVoidType();
+            llvm_type = state->void_type;
             break;
         case TYPE_BOOL:
-            llvm_type = LLVMIntType(1);
+            llvm_type = state->bool_type;
             break;
         case TYPE_CHAR:
-            llvm_type = LLVMInt8Type();
+            llvm_type = state->char_type;
             break;
         case TYPE_INT:
-            llvm_type = LLVMInt32Type();
+            llvm_type = state->int_type;
             break;
         case TYPE_FLOAT:
-            llvm_type = LLVMFloatType();
+            llvm_type = state->float_type;
             break;
         case TYPE_UNDEFINED:
             // Unexpected case
@@ -287,121 +736,79 @@ static LLVMTypeRef createType(Type type)
     return llvm_type;
 }
 
-static LLVMTypeRef createFunctionType(AstDeclaration* function)
+static LLVMTypeRef createFunctionType(AstDeclaration* function,
+        IRState* state)
 {
     int n_parameters = function->u.function_.n_parameters;
     LLVMTypeRef parameters_types[n_parameters];
     AstDeclaration* parameter = function->u.function_.parameters;
     for (int i = 0; i < n_parameters; ++i) {
-        parameters_types[i] = createType(parameter->type);
+        parameters_types[i] = createType(parameter->type, state);
         parameter = parameter->next;
     }
-    LLVMTypeRef return_type = createType(function->type);
+    LLVMTypeRef return_type = createType(function->type, state);
     return LLVMFunctionType(return_type, parameters_types, n_parameters, false);
 }
 
-static LLVMValueRef createPrintfPrototype(LLVMModuleRef module)
-{
-    LLVMTypeRef param_types[] = {LLVMPointerType(LLVMInt8Type(), 0)};
-    LLVMTypeRef type = LLVMFunctionType(LLVMInt32Type(), param_types, 1,
-            true);
-    LLVMValueRef function = LLVMAddFunction(module, "printf", type);
-    return function;
-}
-
-static LLVMValueRef createBooleanStrings(LLVMModuleRef module)
+static void removeLocals(AstDeclaration* variables, IRState* state)
 {
-    LLVMTypeRef str_type = LLVMPointerType(LLVMInt8Type(), 0);
-
-    LLVMValueRef false_string = LLVMAddGlobal(module,
-            LLVMArrayType(LLVMInt8Type(), 6), ".false");
-    LLVMSetInitializer(false_string, LLVMConstString("false", 6, true));
-    LLVMValueRef false_ptr = LLVMConstPointerCast(false_string, str_type);
-
-    LLVMValueRef true_string = LLVMAddGlobal(module,
-            LLVMArrayType(LLVMInt8Type(), 5), ".true");
-    LLVMSetInitializer(true_string, LLVMConstString("true", 5, true));
-    LLVMValueRef true_ptr = LLVMConstPointerCast(true_string, str_type);
-
-    LLVMValueRef strings = LLVMAddGlobal(module,
-            LLVMArrayType(str_type, 2), ".boolean");
-    LLVMValueRef array_values[] = {false_ptr, true_ptr};
-    LLVMValueRef array = LLVMConstArray(str_type, array_values, 2);
-    LLVMSetInitializer(strings, array);
-
-    return strings;
-}
-
-static LLVMValueRef createPrintfFormat(AstExpression* expressions,
-        IRState* state)
-{
-    char format[MAX_FORMAT];
-    format[0] = '\0';
-    Type last_type = TypeCreate(TYPE_UNDEFINED, 0);
-    AST_FOREACH(AstExpression, expression, expressions) {
-        Type type = expression->type;
-        if (TypeIsString(type)) {
-            strcat(format, "%s");
-        } else if (TypeIsArray(type)) {
-            strcat(format, "<pointer> (0x %p)");
-        } else if (TypeIsBool(type)) {
-            strcat(format, "%s");
-        } else if (TypeIsInt(type)) {
-            strcat(format, "%d");
-        } else if (TypeIsFloat(type)) {
-            strcat(format, "%f");
-        } else if (TypeIsVoid(type)) {
-            strcat(format, "<void>");
-        } else {
-            assert(false);
-        }
-        last_type = type;
-    }
-    if (!TypeIsString(last_type))
-    {
-        strcat(format, "\n");
+    AST_FOREACH(AstDeclaration, variable, variables) {
+        state->locals[variable->u.variable_.offset] = NULL;
     }
-    LLVMValueRef llvm_format = 
-            LLVMBuildGlobalString(state->builder, format, "");
-    return LLVMBuildPointerCast(state->builder, llvm_format,
-            LLVMPointerType(LLVMInt8Type(), 0), "");
 }
 
-static void removeDeclarations(AstDeclaration* variables, TableRef declarations)
+static LLVMValueRef getString(char* string, IRState* state)
 {
-    AST_FOREACH(AstDeclaration, variable, variables) {
-        TableErase(declarations, variable);
+    LLVMValueRef llvm_string = TableFind(state->strings, string).data;
+    if (llvm_string != NULL)
+        return llvm_string;
+
+    size_t len = strlen(string);
+    LLVMValueRef initializer =
+            LLVMConstStringInContext(state->context, string, len, false);
+    if (ir_bounds_check) {
+        // The literal has the array header, it is a struct with the padding,
+        // the length and the characters
+        LLVMValueRef fields[] = {
+            LLVMConstInt(state->int_type, 0, false),
+            LLVMConstInt(state->int_type, len + 1, false),
+            initializer
+        };
+        initializer = LLVMConstStructInContext(state->context, fields, 3,
+                false);
+    }
+    llvm_string = LLVMAddGlobal(state->module, LLVMTypeOf(initializer), "");
+    LLVMSetInitializer(llvm_string, initializer);
+    LLVMSetLinkage(llvm_string, LLVMPrivateLinkage);
+    if (ir_bounds_check) {
+        LLVMValueRef indices[] = {
+            LLVMConstInt(state->int_type, 0, false),
+            LLVMConstInt(state->int_type, 2, false)
+        };
+        llvm_string = LLVMConstInBoundsGEP(llvm_string, indices, 2);
     }
+    TableInsert(state->strings, string, llvm_string);
+    return llvm_string;
 }
 
-static void compileStrings(IRState* state)
+static LLVMBasicBlockRef appendBlock(const char* name, IRState* state)
 {
-    Vector* strings = ScannerGetStrings();
-    if (strings == NULL)
-        return;
-
-    for (size_t i = 0; i < VectorSize(strings); ++i) {
-        char* string = (char*)VectorGet(strings, i);
-        size_t len = strlen(string);
-        LLVMTypeRef type = LLVMArrayType(LLVMInt8Type(), len + 1);
-        LLVMValueRef llvm_string = LLVMAddGlobal(state->module, type, "");
-        LLVMSetInitializer(llvm_string, LLVMConstString(string, len, false));
-        LLVMSetVisibility(llvm_string, LLVMHiddenVisibility);
-        TableInsert(state->strings, string, llvm_string);
-    }
+    return LLVMAppendBasicBlockInContext(state->context, state->function,
+            name);
 }
 
 static void compileGlobalVariables(AstDeclaration* tree,
-        TableRef declarations, IRState* state)
+        TableRef declarations, bool define, IRState* state)
 {
     AST_FOREACH(AstDeclaration, variable, tree) {
         if (variable->tag != AST_DECLARATION_VARIABLE)
             continue;
 
-        LLVMTypeRef type = createType(variable->type);
+        LLVMTypeRef type = createType(variable->type, state);
         LLVMValueRef llvm_variable = LLVMAddGlobal(state->module, type,
                 variable->identifier);
-        LLVMSetInitializer(llvm_variable, LLVMConstNull(type));
+        if (define && !variable->external)
+            LLVMSetInitializer(llvm_variable, LLVMConstNull(type));
         TableInsert(declarations, variable, llvm_variable);
     }
 }
@@ -413,41 +820,542 @@ static void compileFunctionsDeclarations(AstDeclaration* tree,
         if (function->tag != AST_DECLARATION_FUNCTION)
             continue;
 
-        LLVMTypeRef type = createFunctionType(function);
+        if (function->external) {
+            compileExternalFunction(function, declarations, state);
+            continue;
+        }
+
+        LLVMTypeRef type = createFunctionType(function, state);
         state->function = LLVMAddFunction(state->module, function->identifier,
                 type);
+        setParametersAttributes(function, state->function, state);
+        setEffectsAttributes(function, state->function, state);
         TableInsert(declarations, function, state->function);
+        compileFunction(function, declarations, state);
+    }
+}
+
+static void compileFunctionsStubs(AstDeclaration* tree,
+        TableRef declarations, IRState* state)
+{
+    LLVMTypeRef str_type = state->string_type;
+    LLVMTypeRef index_type = state->int_type;
+    LLVMTypeRef lazy_type = LLVMFunctionType(str_type, &index_type, 1, false);
+    LLVMValueRef lazy_compile = LLVMAddFunction(state->module,
+            IR_LAZY_COMPILE_FUNCTION, lazy_type);
+
+    int index = 0;
+    AST_FOREACH(AstDeclaration, function, tree) {
+        if (function->tag != AST_DECLARATION_FUNCTION)
+            continue;
+
+        if (function->external) {
+            compileExternalFunction(function, declarations, state);
+            continue;
+        }
+
+        // The stub has the function's name, so it is the external entry point
+        LLVMTypeRef type = createFunctionType(function, state);
+        LLVMValueRef stub = LLVMAddFunction(state->module,
+                function->identifier, type);
+        setParametersAttributes(function, stub, state);
+
+        size_t length = strlen(function->identifier);
+        char name[length + sizeof(".addr")];
+        sprintf(name, "%s.addr", function->identifier);
+        LLVMTypeRef address_type = LLVMPointerType(type, 0);
+        LLVMValueRef address = LLVMAddGlobal(state->module, address_type,
+                name);
+        LLVMSetInitializer(address, stub);
+        TableInsert(declarations, function, address);
+
+        // Compiles the body, stores its address and forwards the call
+        LLVMPositionBuilderAtEnd(state->builder,
+                LLVMAppendBasicBlockInContext(state->context, stub,
+                        "entry"));
+        LLVMValueRef llvm_index = LLVMConstInt(index_type, index++, false);
+        LLVMValueRef body = LLVMBuildCall(state->builder, lazy_compile,
+                &llvm_index, 1, "");
+        body = LLVMBuildBitCast(state->builder, body, address_type, "");
+        LLVMBuildStore(state->builder, body, address);
+
+        int n_parameters = function->u.function_.n_parameters;
+        LLVMValueRef parameters[n_parameters];
+        for (int i = 0; i < n_parameters; ++i)
+            parameters[i] = LLVMGetParam(stub, i);
+        LLVMValueRef value = LLVMBuildCall(state->builder, body, parameters,
+                n_parameters, "");
+        LLVMSetTailCall(value, true);
+        if (TypeIsVoid(function->type))
+            LLVMBuildRetVoid(state->builder);
+        else
+            LLVMBuildRet(state->builder, value);
+    }
+}
+
+static void compileFunctionsAddresses(AstDeclaration* tree,
+        TableRef declarations, IRState* state)
+{
+    AST_FOREACH(AstDeclaration, function, tree) {
+        if (function->tag != AST_DECLARATION_FUNCTION)
+            continue;
+
+        if (function->external) {
+            compileExternalFunction(function, declarations, state);
+            continue;
+        }
+
+        size_t length = strlen(function->identifier);
+        char name[length + sizeof(".addr")];
+        sprintf(name, "%s.addr", function->identifier);
+        LLVMTypeRef address_type =
+                LLVMPointerType(createFunctionType(function, state), 0);
+        LLVMValueRef address = LLVMAddGlobal(state->module, address_type,
+                name);
+        TableInsert(declarations, function, address);
+    }
+}
+
+static void compileExternalFunction(AstDeclaration* function,
+        TableRef declarations, IRState* state)
+{
+    LLVMValueRef llvm_function = LLVMAddFunction(state->module,
+            function->identifier, createFunctionType(function, state));
+    setParametersAttributes(function, llvm_function, state);
+    TableInsert(declarations, function, llvm_function);
+}
+
+static void setParametersAttributes(AstDeclaration* function,
+        LLVMValueRef llvm_function, IRState* state)
+{
+    LLVMAttributeIndex index = 1;
+    AST_FOREACH(AstDeclaration, parameter, function->u.function_.parameters) {
+        if (parameter->type.restricted)
+            addAttribute(llvm_function, index, "noalias", state);
+        index++;
+    }
+}
+
+static void setEffectsAttributes(AstDeclaration* function,
+        LLVMValueRef llvm_function, IRState* state)
+{
+    // Monga has no exceptions
+    addAttribute(llvm_function, LLVMAttributeFunctionIndex, "nounwind",
+            state);
+    if (!function->u.function_.recursive)
+        addAttribute(llvm_function, LLVMAttributeFunctionIndex, "norecurse",
+                state);
+
+    // The restrict check and the bounds trap may print, the calls to the
+    // functions that trap can't be removed
+    AstEffect effect = function->u.function_.effect;
+    bool checked = ir_check_restrict || ir_bounds_check;
+    if (effect == AST_EFFECT_NONE && !checked)
+        addAttribute(llvm_function, LLVMAttributeFunctionIndex, "readnone",
+                state);
+    else if (effect == AST_EFFECT_READ && !checked)
+        addAttribute(llvm_function, LLVMAttributeFunctionIndex, "readonly",
+                state);
+
+    LLVMAttributeIndex index = 1;
+    AST_FOREACH(AstDeclaration, parameter, function->u.function_.parameters) {
+        if (TypeIsArray(parameter->type)) {
+            if (!parameter->u.variable_.captured)
+                addAttribute(llvm_function, index, "nocapture", state);
+            if (!parameter->u.variable_.written)
+                addAttribute(llvm_function, index, "readonly", state);
+        }
+        index++;
+    }
+}
+
+static void addAttribute(LLVMValueRef function, LLVMAttributeIndex index,
+        const char* name, IRState* state)
+{
+    unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+    LLVMAttributeRef attribute =
+            LLVMCreateEnumAttribute(state->context, kind, 0);
+    if (LLVMIsACallInst(function))
+        LLVMAddCallSiteAttribute(function, index, attribute);
+    else
+        LLVMAddAttributeAtIndex(function, index, attribute);
+}
+
+static void compileFunction(AstDeclaration* function, TableRef declarations,
+        IRState* state)
+{
+    int space = function->u.function_.space;
+    state->locals = NEW_ARRAY(LLVMValueRef, space + 1);
+    for (int i = 0; i < space; ++i)
+        state->locals[i] = NULL;
+
+    AstDeclaration* parameters = function->u.function_.parameters;
+    compileParameters(parameters, state);
+    createAliasScopes(function, state);
+
+    state->declaration = function;
+    state->main = strcmp(function->identifier, "main") == 0;
+    state->fast_math = ir_fast_math;
+    AST_FOREACH(AstAnnotation, annotation, function->u.function_.annotations) {
+        if (annotation->tag == AST_ANNOTATION_FASTMATH)
+            state->fast_math = IR_FAST_MATH_ALL;
+    }
+
+    AstStatement* block = function->u.function_.block;
+    state->assigned_variables = TableCreate(TableDummyDestroy,
+            (TableDestroyFunction)VectorDestroy, TableDummyCopy,
+            TableDummyCopy, TableDummyLess);
+    Vector* assigned = VectorCreate();
+    TableRef found = TableCreateDummy();
+    findAssignedVariables(block, assigned, found, state);
+    VectorDestroy(assigned);
+    TableDestroy(found);
+
+    // The entry's checks have the function's line
+    if (state->debug_builder != NULL) {
+        createDebugFunction(function, state);
+        setDebugLocation(function->line, state);
+    }
 
-        AstDeclaration* parameters = function->u.function_.parameters;
-        compileParameters(parameters, declarations, state);
+    LLVMBasicBlockRef entry_block = appendBlock("entry", state);
+    if (ir_check_restrict)
+        entry_block = compileRestrictCheck(function, entry_block, state);
+    if (function->u.function_.tail_recursive &&
+        isRecursionConvertible(function))
+        entry_block = compileRecursionBlock(function, entry_block, state);
+    compileStatements(block, entry_block, declarations, state);
+
+    TableDestroy(state->assigned_variables);
+    state->assigned_variables = NULL;
+    free(state->locals);
+    state->locals = NULL;
+    free(state->alias_scopes);
+    free(state->noalias_scopes);
+    state->alias_scopes = NULL;
+    state->noalias_scopes = NULL;
+    state->all_scopes = NULL;
+    free(state->recursion_phis);
+    state->recursion = NULL;
+    state->recursion_block = NULL;
+    state->recursion_phis = NULL;
+    state->declaration = NULL;
+    state->bounds_trap = NULL;
+    state->debug_scope = NULL;
+    LLVMSetCurrentDebugLocation2(state->builder, NULL);
+}
 
-        AstStatement* block = function->u.function_.block;
-        LLVMBasicBlockRef entry_block =
-                LLVMAppendBasicBlock(state->function, "entry");
-        compileStatements(block, entry_block, declarations, state);
+static void findRestrictVariables(AstDeclaration* variables,
+        AstStatement* statements, Vector* found)
+{
+    AST_FOREACH(AstDeclaration, variable, variables) {
+        if (variable->type.restricted)
+            VectorPush(found, variable);
+    }
 
-        removeDeclarations(parameters, declarations);
+    AST_FOREACH(AstStatement, statement, statements) {
+        switch (statement->tag) {
+        case AST_STATEMENT_BLOCK:
+            findRestrictVariables(statement->u.block_.variables,
+                    statement->u.block_.statements, found);
+            break;
+        case AST_STATEMENT_IF:
+            findRestrictVariables(NULL, statement->u.if_.then_statement,
+                    found);
+            findRestrictVariables(NULL, statement->u.if_.else_statement,
+                    found);
+            break;
+        case AST_STATEMENT_WHILE:
+            findRestrictVariables(NULL, statement->u.while_.statement, found);
+            break;
+        default:
+            break;
+        }
     }
 }
 
-static void compileParameters(AstDeclaration* parameters, TableRef declarations,
+static void createAliasScopes(AstDeclaration* function, IRState* state)
+{
+    Vector* restricted = VectorCreate();
+    findRestrictVariables(function->u.function_.parameters,
+            function->u.function_.block, restricted);
+    int n_restricted = VectorSize(restricted);
+    if (n_restricted == 0) {
+        VectorDestroy(restricted);
+        return;
+    }
+
+    int space = function->u.function_.space;
+    state->alias_scopes = NEW_ARRAY(LLVMValueRef, space);
+    state->noalias_scopes = NEW_ARRAY(LLVMValueRef, space);
+    for (int i = 0; i < space; ++i) {
+        state->alias_scopes[i] = NULL;
+        state->noalias_scopes[i] = NULL;
+    }
+
+    // Each function has its own domain, so inlined scopes don't mix
+    LLVMMetadataRef domain = ExtensionCreateAliasDomain(state->context,
+            function->identifier);
+    LLVMMetadataRef scopes[n_restricted];
+    for (int i = 0; i < n_restricted; ++i) {
+        AstDeclaration* variable = VectorGet(restricted, i);
+        scopes[i] = ExtensionCreateAliasScope(state->context, domain,
+                variable->identifier);
+    }
+
+    LLVMContextRef context = state->context;
+    state->all_scopes = LLVMMetadataAsValue(context,
+            LLVMMDNodeInContext2(context, scopes, n_restricted));
+    for (int i = 0; i < n_restricted; ++i) {
+        AstDeclaration* variable = VectorGet(restricted, i);
+        int slot = variable->u.variable_.offset;
+        state->alias_scopes[slot] = LLVMMetadataAsValue(context,
+                LLVMMDNodeInContext2(context, &scopes[i], 1));
+
+        // The other scopes, the variable's scope is swapped to the end
+        if (n_restricted > 1) {
+            LLVMMetadataRef others[n_restricted];
+            memcpy(others, scopes, sizeof(others));
+            others[i] = others[n_restricted - 1];
+            state->noalias_scopes[slot] = LLVMMetadataAsValue(context,
+                    LLVMMDNodeInContext2(context, others, n_restricted - 1));
+        }
+    }
+    VectorDestroy(restricted);
+}
+
+static void setAliasMetadata(LLVMValueRef access, AstVariable* variable,
         IRState* state)
+{
+    if (state->all_scopes == NULL)
+        return;
+
+    // The elements of every dimension belong to the outermost array
+    AstExpression* location = variable->u.array_.location;
+    while (location->tag == AST_EXPRESSION_VARIABLE &&
+           location->u.variable_->tag == AST_VARIABLE_ARRAY)
+        location = location->u.variable_->u.array_.location;
+
+    AstDeclaration* declaration = NULL;
+    if (location->tag == AST_EXPRESSION_VARIABLE)
+        declaration = location->u.variable_->u.reference_.u.declaration_;
+
+    if (declaration != NULL && !declaration->u.variable_.global &&
+        declaration->type.restricted) {
+        int slot = declaration->u.variable_.offset;
+        LLVMSetMetadata(access, state->alias_scope_kind,
+                state->alias_scopes[slot]);
+        if (state->noalias_scopes[slot] != NULL)
+            LLVMSetMetadata(access, state->noalias_kind,
+                    state->noalias_scopes[slot]);
+    } else {
+        LLVMSetMetadata(access, state->noalias_kind, state->all_scopes);
+    }
+}
+
+static void setTypeMetadata(LLVMValueRef access, Type type, IRState* state)
+{
+    // The nodes are uniqued by the context, so they are created every time
+    LLVMContextRef context = state->context;
+    char* name = TypeToString(TypeCreate(type.tag, type.pointers));
+    LLVMMetadataRef offset = LLVMValueAsMetadata(LLVMConstInt(
+            LLVMInt64TypeInContext(context), 0, false));
+    LLVMMetadataRef type_fields[] = {
+        LLVMMDStringInContext2(context, name, strlen(name)),
+        state->tbaa_root,
+        offset
+    };
+    LLVMMetadataRef type_node = LLVMMDNodeInContext2(context, type_fields, 3);
+    LLVMMetadataRef tag_fields[] = {type_node, type_node, offset};
+    LLVMMetadataRef tag = LLVMMDNodeInContext2(context, tag_fields, 3);
+    LLVMSetMetadata(access, state->tbaa_kind,
+            LLVMMetadataAsValue(context, tag));
+    free(name);
+}
+
+static LLVMBasicBlockRef compileRestrictCheck(AstDeclaration* function,
+        LLVMBasicBlockRef in_block, IRState* state)
+{
+    LLVMBasicBlockRef out_block = in_block;
+    AstDeclaration* parameters = function->u.function_.parameters;
+    int i = 0;
+    AST_FOREACH(AstDeclaration, parameter, parameters) {
+        int j = 0;
+        AST_FOREACH(AstDeclaration, other, parameters) {
+            // Arrays of different types are never the same array, and each
+            // pair of restrict arrays is checked once
+            bool checked = parameter->type.restricted && i != j &&
+                    TypeEquals(parameter->type, other->type) &&
+                    !(other->type.restricted && j < i);
+            j++;
+            if (!checked)
+                continue;
+
+            // Null arrays aren't accessed, so they may be equal
+            LLVMValueRef lhs = state->locals[parameter->u.variable_.offset];
+            LLVMValueRef rhs = state->locals[other->u.variable_.offset];
+            LLVMPositionBuilderAtEnd(state->builder, out_block);
+            LLVMValueRef overlap = LLVMBuildAnd(state->builder,
+                    LLVMBuildICmp(state->builder, LLVMIntEQ, lhs, rhs, ""),
+                    LLVMBuildIsNotNull(state->builder, lhs, ""), "");
+            LLVMBasicBlockRef trap_block = appendBlock("restrict.trap", state);
+            out_block = appendBlock("restrict.ok", state);
+            LLVMBuildCondBr(state->builder, overlap, trap_block, out_block);
+
+            LLVMPositionBuilderAtEnd(state->builder, trap_block);
+            compileRestrictTrap(function, parameter, other, state);
+        }
+        i++;
+    }
+    return out_block;
+}
+
+static void compileRestrictTrap(AstDeclaration* function,
+        AstDeclaration* parameter, AstDeclaration* other, IRState* state)
+{
+    const char* format = "monga: restrict arguments '%s' and '%s' of '%s' "
+            "overlap\n";
+    size_t length = strlen(format) + strlen(parameter->identifier) +
+            strlen(other->identifier) + strlen(function->identifier);
+    char message[length];
+    sprintf(message, format, parameter->identifier, other->identifier,
+            function->identifier);
+    compileTrap(message, state);
+}
+
+static void compileTrap(const char* message, IRState* state)
+{
+    LLVMValueRef dprintf = LLVMGetNamedFunction(state->module, "dprintf");
+    if (dprintf == NULL) {
+        LLVMTypeRef parameters_types[] = {state->int_type, state->string_type};
+        dprintf = LLVMAddFunction(state->module, "dprintf",
+                LLVMFunctionType(state->int_type, parameters_types, 2, true));
+    }
+    LLVMValueRef trap = LLVMGetNamedFunction(state->module, "llvm.trap");
+    if (trap == NULL) {
+        trap = LLVMAddFunction(state->module, "llvm.trap",
+                LLVMFunctionType(state->void_type, NULL, 0, false));
+    }
+
+    // The message goes to stderr, since the trap doesn't flush stdout
+    // The output written before the trap is flushed
+    LLVMBuildCall(state->builder, state->runtime.flush, NULL, 0, "");
+    LLVMValueRef arguments[] = {
+        LLVMConstInt(state->int_type, 2, false),
+        LLVMBuildGlobalStringPtr(state->builder, message, "")
+    };
+    LLVMBuildCall(state->builder, dprintf, arguments, 2, "");
+    LLVMBuildCall(state->builder, trap, NULL, 0, "");
+    LLVMBuildUnreachable(state->builder);
+}
+
+static LLVMBasicBlockRef getBoundsTrap(IRState* state)
+{
+    if (state->bounds_trap != NULL)
+        return state->bounds_trap;
+
+    LLVMBasicBlockRef current_block = LLVMGetInsertBlock(state->builder);
+    state->bounds_trap = appendBlock("bounds.trap", state);
+    LLVMPositionBuilderAtEnd(state->builder, state->bounds_trap);
+    const char* identifier = state->declaration->identifier;
+    const char* format = "monga: array index out of bounds in '%s'\n";
+    char message[strlen(format) + strlen(identifier)];
+    sprintf(message, format, identifier);
+    compileTrap(message, state);
+    LLVMPositionBuilderAtEnd(state->builder, current_block);
+    return state->bounds_trap;
+}
+
+static LLVMValueRef buildArrayLengthAddress(LLVMValueRef array,
+        IRState* state)
+{
+    LLVMValueRef header = LLVMBuildPointerCast(state->builder, array,
+            LLVMPointerType(state->int_type, 0), "");
+    LLVMValueRef index = LLVMConstInt(state->int_type, -1, true);
+    return LLVMBuildInBoundsGEP(state->builder, header, &index, 1, "");
+}
+
+static LLVMValueRef buildArrayLength(LLVMValueRef array, IRState* state)
+{
+    // The load is invariant, so LICM hoists it out of the loops that access
+    // the array
+    LLVMValueRef length = LLVMBuildLoad(state->builder,
+            buildArrayLengthAddress(array, state), "length");
+    LLVMSetMetadata(length, state->invariant_load_kind,
+            LLVMMDNodeInContext(state->context, NULL, 0));
+    return length;
+}
+
+static void findAssignedVariables(AstStatement* statements, Vector* assigned,
+        TableRef found, IRState* state)
+{
+    AST_FOREACH(AstStatement, statement, statements) {
+        switch (statement->tag) {
+        case AST_STATEMENT_BLOCK:
+            findAssignedVariables(statement->u.block_.statements, assigned,
+                    found, state);
+            break;
+        case AST_STATEMENT_IF:
+        case AST_STATEMENT_WHILE: {
+            // Each if and while keeps its own variables
+            Vector* statement_assigned = VectorCreate();
+            TableRef statement_found = TableCreateDummy();
+            if (statement->tag == AST_STATEMENT_IF) {
+                findAssignedVariables(statement->u.if_.then_statement,
+                        statement_assigned, statement_found, state);
+                findAssignedVariables(statement->u.if_.else_statement,
+                        statement_assigned, statement_found, state);
+            } else {
+                findAssignedVariables(statement->u.while_.statement,
+                        statement_assigned, statement_found, state);
+            }
+            TableDestroy(statement_found);
+            TableInsert(state->assigned_variables, statement,
+                    statement_assigned);
+            for (size_t i = 0; i < VectorSize(statement_assigned); ++i)
+                addAssignedVariable(VectorGet(statement_assigned, i),
+                        assigned, found);
+            break;
+        }
+        case AST_STATEMENT_ASSIGN: {
+            AstVariable* variable = statement->u.assign_.variable;
+            if (variable->tag != AST_VARIABLE_REFERENCE)
+                break;
+            AstDeclaration* declaration =
+                    variable->u.reference_.u.declaration_;
+            if (!declaration->u.variable_.global)
+                addAssignedVariable(declaration, assigned, found);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+static void addAssignedVariable(AstDeclaration* variable, Vector* assigned,
+        TableRef found)
+{
+    if (TableFind(found, variable).key == NULL) {
+        TableInsert(found, variable, NULL);
+        VectorPush(assigned, variable);
+    }
+}
+
+static void compileParameters(AstDeclaration* parameters, IRState* state)
 {
     int i = 0;
     AST_FOREACH(AstDeclaration, parameter, parameters) {
         LLVMValueRef llvm_parameter = LLVMGetParam(state->function, i++);
         LLVMSetValueName(llvm_parameter, parameter->identifier);
-        TableInsert(declarations, parameter, llvm_parameter);
+        state->locals[parameter->u.variable_.offset] = llvm_parameter;
     }
 }
 
-static void compileLocalVariables(AstDeclaration* variables,
-        TableRef declarations)
+static void compileLocalVariables(AstDeclaration* variables, IRState* state)
 {
     AST_FOREACH(AstDeclaration, variable, variables) {
-        LLVMTypeRef type = createType(variable->type);
-        LLVMValueRef empty_const = LLVMConstNull(type);
-        TableInsert(declarations, variable, empty_const);
+        LLVMTypeRef type = createType(variable->type, state);
+        state->locals[variable->u.variable_.offset] = LLVMConstNull(type);
     }
 }
 
@@ -458,6 +1366,7 @@ static LLVMBasicBlockRef compileStatements(AstStatement* statement,
         return in_block;
 
     LLVMBasicBlockRef out_block = NULL;
+    setDebugLocation(statement->line, state);
     
     switch (statement->tag) {
     case AST_STATEMENT_BLOCK:
@@ -489,6 +1398,10 @@ static LLVMBasicBlockRef compileStatements(AstStatement* statement,
                 state);
         break;
     case AST_STATEMENT_CALL:
+        // The return after the tail recursion is replaced by the jump
+        if (isTailRecursion(statement->u.call_, state))
+            return compileTailRecursion(statement->u.call_, in_block,
+                    declarations, state);
         out_block = compileExpressionCall(statement->u.call_, in_block, 
                 declarations, state).block;
         break;
@@ -501,13 +1414,13 @@ static LLVMBasicBlockRef compileStatementBlock(AstStatement* statement,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
 {
     AstDeclaration* variables = statement->u.block_.variables;
-    compileLocalVariables(variables, declarations);
+    compileLocalVariables(variables, state);
 
     AstStatement* statements = statement->u.block_.statements;
     LLVMBasicBlockRef out_block =
         compileStatements(statements, in_block, declarations, state);
 
-    removeDeclarations(variables, declarations);
+    removeLocals(variables, state);
     return out_block;
 }
 
@@ -516,18 +1429,28 @@ static LLVMBasicBlockRef compileStatementIf(AstStatement* statement,
 {
     // Creates the then and else blocks and build the jump
     LLVMBasicBlockRef then_in_block =
-            LLVMAppendBasicBlock(state->function, "then");
+            appendBlock("then", state);
     LLVMBasicBlockRef else_in_block =
-            LLVMAppendBasicBlock(state->function, "else");
+            appendBlock("else", state);
     AstExpression* expression = statement->u.if_.expression;
     compileJump(expression, in_block, then_in_block, else_in_block,
             declarations, state, NULL, NULL);
 
+    // Only the assigned locals may change, their values are saved
+    // The arrays have one more element, because they can't be empty
+    int n_locals;
+    AstDeclaration** locals = getAssignedLocals(statement, &n_locals, state);
+    LLVMValueRef in_values[n_locals + 1];
+    LLVMValueRef then_values[n_locals + 1];
+    LLVMValueRef else_values[n_locals + 1];
+    saveLocals(locals, n_locals, in_values, state);
+
     // Compiles the then statement
     AstStatement* then_statement = statement->u.if_.then_statement;
-    TableRef then_declarations = TableClone(declarations);
     LLVMBasicBlockRef then_out_block = compileStatements(then_statement,
-            then_in_block, then_declarations, state);
+            then_in_block, declarations, state);
+    saveLocals(locals, n_locals, then_values, state);
+    restoreLocals(locals, n_locals, in_values, state);
 
     // Compiles the else statement
     AstStatement* else_statement = statement->u.if_.else_statement;
@@ -535,28 +1458,28 @@ static LLVMBasicBlockRef compileStatementIf(AstStatement* statement,
         else_statement = AstStatementBlock(NULL, NULL, -1);
         statement->u.if_.else_statement = else_statement;
     }
-    TableRef else_declarations = TableClone(declarations);
     LLVMBasicBlockRef else_out_block = compileStatements(else_statement,
-            else_in_block, else_declarations, state);
+            else_in_block, declarations, state);
+    saveLocals(locals, n_locals, else_values, state);
+    restoreLocals(locals, n_locals, in_values, state);
 
     // Defines the out block
     LLVMBasicBlockRef out_block = NULL;
     if (then_statement->returned || else_statement->returned) {
         if (!then_statement->returned) {
-            updateDeclarations(declarations, then_declarations);
+            restoreLocals(locals, n_locals, then_values, state);
             out_block = then_out_block;
         } else if (!else_statement->returned) {
-            updateDeclarations(declarations, else_declarations);
+            restoreLocals(locals, n_locals, else_values, state);
             out_block = else_out_block;
         }
     } else {
-        out_block = LLVMAppendBasicBlock(state->function, "out");
-        mergeBlocks(then_out_block, then_declarations, else_out_block,
-                else_declarations, out_block, declarations, state);
+        out_block = appendBlock("out", state);
+        mergeBlocks(locals, n_locals, then_out_block, then_values,
+                else_out_block, else_values, out_block, state);
     }
 
-    TableDestroy(then_declarations);
-    TableDestroy(else_declarations);
+    free(locals);
     return out_block;
 }
 
@@ -574,9 +1497,9 @@ static LLVMBasicBlockRef compileStatementWhile(AstStatement* statement,
 
     // Creates the while's blocks
     LLVMBasicBlockRef loop_in_block =
-            LLVMAppendBasicBlock(state->function, "loop_in");
+            appendBlock("loop_in", state);
     LLVMBasicBlockRef end_block =
-            LLVMAppendBasicBlock(state->function, "loop_end");
+            appendBlock("loop_end", state);
 
     // Evaluates the expression before the loop
     AstExpression* expression = statement->u.while_.expression;
@@ -586,130 +1509,140 @@ static LLVMBasicBlockRef compileStatementWhile(AstStatement* statement,
             declarations, state, arrive_at_loop_from_in,
             arrive_at_end_from_in);
 
-    // Create the loop's phis variables
+    // Create the loop's phis variables, only for the assigned locals
     int n_locals;
-    TablePair* locals = getLocalDeclarations(declarations, &n_locals);
-    LLVMValueRef loop_phis[n_locals];
-    TableRef loop_declarations = TableClone(declarations);
+    AstDeclaration** locals = getAssignedLocals(statement, &n_locals, state);
+    LLVMValueRef in_values[n_locals + 1];
+    LLVMValueRef loop_phis[n_locals + 1];
+    saveLocals(locals, n_locals, in_values, state);
     LLVMPositionBuilderAtEnd(state->builder, loop_in_block);
     for (int i = 0; i < n_locals; ++i) {
-        AstDeclaration* declaration = locals[i].key;
-        LLVMTypeRef phi_type = createType(declaration->type);
+        LLVMTypeRef phi_type = createType(locals[i]->type, state);
         loop_phis[i] = LLVMBuildPhi(state->builder, phi_type, "");
-        TableErase(loop_declarations, declaration);
-        TableInsert(loop_declarations, declaration, loop_phis[i]);
     }
+    restoreLocals(locals, n_locals, loop_phis, state);
 
     // Compiles the loop statement
     AstStatement* loop_statement = statement->u.while_.statement;
     LLVMBasicBlockRef loop_out_block = compileStatements(loop_statement,
-            loop_in_block, loop_declarations, state);
+            loop_in_block, declarations, state);
 
     // Evaluetes the expression inside the loop
     Vector* arrive_at_loop_from_loop = VectorCreate();
     Vector* arrive_at_end_from_loop = VectorCreate();
     compileJump(expression, loop_out_block, loop_in_block, end_block,
-            loop_declarations, state, arrive_at_loop_from_loop,
+            declarations, state, arrive_at_loop_from_loop,
             arrive_at_end_from_loop);
+    setLoopMetadata(statement->u.while_.annotations, arrive_at_loop_from_loop,
+            state);
+    LLVMValueRef loop_values[n_locals + 1];
+    saveLocals(locals, n_locals, loop_values, state);
 
     // Creates the end block phis
-    LLVMValueRef end_phis[n_locals];
+    LLVMValueRef end_phis[n_locals + 1];
     LLVMPositionBuilderAtEnd(state->builder, end_block);
     for (int i = 0; i < n_locals; ++i) {
-        AstDeclaration* declaration = locals[i].key;
-        LLVMTypeRef phi_type = createType(declaration->type);
+        LLVMTypeRef phi_type = createType(locals[i]->type, state);
         end_phis[i] = LLVMBuildPhi(state->builder, phi_type, "");
     }
 
     // Link phis
-    linkPhis(locals, n_locals, loop_phis, declarations, arrive_at_loop_from_in,
-            loop_declarations, arrive_at_loop_from_loop);
-    linkPhis(locals, n_locals, end_phis, declarations, arrive_at_end_from_in,
-            loop_declarations, arrive_at_end_from_loop);
+    linkPhis(n_locals, loop_phis, in_values, arrive_at_loop_from_in,
+            loop_values, arrive_at_loop_from_loop);
+    linkPhis(n_locals, end_phis, in_values, arrive_at_end_from_in,
+            loop_values, arrive_at_end_from_loop);
 
-    // Replace phis in out declarations
-    for (int i = 0; i < n_locals; ++i) {
-        AstDeclaration* declaration = locals[i].key;
-        TableErase(declarations, declaration);
-        TableInsert(declarations, declaration, end_phis[i]);
-    }
+    // The end phis are the values after the loop
+    restoreLocals(locals, n_locals, end_phis, state);
 
     // Deallocation
     VectorDestroy(arrive_at_loop_from_in);
     VectorDestroy(arrive_at_end_from_in);
     VectorDestroy(arrive_at_loop_from_loop);
     VectorDestroy(arrive_at_end_from_loop);
-    TableDestroy(loop_declarations);
     free(locals);
     return end_block;
 }
-#if 0
-{
-    // Creates the while's blocks
-    LLVMBasicBlockRef expression_in_block =
-            LLVMAppendBasicBlock(state->function, "while_expression");
-    LLVMBasicBlockRef statement_in_block =
-            LLVMAppendBasicBlock(state->function, "while_statement");
-    LLVMBasicBlockRef out_block =
-            LLVMAppendBasicBlock(state->function, "while_out");
 
-    // Add jump from input block to while's expression block
-    LLVMPositionBuilderAtEnd(state->builder, in_block);
-    LLVMBuildBr(state->builder, expression_in_block);
-
-    // Create phis variables
-    int n_locals;
-    TablePair* locals = getLocalDeclarations(declarations, &n_locals);
-    LLVMValueRef phis[n_locals];
+static void setLoopMetadata(AstAnnotation* annotations, Vector* latches,
+        IRState* state)
+{
+    if (annotations == NULL)
+        return;
 
-    // Add phis at the beginning of the expression block
-    LLVMPositionBuilderAtEnd(state->builder, expression_in_block);
-    for (int i = 0; i < n_locals; ++i) {
-        AstDeclaration* declaration = locals[i].key;
-        LLVMTypeRef phi_type = createType(declaration->type);
-        phis[i] = LLVMBuildPhi(state->builder, phi_type, "");
-        TableErase(declarations, declaration);
-        TableInsert(declarations, declaration, phis[i]);
+    // The later annotations override the earlier ones
+    AstAnnotation* unroll = NULL;
+    AstAnnotation* vectorize = NULL;
+    AstAnnotation* interleave = NULL;
+    AST_FOREACH(AstAnnotation, annotation, annotations) {
+        switch (annotation->tag) {
+        case AST_ANNOTATION_UNROLL:
+        case AST_ANNOTATION_NOUNROLL:
+            unroll = annotation;
+            break;
+        case AST_ANNOTATION_VECTORIZE:
+        case AST_ANNOTATION_NOVECTORIZE:
+            vectorize = annotation;
+            break;
+        case AST_ANNOTATION_INTERLEAVE:
+            interleave = annotation;
+            break;
+        case AST_ANNOTATION_FASTMATH:
+            break;
+        }
     }
 
-    // Compile expression and add the jump to statement block or out block
-    AstExpression* expression = statement->u.while_.expression;
-    compileJump(expression, expression_in_block, statement_in_block, out_block,
-            declarations, state, NULL, NULL);
+    LLVMMetadataRef properties[4];
+    int n = 0;
+    if (unroll != NULL && unroll->tag == AST_ANNOTATION_NOUNROLL) {
+        properties[n++] = createLoopProperty("llvm.loop.unroll.disable", NULL,
+                state);
+    } else if (unroll != NULL && unroll->value == 0) {
+        properties[n++] = createLoopProperty("llvm.loop.unroll.enable", NULL,
+                state);
+    } else if (unroll != NULL) {
+        properties[n++] = createLoopProperty("llvm.loop.unroll.count",
+                LLVMConstInt(state->int_type, unroll->value, false), state);
+    }
 
-    // Compile statement
-    TableRef while_declarations = TableClone(declarations);
-    AstStatement* substatment = statement->u.while_.statement;
-    LLVMBasicBlockRef statement_out_block = compileStatements(substatment,
-            statement_in_block, while_declarations, state);
-    LLVMPositionBuilderAtEnd(state->builder, statement_out_block);
-    LLVMBuildBr(state->builder, expression_in_block);
+    // A width of one disables the vectorization, like clang does
+    if (vectorize != NULL && vectorize->tag == AST_ANNOTATION_NOVECTORIZE) {
+        properties[n++] = createLoopProperty("llvm.loop.vectorize.width",
+                LLVMConstInt(state->int_type, 1, false), state);
+    } else if (vectorize != NULL) {
+        properties[n++] = createLoopProperty("llvm.loop.vectorize.enable",
+                LLVMConstInt(state->bool_type, 1, false), state);
+        if (vectorize->value != 0)
+            properties[n++] = createLoopProperty("llvm.loop.vectorize.width",
+                    LLVMConstInt(state->int_type, vectorize->value, false),
+                    state);
+    }
 
-    // Add phis' incomming values
-    for (int i = 0; i < n_locals; ++i) {
-        AstDeclaration* declaration = locals[i].key;
-        LLVMValueRef in_value = locals[i].data;
-        LLVMValueRef statement_value =
-                TableFind(while_declarations, declaration).data;
-        if (statement_value == phis[i]) {
-            LLVMReplaceAllUsesWith(phis[i], in_value);
-            LLVMInstructionEraseFromParent(phis[i]);
-            TableErase(declarations, declaration);
-            TableInsert(declarations, declaration, in_value);
-        } else {
-            LLVMValueRef incomming_values[] = {in_value, statement_value};
-            LLVMBasicBlockRef incomming_blocks[] = {in_block,
-                    statement_out_block};
-            LLVMAddIncoming(phis[i], incomming_values, incomming_blocks, 2);
-        }
+    if (interleave != NULL) {
+        properties[n++] = createLoopProperty("llvm.loop.interleave.count",
+                LLVMConstInt(state->int_type, interleave->value, false),
+                state);
     }
 
-    TableDestroy(while_declarations);
-    free(locals);
+    // Every latch must have the same loop metadata
+    LLVMValueRef loop = LLVMMetadataAsValue(state->context,
+            ExtensionCreateLoopId(state->context, properties, n));
+    for (size_t i = 0; i < VectorSize(latches); ++i) {
+        LLVMBasicBlockRef latch = VectorGet(latches, i);
+        LLVMSetMetadata(LLVMGetBasicBlockTerminator(latch), state->loop_kind,
+                loop);
+    }
+}
 
-    return out_block;
+static LLVMMetadataRef createLoopProperty(const char* name,
+        LLVMValueRef value, IRState* state)
+{
+    LLVMMetadataRef fields[2];
+    fields[0] = LLVMMDStringInContext2(state->context, name, strlen(name));
+    if (value != NULL)
+        fields[1] = LLVMValueAsMetadata(value);
+    return LLVMMDNodeInContext2(state->context, fields, value != NULL ? 2 : 1);
 }
-#endif
 
 static LLVMBasicBlockRef compileStatementAssign(AstStatement* statement, 
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
@@ -723,7 +1656,7 @@ static LLVMBasicBlockRef compileStatementAssign(AstStatement* statement,
     AstVariable* variable = statement->u.assign_.variable;
     if (TypeIsChar(variable->type)) {
         LLVMPositionBuilderAtEnd(state->builder, in_block);
-        value = LLVMBuildTrunc(state->builder, value, LLVMInt8Type(), "");
+        value = LLVMBuildTrunc(state->builder, value, state->char_type, "");
     }
     LLVMBasicBlockRef out_block;
 
@@ -734,7 +1667,9 @@ static LLVMBasicBlockRef compileStatementAssign(AstStatement* statement,
         LLVMValueRef array = expression_return.value;
         out_block = expression_return.block;
         LLVMPositionBuilderAtEnd(state->builder, out_block);
-        LLVMBuildStore(state->builder, value, array);
+        LLVMValueRef store = LLVMBuildStore(state->builder, value, array);
+        setAliasMetadata(store, variable, state);
+        setTypeMetadata(store, variable->type, state);
         break;
     }
     case AST_VARIABLE_REFERENCE: {
@@ -744,10 +1679,11 @@ static LLVMBasicBlockRef compileStatementAssign(AstStatement* statement,
             LLVMValueRef llvm_variable =
                     TableFind(declarations, declaration).data;
             LLVMPositionBuilderAtEnd(state->builder, out_block);
-            LLVMBuildStore(state->builder, value, llvm_variable);
+            LLVMValueRef store =
+                    LLVMBuildStore(state->builder, value, llvm_variable);
+            setTypeMetadata(store, declaration->type, state);
         } else {
-            TableErase(declarations, declaration);
-            TableInsert(declarations, declaration, value);
+            state->locals[declaration->u.variable_.offset] = value;
         }
         break;
     }
@@ -759,12 +1695,27 @@ static LLVMBasicBlockRef compileStatementAssign(AstStatement* statement,
 static LLVMBasicBlockRef compileStatementDelete(AstStatement* statement, 
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
 {
+    // The arrays of the function's frame are released on its return
+    if (statement->u.delete_.stack)
+        return in_block;
+
     AstExpression* expression = statement->u.delete_.expression;
     IRBlockValue expression_return =
             compileExpression(expression, in_block, declarations, state);
     LLVMBasicBlockRef out_block = expression_return.block;
     LLVMValueRef value = expression_return.value;
     LLVMPositionBuilderAtEnd(state->builder, out_block);
+    if (ir_bounds_check) {
+        // The allocation starts at the header, but null is still freed
+        LLVMValueRef offset =
+                LLVMConstInt(state->int_type, -ARRAY_HEADER_SIZE, true);
+        LLVMValueRef header = LLVMBuildGEP(state->builder,
+                LLVMBuildPointerCast(state->builder, value,
+                        state->string_type, ""), &offset, 1, "");
+        value = LLVMBuildSelect(state->builder,
+                LLVMBuildIsNull(state->builder, value, ""),
+                LLVMConstNull(state->string_type), header, "");
+    }
     LLVMBuildFree(state->builder, value);
     return out_block;
 }
@@ -773,51 +1724,71 @@ static LLVMBasicBlockRef compileStatementPrint(AstStatement* statement,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
 {
     AstExpression* expressions = statement->u.print_.expressions;
+    Runtime* runtime = &state->runtime;
 
-    LLVMValueRef parameters[MAX_N_PARAMETERS];
-    int n = 0;
-    LLVMPositionBuilderAtEnd(state->builder, in_block);
-    parameters[n++] = createPrintfFormat(expressions, state);
-
-    LLVMBasicBlockRef curr_in_block = in_block;
+    LLVMBasicBlockRef out_block = in_block;
+    Type last_type = TypeCreate(TYPE_UNDEFINED, 0);
     AST_FOREACH(AstExpression, expression, expressions) {
         Type type = expression->type;
-        if (TypeIsArray(type) || TypeIsBool(type) || TypeIsInt(type) ||
-            TypeIsFloat(type)) {
-            IRBlockValue expression_return = compileExpression(expression,
-                    curr_in_block, declarations, state);
-            curr_in_block = expression_return.block;
-            LLVMValueRef value = expression_return.value;
-
-            LLVMPositionBuilderAtEnd(state->builder, curr_in_block);
-            if (TypeIsFloat(type)) {
-                value = LLVMBuildFPCast(state->builder, value,
-                        LLVMDoubleType(), "");
-            } else if (TypeIsBool(type)) {
-                LLVMValueRef zero = LLVMConstInt(LLVMInt32Type(), 0, false);
-                LLVMValueRef index = LLVMBuildZExt(state->builder,
-                        value, LLVMInt32Type(), "");
-                LLVMValueRef indices[] = {zero, index};
-                LLVMValueRef location = LLVMBuildGEP(state->builder,
-                        state->bool_strings, indices, 2, "");
-                value = LLVMBuildLoad(state->builder, location, "");
-            }
+        last_type = type;
+        if (expression->tag == AST_EXPRESSION_STRING) {
+            compileWriteBytes(expression->u.string_, out_block, state);
+            continue;
+        } else if (TypeIsVoid(type)) {
+            compileWriteBytes("<void>", out_block, state);
+            continue;
+        }
 
-            parameters[n++] = value;
+        IRBlockValue expression_return = compileExpression(expression,
+                out_block, declarations, state);
+        out_block = expression_return.block;
+        LLVMValueRef value = expression_return.value;
+
+        LLVMValueRef write = NULL;
+        LLVMPositionBuilderAtEnd(state->builder, out_block);
+        if (TypeIsString(type)) {
+            write = runtime->write_string;
+        } else if (TypeIsArray(type)) {
+            write = runtime->write_pointer;
+            value = LLVMBuildPointerCast(state->builder, value,
+                    state->string_type, "");
+        } else if (TypeIsBool(type)) {
+            write = runtime->write_bool;
+        } else if (TypeIsInt(type)) {
+            write = runtime->write_int;
+        } else if (TypeIsFloat(type)) {
+            write = runtime->write_float;
+        } else {
+            assert(false);
         }
+        LLVMBuildCall(state->builder, write, &value, 1, "");
     }
-
-    LLVMBasicBlockRef out_block = curr_in_block;
-    LLVMPositionBuilderAtEnd(state->builder, out_block);
-    LLVMBuildCall(state->builder, state->printf, parameters, n, "");
+    if (!TypeIsString(last_type))
+        compileWriteBytes("\n", out_block, state);
 
     return out_block;
 }
 
+static void compileWriteBytes(char* string, LLVMBasicBlockRef block,
+        IRState* state)
+{
+    LLVMPositionBuilderAtEnd(state->builder, block);
+    LLVMValueRef arguments[] = {
+        LLVMBuildPointerCast(state->builder, getString(string, state),
+                state->string_type, ""),
+        LLVMConstInt(state->int_type, strlen(string), false)
+    };
+    LLVMBuildCall(state->builder, state->runtime.write_bytes, arguments, 2,
+            "");
+}
+
 static LLVMBasicBlockRef compileStatementReturn(AstStatement* statement, 
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
 {
     AstExpression* expression = statement->u.return_.expression;
+    if (expression != NULL && isTailRecursion(expression, state))
+        return compileTailRecursion(expression, in_block, declarations,
+                state);
 
     LLVMBasicBlockRef out_block = in_block;
     LLVMValueRef value = NULL;
@@ -829,6 +1800,8 @@ static LLVMBasicBlockRef compileStatementReturn(AstStatement* statement,
     } 
 
     LLVMPositionBuilderAtEnd(state->builder, out_block);
+    if (state->main)
+        LLVMBuildCall(state->builder, state->runtime.flush, NULL, 0, "");
     if (expression == NULL || TypeIsVoid(expression->type))
         LLVMBuildRetVoid(state->builder);
     else
@@ -837,10 +1810,75 @@ static LLVMBasicBlockRef compileStatementReturn(AstStatement* statement,
     return out_block;
 }
 
-static void mergeBlocks(LLVMBasicBlockRef left_block,
-        TableRef left_declarations, LLVMBasicBlockRef right_block,
-        TableRef right_declarations, LLVMBasicBlockRef out_block,
-        TableRef declarations, IRState* state)
+static bool isRecursionConvertible(AstDeclaration* function)
+{
+    AST_FOREACH(AstDeclaration, parameter, function->u.function_.parameters) {
+        if (parameter->type.restricted)
+            return false;
+    }
+    return true;
+}
+
+static LLVMBasicBlockRef compileRecursionBlock(AstDeclaration* function,
+        LLVMBasicBlockRef in_block, IRState* state)
+{
+    LLVMBasicBlockRef recursion_block = appendBlock("recursion", state);
+    LLVMPositionBuilderAtEnd(state->builder, in_block);
+    LLVMBuildBr(state->builder, recursion_block);
+
+    // The tail calls add their arguments to the phis
+    LLVMPositionBuilderAtEnd(state->builder, recursion_block);
+    int n_parameters = function->u.function_.n_parameters;
+    state->recursion_phis = NEW_ARRAY(LLVMValueRef, n_parameters + 1);
+    int i = 0;
+    AST_FOREACH(AstDeclaration, parameter, function->u.function_.parameters) {
+        int slot = parameter->u.variable_.offset;
+        LLVMValueRef value = state->locals[slot];
+        LLVMValueRef phi = LLVMBuildPhi(state->builder, LLVMTypeOf(value),
+                parameter->identifier);
+        LLVMAddIncoming(phi, &value, &in_block, 1);
+        state->locals[slot] = phi;
+        state->recursion_phis[i++] = phi;
+    }
+
+    state->recursion = function;
+    state->recursion_block = recursion_block;
+    return recursion_block;
+}
+
+static bool isTailRecursion(AstExpression* expression, IRState* state)
+{
+    return expression->tag == AST_EXPRESSION_CALL &&
+           expression->u.call_.tail &&
+           expression->u.call_.u.declaration_ == state->recursion;
+}
+
+static LLVMBasicBlockRef compileTailRecursion(AstExpression* call,
+        LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
+{
+    // All the arguments are evaluated before the parameters change
+    LLVMValueRef arguments[MAX_N_PARAMETERS];
+    int n = 0;
+    LLVMBasicBlockRef out_block = in_block;
+    AST_FOREACH(AstExpression, argument, call->u.call_.expressions) {
+        IRBlockValue argument_return = compileExpression(argument, out_block,
+                declarations, state);
+        out_block = argument_return.block;
+        arguments[n++] = argument_return.value;
+    }
+
+    LLVMPositionBuilderAtEnd(state->builder, out_block);
+    for (int i = 0; i < n; ++i)
+        LLVMAddIncoming(state->recursion_phis[i], &arguments[i], &out_block,
+                1);
+    LLVMBuildBr(state->builder, state->recursion_block);
+    return out_block;
+}
+
+static void mergeBlocks(AstDeclaration** locals, int n_locals,
+        LLVMBasicBlockRef left_block, LLVMValueRef* left_values,
+        LLVMBasicBlockRef right_block, LLVMValueRef* right_values,
+        LLVMBasicBlockRef out_block, IRState* state)
 {
     // Add jumps from left and right to output block
     LLVMPositionBuilderAtEnd(state->builder, left_block);
@@ -849,86 +1887,65 @@ static void mergeBlocks(LLVMBasicBlockRef left_block,
     LLVMBuildBr(state->builder, out_block);
     LLVMPositionBuilderAtEnd(state->builder, out_block);
 
-    // Create phi variables
-    int n_locals;
-    TablePair* locals = getLocalDeclarations(declarations, &n_locals);
-    LLVMValueRef phis[n_locals];
-    LLVMValueRef left_values[n_locals];
-    LLVMValueRef right_values[n_locals];
-
     // Add phis to the beginning of the output block
     for (int i = 0; i < n_locals; ++i) {
-        AstDeclaration* declaration = locals[i].key;
-        LLVMValueRef backup = locals[i].data;
-        left_values[i] = TableFind(left_declarations, declaration).data;
-        right_values[i] = TableFind(right_declarations, declaration).data;
-
-        if (left_values[i] != backup || right_values[i] != backup) {
-            LLVMTypeRef phi_type = createType(declaration->type);
-            phis[i] = LLVMBuildPhi(state->builder, phi_type,
-                    declaration->identifier);
-            TableErase(declarations, declaration);
-            TableInsert(declarations, declaration, phis[i]);
-        } else {
-            phis[i] = NULL;
-        }
-    }
-
-    // Add phis' incomming values
-    for (int i = 0; i < n_locals; ++i) {
-        if (phis[i] == NULL)
+        AstDeclaration* declaration = locals[i];
+        int slot = declaration->u.variable_.offset;
+        LLVMValueRef backup = state->locals[slot];
+        if (left_values[i] == backup && right_values[i] == backup)
             continue;
 
+        LLVMTypeRef phi_type = createType(declaration->type, state);
+        LLVMValueRef phi = LLVMBuildPhi(state->builder, phi_type,
+                declaration->identifier);
         LLVMValueRef incomming_values[] = {left_values[i], right_values[i]};
         LLVMBasicBlockRef incomming_blocks[] = {left_block, right_block};
-        LLVMAddIncoming(phis[i], incomming_values, incomming_blocks, 2);
+        LLVMAddIncoming(phi, incomming_values, incomming_blocks, 2);
+        state->locals[slot] = phi;
     }
-
-    free(locals);
 }
 
-static TablePair* getLocalDeclarations(TableRef declarations, int* n)
+static AstDeclaration** getAssignedLocals(AstStatement* statement, int* n,
+        IRState* state)
 {
-    int n_declarations = TableSize(declarations);
-    TablePair* declaration_pairs = TableToArray(declarations);
+    Vector* assigned =
+            TableFind(state->assigned_variables, statement).data;
+    size_t n_assigned = assigned != NULL ? VectorSize(assigned) : 0;
 
-    TablePair* locals = NEW_ARRAY(TablePair, n_declarations);
+    // The variables declared inside the statement aren't visible
+    AstDeclaration** locals = NEW_ARRAY(AstDeclaration*, n_assigned + 1);
     int n_locals = 0;
-
-    for (int i = 0; i < n_declarations; ++i) {
-        AstDeclaration* declaration = declaration_pairs[i].key;
-        if (declaration->tag == AST_DECLARATION_VARIABLE &&
-            !declaration->u.variable_.global)
-            locals[n_locals++] = declaration_pairs[i];
+    for (size_t i = 0; i < n_assigned; ++i) {
+        AstDeclaration* declaration = VectorGet(assigned, i);
+        if (state->locals[declaration->u.variable_.offset] != NULL)
+            locals[n_locals++] = declaration;
     }
 
-    free(declaration_pairs);
     *n = n_locals;
     return locals;
 }
 
-static void updateDeclarations(TableRef declarations, TableRef other)
+static void saveLocals(AstDeclaration** locals, int n_locals,
+        LLVMValueRef* values, IRState* state)
 {
-    TablePair* other_pairs = TableToArray(other);
-    for (int i = 0; i < TableSize(other); ++i) {
-        AstDeclaration* declaration = other_pairs[i].key;
-        LLVMValueRef value = other_pairs[i].data;
-        TableErase(declarations, declaration);
-        TableInsert(declarations, declaration, value);
-    }
-    free(other_pairs);
+    for (int i = 0; i < n_locals; ++i)
+        values[i] = state->locals[locals[i]->u.variable_.offset];
+}
+
+static void restoreLocals(AstDeclaration** locals, int n_locals,
+        LLVMValueRef* values, IRState* state)
+{
+    for (int i = 0; i < n_locals; ++i)
+        state->locals[locals[i]->u.variable_.offset] = values[i];
 }
 
-static void linkPhis(TablePair* locals, int n_locals, LLVMValueRef* phis,
-        TableRef left_declarations, Vector* left_arrives,
-        TableRef right_declarations, Vector* right_arrives)
+static void linkPhis(int n_locals, LLVMValueRef* phis,
+        LLVMValueRef* left_values, Vector* left_arrives,
+        LLVMValueRef* right_values, Vector* right_arrives)
 {
     for (int i = 0; i < n_locals; ++i) {
-        AstDeclaration* declaration = locals[i].key;
-        LLVMValueRef left_value =
-                TableFind(left_declarations, declaration).data;
-        LLVMValueRef right_value =
-                TableFind(right_declarations, declaration).data;
+        LLVMValueRef left_value = left_values[i];
+        LLVMValueRef right_value = right_values[i];
         size_t left_n_blocks = VectorSize(left_arrives);
         size_t right_n_blocks = VectorSize(right_arrives);
         size_t total_blocks = left_n_blocks + right_n_blocks;
@@ -960,22 +1977,23 @@ static IRBlockValue compileExpression(AstExpression* expression,
     switch (expression->tag) {
     case AST_EXPRESSION_KBOOL:
         expression_return.value =
-                LLVMConstInt(LLVMIntType(1), expression->u.kbool_, false);
+                LLVMConstInt(state->bool_type, expression->u.kbool_, false);
         break;
     case AST_EXPRESSION_KINT:
         expression_return.value =
-                LLVMConstInt(LLVMInt32Type(), expression->u.kint_, false);
+                LLVMConstInt(state->int_type, expression->u.kint_, false);
         break;
     case AST_EXPRESSION_KFLOAT:
         expression_return.value =
-                LLVMConstReal(LLVMFloatType(), expression->u.kfloat_);
+                LLVMConstReal(state->float_type, expression->u.kfloat_);
         break;
     case AST_EXPRESSION_STRING:
         expression_return.value =
                 compileExpressionString(expression, in_block, state);
         break;
     case AST_EXPRESSION_NULL:
-        expression_return.value = LLVMConstNull(createType(expression->type));
+        expression_return.value =
+                LLVMConstNull(createType(expression->type, state));
         break;
     case AST_EXPRESSION_CALL:
         expression_return = compileExpressionCall(expression, in_block,
@@ -1009,10 +2027,10 @@ static IRBlockValue compileExpression(AstExpression* expression,
 static LLVMValueRef compileExpressionString(AstExpression* expression,
         LLVMBasicBlockRef block, IRState* state)
 {
-    LLVMValueRef string = TableFind(state->strings, expression->u.string_).data;
+    LLVMValueRef string = getString(expression->u.string_, state);
     LLVMPositionBuilderAtEnd(state->builder, block);
     return LLVMBuildPointerCast(state->builder, string,
-            LLVMPointerType(LLVMInt8Type(), 0), "");
+            state->string_type, "");
 }
 
 static IRBlockValue compileExpressionCall(AstExpression* expression,
@@ -1027,16 +2045,42 @@ static IRBlockValue compileExpressionCall(AstExpression* expression,
     LLVMBasicBlockRef curr_in_block = in_block;
 
     AST_FOREACH(AstExpression, parameter, parameters) {
-        IRBlockValue expression_return =
-                compileExpression(parameter, in_block, declarations, state);
+        IRBlockValue expression_return = compileExpression(parameter,
+                curr_in_block, declarations, state);
         curr_in_block = expression_return.block;
         llvm_parameters[n++] = expression_return.value;
     }
 
+    // The external functions may write to stdout or exit, the flush is
+    // removed if the function is defined in Monga by other file
     LLVMBasicBlockRef out_block = curr_in_block;
     LLVMPositionBuilderAtEnd(state->builder, out_block);
+    if (declaration->external) {
+        LLVMValueRef flush = LLVMBuildCall(state->builder,
+                state->runtime.flush, NULL, 0, "");
+        LLVMSetMetadata(flush, state->extern_flush_kind,
+                LLVMMDNodeInContext(state->context, NULL, 0));
+    }
+    if (state->lazy && !declaration->external)
+        function = LLVMBuildLoad(state->builder, function, "");
     LLVMValueRef value = 
             LLVMBuildCall(state->builder, function, llvm_parameters, n, "");
+
+    // The call through the address variable is indirect, so the call has the
+    // attributes. The stubs' compilation isn't visible to the program.
+    if (state->lazy && !declaration->external) {
+        setParametersAttributes(declaration, value, state);
+        setEffectsAttributes(declaration, value, state);
+    }
+
+    // The tail call can only be guaranteed if the prototypes are the same
+    // Main flushes the output after the call
+    if (expression->u.call_.tail && !state->main) {
+        if (LLVMTypeOf(function) == LLVMTypeOf(state->function))
+            ExtensionSetMustTailCall(value);
+        else
+            LLVMSetTailCall(value, true);
+    }
     return (IRBlockValue) {.block = out_block, .value = value};
 }
 
@@ -1054,17 +2098,21 @@ static IRBlockValue compileExpressionVariable(AstExpression* expression,
         out_block = variable_return.block;
         LLVMPositionBuilderAtEnd(state->builder, out_block);
         value = LLVMBuildLoad(state->builder, variable_return.value, "");
+        setAliasMetadata(value, variable, state);
+        setTypeMetadata(value, variable->type, state);
         break;
     }
     case AST_VARIABLE_REFERENCE: {
         AstDeclaration* declaration = variable->u.reference_.u.declaration_;
-        LLVMValueRef llvm_variable = TableFind(declarations, declaration).data;
         if (declaration->u.variable_.global) {
+            LLVMValueRef llvm_variable =
+                    TableFind(declarations, declaration).data;
             LLVMPositionBuilderAtEnd(state->builder, out_block);
             value = LLVMBuildLoad(state->builder, llvm_variable, "");
+            setTypeMetadata(value, declaration->type, state);
         }
         else {
-            value = llvm_variable;
+            value = state->locals[declaration->u.variable_.offset];
         }
         break;
     }
@@ -1072,7 +2120,7 @@ static IRBlockValue compileExpressionVariable(AstExpression* expression,
 
     if (TypeIsChar(variable->type)) {
         LLVMPositionBuilderAtEnd(state->builder, out_block);
-        value = LLVMBuildZExt(state->builder, value, LLVMInt32Type(), "");
+        value = LLVMBuildZExt(state->builder, value, state->int_type, "");
     }
 
     return (IRBlockValue) {.block = out_block, .value = value};
@@ -1081,17 +2129,104 @@ static IRBlockValue compileExpressionVariable(AstExpression* expression,
 static IRBlockValue compileExpressionNew(AstExpression* expression,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
 {
-    LLVMTypeRef type = createType(expression->u.new_.type);
+    if (expression->u.new_.stack) {
+        LLVMValueRef value = compileStackArray(expression, state);
+        LLVMPositionBuilderAtEnd(state->builder, in_block);
+        return (IRBlockValue) {.block = in_block, .value = value};
+    }
+
+    LLVMTypeRef type = createType(expression->u.new_.type, state);
     AstExpression* subexpression = expression->u.new_.expression;
     IRBlockValue expression_return = compileExpression(subexpression, in_block,
             declarations, state);
     LLVMBasicBlockRef out_block = expression_return.block;
     LLVMValueRef size = expression_return.value;
     LLVMPositionBuilderAtEnd(state->builder, out_block);
-    LLVMValueRef value = LLVMBuildArrayMalloc(state->builder, type, size, "");
+    if (!ir_bounds_check) {
+        LLVMValueRef value = LLVMBuildArrayMalloc(state->builder, type, size,
+                "");
+        return (IRBlockValue) {.block = out_block, .value = value};
+    }
+
+    // The negative sizes trap, since their lengths would accept any index
+    // The bytes are counted in 64 bits, the counts that don't fit in the
+    // malloc's i32 argument trap too, instead of allocating a wrapped size
+    LLVMTypeRef long_type = LLVMInt64TypeInContext(state->context);
+    LLVMValueRef zero = LLVMConstInt(state->int_type, 0, false);
+    LLVMValueRef negative = LLVMBuildICmp(state->builder, LLVMIntSLT, size,
+            zero, "");
+    LLVMValueRef bytes = LLVMBuildAdd(state->builder,
+            LLVMBuildMul(state->builder,
+                    LLVMBuildZExt(state->builder, size, long_type, ""),
+                    LLVMConstZExtOrBitCast(LLVMSizeOf(type), long_type), ""),
+            LLVMConstInt(long_type, ARRAY_HEADER_SIZE, false), "");
+    LLVMValueRef too_large = LLVMBuildICmp(state->builder, LLVMIntUGT, bytes,
+            LLVMConstInt(long_type, UINT32_MAX, false), "");
+    LLVMBasicBlockRef alloc_block = appendBlock("new", state);
+    LLVMBuildCondBr(state->builder,
+            LLVMBuildOr(state->builder, negative, too_large, ""),
+            getBoundsTrap(state), alloc_block);
+    out_block = alloc_block;
+
+    LLVMPositionBuilderAtEnd(state->builder, out_block);
+    LLVMValueRef header_size =
+            LLVMConstInt(state->int_type, ARRAY_HEADER_SIZE, false);
+    LLVMValueRef memory = LLVMBuildArrayMalloc(state->builder,
+            state->char_type, LLVMBuildTrunc(state->builder, bytes,
+                    state->int_type, ""), "");
+    LLVMValueRef elements = LLVMBuildInBoundsGEP(state->builder, memory,
+            &header_size, 1, "");
+    LLVMValueRef value = LLVMBuildPointerCast(state->builder, elements,
+            LLVMPointerType(type, 0), "");
+    LLVMBuildStore(state->builder, size,
+            buildArrayLengthAddress(value, state));
     return (IRBlockValue) {.block = out_block, .value = value};
 }
 
+static LLVMValueRef compileStackArray(AstExpression* expression,
+        IRState* state)
+{
+    // The allocas of the entry block are static, so the loops reuse them
+    // Positioning before an instruction takes its line, so it is restored
+    LLVMMetadataRef location = LLVMGetCurrentDebugLocation2(state->builder);
+    LLVMBasicBlockRef entry_block = LLVMGetEntryBasicBlock(state->function);
+    LLVMValueRef first = LLVMGetFirstInstruction(entry_block);
+    if (first != NULL)
+        LLVMPositionBuilderBefore(state->builder, first);
+    else
+        LLVMPositionBuilderAtEnd(state->builder, entry_block);
+
+    // The bounds checks need the header before the elements
+    LLVMTypeRef type = createType(expression->u.new_.type, state);
+    int size = expression->u.new_.expression->u.kint_;
+    LLVMTypeRef array_type = LLVMArrayType(type, size);
+    LLVMValueRef indices[] = {
+        LLVMConstInt(state->int_type, 0, false),
+        LLVMConstInt(state->int_type, 0, false)
+    };
+    if (ir_bounds_check) {
+        LLVMTypeRef fields[] = {
+            LLVMArrayType(state->int_type, ARRAY_HEADER_SIZE / 4),
+            array_type
+        };
+        array_type = LLVMStructTypeInContext(state->context, fields, 2,
+                false);
+        indices[1] = LLVMConstInt(state->int_type, 1, false);
+    }
+    LLVMValueRef memory = LLVMBuildAlloca(state->builder, array_type, "");
+    LLVMValueRef value = LLVMBuildInBoundsGEP(state->builder, memory,
+            indices, 2, "");
+    value = LLVMBuildPointerCast(state->builder, value,
+            LLVMPointerType(type, 0), "");
+    if (ir_bounds_check) {
+        LLVMBuildStore(state->builder,
+                LLVMConstInt(state->int_type, size, false),
+                buildArrayLengthAddress(value, state));
+    }
+    LLVMSetCurrentDebugLocation2(state->builder, location);
+    return value;
+}
+
 static IRBlockValue compileExpressionUnary(AstExpression* expression,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
 {
@@ -1105,10 +2240,13 @@ static IRBlockValue compileExpressionUnary(AstExpression* expression,
     LLVMValueRef value = NULL;
     switch (expression->u.unary_.operator) {
     case AST_OPERATOR_NEGATE:
-        if (TypeIsInt(expression->type))
+        if (TypeIsInt(expression->type) && ir_wrapv)
             value = LLVMBuildNeg(state->builder, operand, "");
+        else if (TypeIsInt(expression->type))
+            value = LLVMBuildNSWNeg(state->builder, operand, "");
         else
             value = LLVMBuildFNeg(state->builder, operand, "");
+        setFastMathFlags(value, state);
         break;
     case AST_OPERATOR_NOT:
         value = LLVMBuildNot(state->builder, operand, "");
@@ -1156,6 +2294,7 @@ static IRBlockValue compileExpressionBinary(AstExpression* expression,
     } else {
         value = compileExpressionBinaryFloatCmp(operator, lhs, rhs, state);
     }
+    setFastMathFlags(value, state);
 
     return (IRBlockValue) {.block = in_block, .value = value};
 }
@@ -1172,9 +2311,9 @@ static IRBlockValue compileLogicalBinaryExpression(AstBinaryOperator operator,
 
     // Create blocks necessary for short circuit
     LLVMBasicBlockRef rhs_in_block =
-            LLVMAppendBasicBlock(state->function, "logical_compute_rhs");
+            appendBlock("logical_compute_rhs", state);
     LLVMBasicBlockRef final_block =
-            LLVMAppendBasicBlock(state->function, "logical_end");
+            appendBlock("logical_end", state);
 
     // Jump to final block in caso of short circuit
     LLVMPositionBuilderAtEnd(state->builder, in_block);
@@ -1193,7 +2332,7 @@ static IRBlockValue compileLogicalBinaryExpression(AstBinaryOperator operator,
 
     // Add phi into final block
     LLVMPositionBuilderAtEnd(state->builder, final_block);
-    LLVMValueRef phi = LLVMBuildPhi(state->builder, LLVMIntType(1), "");
+    LLVMValueRef phi = LLVMBuildPhi(state->builder, state->bool_type, "");
     LLVMValueRef incomming_values[] = {lhs, rhs};
     LLVMBasicBlockRef incomming_blocks[] = {in_block, rhs_out_block};
     LLVMAddIncoming(phi, incomming_values, incomming_blocks, 2);
@@ -1204,6 +2343,20 @@ static IRBlockValue compileLogicalBinaryExpression(AstBinaryOperator operator,
 static LLVMValueRef compileExpressionBinaryInt(AstBinaryOperator operator,
         LLVMValueRef lhs, LLVMValueRef rhs, IRState* state)
 {
+    // The signed overflow is undefined, unless -fwrapv
+    if (!ir_wrapv) {
+        switch (operator) {
+        case AST_OPERATOR_ADD:
+            return LLVMBuildNSWAdd(state->builder, lhs, rhs, "");
+        case AST_OPERATOR_SUB:
+            return LLVMBuildNSWSub(state->builder, lhs, rhs, "");
+        case AST_OPERATOR_MUL:
+            return LLVMBuildNSWMul(state->builder, lhs, rhs, "");
+        default:
+            break;
+        }
+    }
+
     switch (operator) {
     case AST_OPERATOR_ADD:
         return LLVMBuildAdd(state->builder, lhs, rhs, "");
@@ -1281,6 +2434,12 @@ static LLVMValueRef compileExpressionBinaryFloatCmp(AstBinaryOperator operator,
     }
 }
 
+static void setFastMathFlags(LLVMValueRef instruction, IRState* state)
+{
+    if (state->fast_math != 0)
+        ExtensionSetFastMathFlags(instruction, state->fast_math);
+}
+
 static IRBlockValue compileExpressionCast(AstExpression* expression,
         LLVMBasicBlockRef in_block, TableRef declarations, IRState* state)
 {
@@ -1294,10 +2453,10 @@ static IRBlockValue compileExpressionCast(AstExpression* expression,
     LLVMValueRef value = NULL;
     switch (expression->u.cast_.tag) {
     case AST_CAST_INT_TO_FLOAT:
-        value = LLVMBuildSIToFP(state->builder, operand, LLVMFloatType(), "");
+        value = LLVMBuildSIToFP(state->builder, operand, state->float_type, "");
         break;
     case AST_CAST_FLOAT_TO_INT:
-        value = LLVMBuildFPToSI(state->builder, operand, LLVMInt32Type(), "");
+        value = LLVMBuildFPToSI(state->builder, operand, state->int_type, "");
         break;
     }
 
@@ -1318,8 +2477,9 @@ static void compileJump(AstExpression* expression,
         break;
     case AST_EXPRESSION_UNARY:
         assert(expression->u.unary_.operator == AST_OPERATOR_NOT);
-        compileJump(expression, in_block, false_block, true_block, declarations,
-                state, arrive_at_false, arrive_at_true);
+        compileJump(expression->u.unary_.expression, in_block, false_block,
+                true_block, declarations, state, arrive_at_false,
+                arrive_at_true);
         break;
     case AST_EXPRESSION_BINARY:
         compileJumpBinary(expression, in_block, true_block, false_block,
@@ -1367,7 +2527,7 @@ static void compileJumpBinary(AstExpression* expression,
 
     // Computes left hand side operand
     LLVMBasicBlockRef rhs_in_block =
-            LLVMAppendBasicBlock(state->function, "compute_rhs");
+            appendBlock("compute_rhs", state);
     AstExpression* left_expression = expression->u.binary_.expression_left;
     if (operator == AST_OPERATOR_OR) {
         compileJump(left_expression, in_block, true_block, rhs_in_block,
@@ -1398,10 +2558,29 @@ static IRBlockValue compileVariableArray(AstVariable* variable,
     out_block = offset_return.block;
     LLVMValueRef llvm_offset = offset_return.value;
 
-    LLVMValueRef indices[] = {llvm_offset};
+    // Accesses outside the array are undefined, unless they are checked
+    // The unsigned comparison also rejects the negative indices
     LLVMPositionBuilderAtEnd(state->builder, out_block);
-    LLVMValueRef value =
-            LLVMBuildGEP(state->builder, llvm_location, indices, 1, "");
+    if (ir_bounds_check) {
+        // The null array has no header, it traps before its length is read
+        LLVMValueRef is_null = LLVMBuildIsNull(state->builder, llvm_location,
+                "");
+        LLVMBasicBlockRef length_block = appendBlock("not.null", state);
+        LLVMBuildCondBr(state->builder, is_null, getBoundsTrap(state),
+                length_block);
+        LLVMPositionBuilderAtEnd(state->builder, length_block);
+        LLVMValueRef length = buildArrayLength(llvm_location, state);
+        LLVMValueRef in_bounds = LLVMBuildICmp(state->builder, LLVMIntULT,
+                llvm_offset, length, "");
+        LLVMBasicBlockRef access_block = appendBlock("in.bounds", state);
+        LLVMBuildCondBr(state->builder, in_bounds, access_block,
+                getBoundsTrap(state));
+        out_block = access_block;
+        LLVMPositionBuilderAtEnd(state->builder, out_block);
+    }
+    LLVMValueRef indices[] = {llvm_offset};
+    LLVMValueRef value = LLVMBuildInBoundsGEP(state->builder, llvm_location,
+            indices, 1, "");
 
     return (IRBlockValue) {.block = out_block, .value = value};
 }
@@ -8,12 +8,76 @@
 #ifndef IR_H 
 #define IR_H
 
+#include <stdbool.h>
+
 #include <llvm-c/Core.h>
 
 #include "ast/ast.h"
 
-/* Compiles the LLVM IR module from the AST */
-LLVMModuleRef IRCompileModule(AstDeclaration* tree);
+/* Function called by the lazy stubs, it has the signature
+ * i8* (i32 function_index) and must return the address of the compiled body.
+ * The index is the position of the function among the tree's functions. */
+#define IR_LAZY_COMPILE_FUNCTION "monga.lazy_compile"
+
+/* Selects whether the signed integer overflow wraps (-fwrapv)
+ * By default it is undefined, so the arithmetic has the nsw flag. */
+void IRSelectWrapv(bool wrapv);
+
+/* Selects whether the functions verify, on their entry, that the restrict
+ * array arguments aren't equal to the other array arguments
+ * (-fcheck-restrict). The program traps if they are. */
+void IRSelectCheckRestrict(bool check);
+
+/* Selects whether the array accesses are checked (-fbounds-check). The
+ * arrays store their length in a header before the elements, so the modules
+ * compiled with and without the checks can't share arrays. An access outside
+ * the array traps. */
+void IRSelectBoundsCheck(bool check);
+
+/* Fast math flags of the float instructions, the bits are the same of
+ * llvm::FastMathFlags */
+#define IR_FAST_MATH_REASSOC  (1 << 0)
+#define IR_FAST_MATH_NNAN     (1 << 1)
+#define IR_FAST_MATH_NINF     (1 << 2)
+#define IR_FAST_MATH_NSZ      (1 << 3)
+#define IR_FAST_MATH_ARCP     (1 << 4)
+#define IR_FAST_MATH_CONTRACT (1 << 5)
+#define IR_FAST_MATH_AFN      (1 << 6)
+#define IR_FAST_MATH_ALL      ((1 << 7) - 1)
+
+/* Selects the fast math flags of the float arithmetic and comparisons
+ * (-ffast-math). By default there is none, so the float semantics is
+ * strict. The functions annotated with @fastmath use all the flags. */
+void IRSelectFastMath(unsigned flags);
+
+/* Selects whether the modules have debug information (-g): the DWARF
+ * compile unit of the file, the functions' subprograms and the statements'
+ * lines, taken from the AST */
+void IRSelectDebugInfo(bool debug);
+
+/* Compiles the LLVM IR module from the AST, in the context
+ * The file name is the one of the debug information, NULL for the standard
+ * input. */
+LLVMModuleRef IRCompileModule(AstDeclaration* tree, const char* file_name,
+        LLVMContextRef context);
+
+/* Compiles the module used by the lazy compilation. It contains the global
+ * variables and, for each function, a stub that calls the lazy compile
+ * function on the first call. Calls inside the bodies are made through the
+ * function's address variable, so only the first call pays for the stub. */
+LLVMModuleRef IRCompileLazyModule(AstDeclaration* tree,
+        LLVMContextRef context);
+
+/* Compiles the body of a function in a new module that references the lazy
+ * module symbols. The body is returned by the last parameter. */
+LLVMModuleRef IRCompileLazyFunction(AstDeclaration* tree,
+        AstDeclaration* function, const char* file_name,
+        LLVMContextRef context, LLVMValueRef* body);
+
+/* Removes the output flushes before the calls to extern functions that are
+ * defined by the modules linked to the module, only the calls to C need
+ * them */
+void IRRemoveLinkedFlushes(LLVMModuleRef module);
 
 #endif
 
@@ -0,0 +1,280 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * jit.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <llvm-c/ExecutionEngine.h>
+#include <llvm-c/Support.h>
+#include <llvm-c/Target.h>
+
+#include "jit.h"
+
+#include "backend/extension.h"
+#include "backend/ir.h"
+#include "backend/optimize.h"
+#include "backend/target.h"
+#include "util/error.h"
+#include "util/new.h"
+#include "util/phase.h"
+#include "util/timer.h"
+
+/* Signature of the monga main function */
+typedef int (*MainFunction)();
+
+/* State used by the lazy compile function, that is called by native code */
+typedef struct JitLazyState {
+    /* Engine that owns the lazy module and the bodies' modules */
+    LLVMExecutionEngineRef engine;
+
+    /* Program tree and its file name, NULL for the standard input */
+    AstDeclaration* tree;
+    const char* file_name;
+
+    /* Context of the lazy module, the bodies are compiled in it */
+    LLVMContextRef context;
+
+    /* Functions' declarations and compiled bodies, indexed by position */
+    AstDeclaration** functions;
+    void** bodies;
+
+    /* Optimization level of the bodies */
+    int level;
+
+    /* Statistics of the current execution */
+    JitStatistics* statistics;
+} JitLazyState;
+
+static JitLazyState lazy_state;
+
+/* True if the engines register their code for perf */
+static bool jit_profiling = false;
+
+/* Verifies if the external symbols are defined in the process, like the
+ * ones of extern declarations without the file that defines them */
+static void checkExternalSymbols(LLVMModuleRef module);
+
+/* Returns true if the global is a declaration that the process resolves */
+static bool isExternalSymbol(LLVMValueRef global);
+
+/* Creates the MCJIT engine that owns the module */
+static LLVMExecutionEngineRef createEngine(LLVMModuleRef module, int level);
+
+/* Obtains the main function, generating the module's native code */
+static MainFunction getMainFunction(LLVMExecutionEngineRef engine);
+
+/* Calls main and measures the run time, without the lazy compilations */
+static int runMainFunction(MainFunction main_function,
+        JitStatistics* statistics);
+
+/* Compiles the function body, called by the lazy stubs */
+static void* lazyCompile(int32_t index);
+
+void JitInitialize(int level)
+{
+    LLVMContextRef context = LLVMContextCreate();
+    LLVMModuleRef module =
+            LLVMModuleCreateWithNameInContext("warm_up", context);
+    LLVMTypeRef int_type = LLVMInt32TypeInContext(context);
+    LLVMTypeRef main_type = LLVMFunctionType(int_type, NULL, 0, false);
+    LLVMValueRef main_function = LLVMAddFunction(module, "main", main_type);
+    LLVMBuilderRef builder = LLVMCreateBuilderInContext(context);
+    LLVMPositionBuilderAtEnd(builder,
+            LLVMAppendBasicBlockInContext(context, main_function, "entry"));
+    LLVMBuildRet(builder, LLVMConstInt(int_type, 0, false));
+    LLVMDisposeBuilder(builder);
+
+    OptimizeModule(module, level);
+    LLVMExecutionEngineRef engine = createEngine(module, level);
+    getMainFunction(engine);
+    LLVMDisposeExecutionEngine(engine);
+    LLVMContextDispose(context);
+}
+
+void JitSelectProfiling(bool profiling)
+{
+    jit_profiling = profiling;
+}
+
+int JitExecuteModule(LLVMModuleRef module, int level,
+        JitStatistics* statistics)
+{
+    int n_functions = 0;
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    for (; function != NULL; function = LLVMGetNextFunction(function)) {
+        if (!LLVMIsDeclaration(function))
+            n_functions++;
+    }
+    statistics->n_functions = n_functions;
+    statistics->n_compiled_functions = n_functions;
+
+    checkExternalSymbols(module);
+
+    PhaseBegin("jit");
+    double compile_start = TimerWallTime();
+    LLVMExecutionEngineRef engine = createEngine(module, level);
+    MainFunction main_function = getMainFunction(engine);
+    statistics->compile_time = TimerWallTime() - compile_start;
+    PhaseEnd();
+
+    int return_value = runMainFunction(main_function, statistics);
+    LLVMDisposeExecutionEngine(engine);
+    return return_value;
+}
+
+int JitExecuteLazyModule(LLVMModuleRef module, AstDeclaration* tree,
+        const char* file_name, int level, JitStatistics* statistics)
+{
+    int n_functions = 0;
+    AST_FOREACH(AstDeclaration, declaration, tree) {
+        if (declaration->tag == AST_DECLARATION_FUNCTION &&
+            !declaration->external)
+            n_functions++;
+    }
+    statistics->n_functions = n_functions;
+    statistics->n_compiled_functions = 0;
+
+    lazy_state.tree = tree;
+    lazy_state.file_name = file_name;
+    lazy_state.context = LLVMGetModuleContext(module);
+    lazy_state.functions = NEW_ARRAY(AstDeclaration*, n_functions);
+    lazy_state.bodies = NEW_ARRAY(void*, n_functions);
+    lazy_state.level = level;
+    lazy_state.statistics = statistics;
+    int index = 0;
+    AST_FOREACH(AstDeclaration, declaration, tree) {
+        if (declaration->tag == AST_DECLARATION_FUNCTION &&
+            !declaration->external) {
+            lazy_state.functions[index] = declaration;
+            lazy_state.bodies[index] = NULL;
+            index++;
+        }
+    }
+
+    checkExternalSymbols(module);
+
+    PhaseBegin("jit");
+    double compile_start = TimerWallTime();
+    lazy_state.engine = createEngine(module, level);
+    LLVMValueRef lazy_compile =
+            LLVMGetNamedFunction(module, IR_LAZY_COMPILE_FUNCTION);
+    LLVMAddGlobalMapping(lazy_state.engine, lazy_compile,
+            (void*)(intptr_t)lazyCompile);
+    MainFunction main_function = getMainFunction(lazy_state.engine);
+    statistics->compile_time = TimerWallTime() - compile_start;
+    PhaseEnd();
+
+    int return_value = runMainFunction(main_function, statistics);
+
+    LLVMDisposeExecutionEngine(lazy_state.engine);
+    free(lazy_state.functions);
+    free(lazy_state.bodies);
+    return return_value;
+}
+
+static void checkExternalSymbols(LLVMModuleRef module)
+{
+    // Makes the symbols of the process visible to the search
+    LLVMLoadLibraryPermanently(NULL);
+
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    for (; function != NULL; function = LLVMGetNextFunction(function)) {
+        if (isExternalSymbol(function) &&
+            LLVMSearchForAddressOfSymbol(LLVMGetValueName(function)) == NULL)
+            Error("undefined function '%s'", LLVMGetValueName(function));
+    }
+
+    LLVMValueRef global = LLVMGetFirstGlobal(module);
+    for (; global != NULL; global = LLVMGetNextGlobal(global)) {
+        if (isExternalSymbol(global) &&
+            LLVMSearchForAddressOfSymbol(LLVMGetValueName(global)) == NULL)
+            Error("undefined variable '%s'", LLVMGetValueName(global));
+    }
+}
+
+static bool isExternalSymbol(LLVMValueRef global)
+{
+    // The lazy compile function is mapped by the engine
+    return LLVMIsDeclaration(global) && !LLVMGetIntrinsicID(global) &&
+           strcmp(LLVMGetValueName(global), IR_LAZY_COMPILE_FUNCTION) != 0;
+}
+
+static LLVMExecutionEngineRef createEngine(LLVMModuleRef module, int level)
+{
+    LLVMLinkInMCJIT();
+    LLVMInitializeNativeAsmPrinter();
+
+    struct LLVMMCJITCompilerOptions options;
+    LLVMInitializeMCJITCompilerOptions(&options, sizeof(options));
+    options.OptLevel = level;
+
+    LLVMExecutionEngineRef engine;
+    char* error_msg = NULL;
+    if (LLVMCreateMCJITCompilerForModule(&engine, module, &options,
+            sizeof(options), &error_msg) != 0) {
+        Error("failed to create execution engine: %s", error_msg);
+    }
+    if (jit_profiling)
+        ExtensionRegisterPerfListeners(engine);
+    return engine;
+}
+
+static MainFunction getMainFunction(LLVMExecutionEngineRef engine)
+{
+    // Obtaining the address finalizes the module, generating the native code
+    uint64_t main_address = LLVMGetFunctionAddress(engine, "main");
+    if (main_address == 0) {
+        Error("main function not found");
+    }
+    return (MainFunction)(intptr_t)main_address;
+}
+
+static int runMainFunction(MainFunction main_function,
+        JitStatistics* statistics)
+{
+    PhaseBegin("run");
+    double compile_time = statistics->compile_time;
+    double run_start = TimerWallTime();
+    int return_value = main_function();
+    double run_time = TimerWallTime() - run_start;
+    PhaseEnd();
+    statistics->run_time = run_time - (statistics->compile_time - compile_time);
+    return return_value;
+}
+
+static void* lazyCompile(int32_t index)
+{
+    if (lazy_state.bodies[index] != NULL)
+        return lazy_state.bodies[index];
+
+    // Measured apart from the run phase that called it
+    PhaseBegin("jit");
+    double compile_start = TimerWallTime();
+    LLVMValueRef body = NULL;
+    AstDeclaration* function = lazy_state.functions[index];
+    LLVMModuleRef module =
+            IRCompileLazyFunction(lazy_state.tree, function,
+                    lazy_state.file_name, lazy_state.context, &body);
+    TargetSetModuleCpu(module);
+    OptimizeModule(module, lazy_state.level);
+    LLVMAddModule(lazy_state.engine, module);
+    uint64_t address =
+            LLVMGetFunctionAddress(lazy_state.engine, LLVMGetValueName(body));
+    if (address == 0) {
+        Error("failed to compile function '%s'", function->identifier);
+    }
+    lazy_state.bodies[index] = (void*)(intptr_t)address;
+
+    JitStatistics* statistics = lazy_state.statistics;
+    statistics->compile_time += TimerWallTime() - compile_start;
+    statistics->n_compiled_functions++;
+    PhaseEnd();
+    return lazy_state.bodies[index];
+}
+
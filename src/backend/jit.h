@@ -0,0 +1,52 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * jit.h
+ * Executes the compiled program with the MCJIT native code.
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+
+#include <llvm-c/Core.h>
+
+#include "ast/ast.h"
+
+/* Execution measures */
+typedef struct JitStatistics {
+    /* Time spent creating the engine and generating code, in seconds */
+    double compile_time;
+
+    /* Time spent running main, without the lazy compilations */
+    double run_time;
+
+    /* Number of functions in the program */
+    int n_functions;
+
+    /* Number of functions with generated native code */
+    int n_compiled_functions;
+} JitStatistics;
+
+/* Initializes the JIT, compiling an empty program to warm up LLVM */
+void JitInitialize(int level);
+
+/* Selects whether the engines make their code visible to perf (-g). The
+ * functions are written to /tmp/perf-<pid>.map, and registered with the perf
+ * JIT interface if LLVM was built with it. */
+void JitSelectProfiling(bool profiling);
+
+/* Executes the main function of the module, returns its result */
+int JitExecuteModule(LLVMModuleRef module, int level,
+        JitStatistics* statistics);
+
+/* Executes the main function of a module created by IRCompileLazyModule.
+ * The functions' bodies are compiled from the tree on their first call, the
+ * file name is the one of their debug information. */
+int JitExecuteLazyModule(LLVMModuleRef module, AstDeclaration* tree,
+        const char* file_name, int level, JitStatistics* statistics);
+
+#endif
+
@@ -0,0 +1,87 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * optimize.c
+ */
+
+#include <stdlib.h>
+
+#include <llvm-c/Transforms/PassManagerBuilder.h>
+
+#include "optimize.h"
+
+#include "backend/extension.h"
+#include "backend/target.h"
+
+/* Inliner thresholds used by clang for -O2 and -O3 */
+static const unsigned INLINE_THRESHOLD = 225;
+static const unsigned INLINE_THRESHOLD_O3 = 275;
+
+/* True if the pipeline has the inductive range check elimination */
+static bool optimize_range_checks = false;
+
+/* Runs the function passes over each function of the module */
+static void runFunctionPasses(LLVMModuleRef module,
+        LLVMPassManagerBuilderRef builder, LLVMTargetMachineRef machine);
+
+/* Runs the module passes (inlining, globals, vectorization...) */
+static void runModulePasses(LLVMModuleRef module,
+        LLVMPassManagerBuilderRef builder, LLVMTargetMachineRef machine);
+
+void OptimizeSelectRangeCheckElimination(bool eliminate)
+{
+    optimize_range_checks = eliminate;
+}
+
+void OptimizeModule(LLVMModuleRef module, int level)
+{
+    if (level <= 0)
+        return;
+
+    // Sets the host triple and data layout, so the passes can query the target
+    LLVMTargetMachineRef machine = TargetCreateHostMachine(level);
+    TargetSetModuleMachine(module, machine);
+
+    LLVMPassManagerBuilderRef builder = LLVMPassManagerBuilderCreate();
+    LLVMPassManagerBuilderSetOptLevel(builder, level);
+    if (level >= 2) {
+        LLVMPassManagerBuilderUseInlinerWithThreshold(builder,
+                level >= 3 ? INLINE_THRESHOLD_O3 : INLINE_THRESHOLD);
+    }
+    if (optimize_range_checks)
+        ExtensionAddRangeCheckElimination(builder);
+
+    runFunctionPasses(module, builder, machine);
+    runModulePasses(module, builder, machine);
+
+    LLVMPassManagerBuilderDispose(builder);
+    LLVMDisposeTargetMachine(machine);
+}
+
+static void runFunctionPasses(LLVMModuleRef module,
+        LLVMPassManagerBuilderRef builder, LLVMTargetMachineRef machine)
+{
+    LLVMPassManagerRef passes = LLVMCreateFunctionPassManagerForModule(module);
+    LLVMAddAnalysisPasses(machine, passes);
+    LLVMPassManagerBuilderPopulateFunctionPassManager(builder, passes);
+
+    LLVMInitializeFunctionPassManager(passes);
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    for (; function != NULL; function = LLVMGetNextFunction(function))
+        LLVMRunFunctionPassManager(passes, function);
+    LLVMFinalizeFunctionPassManager(passes);
+
+    LLVMDisposePassManager(passes);
+}
+
+static void runModulePasses(LLVMModuleRef module,
+        LLVMPassManagerBuilderRef builder, LLVMTargetMachineRef machine)
+{
+    LLVMPassManagerRef passes = LLVMCreatePassManager();
+    LLVMAddAnalysisPasses(machine, passes);
+    LLVMPassManagerBuilderPopulateModulePassManager(builder, passes);
+    LLVMRunPassManager(passes, module);
+    LLVMDisposePassManager(passes);
+}
+
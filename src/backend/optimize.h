@@ -0,0 +1,28 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * optimize.h
+ * Runs the LLVM optimization pipeline over the compiled module.
+ */
+
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <stdbool.h>
+
+#include <llvm-c/Core.h>
+
+/* Max optimization level accepted by OptimizeModule */
+#define OPTIMIZE_MAX_LEVEL 3
+
+/* Selects whether the loops' range checks are eliminated, used with the
+ * array bounds checks (-fbounds-check) */
+void OptimizeSelectRangeCheckElimination(bool eliminate);
+
+/* Optimizes the module in place with the function and module pass pipelines
+ * equivalent to opt -O<level>. Level 0 doesn't change the module. */
+void OptimizeModule(LLVMModuleRef module, int level);
+
+#endif
+
@@ -0,0 +1,250 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * parallel.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+
+#include "parallel.h"
+
+#include "backend/cache.h"
+#include "backend/extension.h"
+#include "backend/target.h"
+#include "util/error.h"
+#include "util/new.h"
+
+/* Number of functions of a group */
+#define PARALLEL_GROUP_SIZE 64
+
+/* Max number of groups, bigger modules have bigger groups */
+#define PARALLEL_MAX_GROUPS 128
+
+/* Groups shared by the threads */
+typedef struct ParallelJob {
+    /* Bitcode of each group, replaced by its object when it is compiled */
+    LLVMMemoryBufferRef* groups;
+    int n_groups;
+
+    /* Next group to be compiled, protected by the mutex */
+    int next_group;
+    pthread_mutex_t mutex;
+
+    /* Optimization level of the code generation */
+    int level;
+} ParallelJob;
+
+/* Computes the number of groups by the number of functions */
+static int countGroups(LLVMModuleRef module);
+
+/* Renames the local symbols with the module's hash, since the split turns
+ * them into hidden symbols that could clash with other monga objects */
+static void renameLocalSymbols(LLVMModuleRef module);
+
+/* Appends the suffix to the symbol's name if it is local */
+static void renameLocalSymbol(LLVMValueRef global, const char* suffix);
+
+/* Stores the bitcode of a group, called by the split */
+static void storeGroup(LLVMModuleRef group, int index, void* data);
+
+/* Compiles the groups until there are no more groups, run by each thread */
+static void* compileGroups(void* data);
+
+/* Compiles the group's bitcode in a new context, returns the object */
+static LLVMMemoryBufferRef compileGroup(LLVMMemoryBufferRef bitcode,
+        int level);
+
+/* Links the groups' objects in a relocatable object */
+static void linkGroups(ParallelJob* job, const char* path);
+
+/* Writes the buffer to the file */
+static void writeBuffer(LLVMMemoryBufferRef buffer, const char* path);
+
+void ParallelEmitObject(LLVMModuleRef module, const char* path, int level,
+        int n_threads)
+{
+    int n_groups = countGroups(module);
+    if (n_groups == 1) {
+        LLVMMemoryBufferRef object = TargetEmitObjectBuffer(module, level);
+        writeBuffer(object, path);
+        LLVMDisposeMemoryBuffer(object);
+        return;
+    }
+
+    // The groups inherit the triple and the data layout
+    LLVMTargetMachineRef machine = TargetCreateHostMachine(level);
+    TargetSetModuleMachine(module, machine);
+    LLVMDisposeTargetMachine(machine);
+
+    ParallelJob job;
+    job.groups = NEW_ARRAY(LLVMMemoryBufferRef, n_groups);
+    job.n_groups = n_groups;
+    job.next_group = 0;
+    job.level = level;
+    pthread_mutex_init(&job.mutex, NULL);
+
+    renameLocalSymbols(module);
+    ExtensionSplitModule(module, n_groups, storeGroup, &job);
+
+    // The calling thread compiles groups too
+    int n_workers = (n_threads < n_groups ? n_threads : n_groups) - 1;
+    pthread_t* workers = NEW_ARRAY(pthread_t, n_workers > 0 ? n_workers : 1);
+    for (int i = 0; i < n_workers; ++i) {
+        if (pthread_create(&workers[i], NULL, compileGroups, &job) != 0)
+            Error("unable to create a code generation thread");
+    }
+    compileGroups(&job);
+    for (int i = 0; i < n_workers; ++i)
+        pthread_join(workers[i], NULL);
+
+    linkGroups(&job, path);
+
+    pthread_mutex_destroy(&job.mutex);
+    for (int i = 0; i < n_groups; ++i)
+        LLVMDisposeMemoryBuffer(job.groups[i]);
+    free(job.groups);
+    free(workers);
+}
+
+static int countGroups(LLVMModuleRef module)
+{
+    int n_functions = 0;
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    for (; function != NULL; function = LLVMGetNextFunction(function)) {
+        if (!LLVMIsDeclaration(function))
+            n_functions++;
+    }
+
+    int n_groups = (n_functions + PARALLEL_GROUP_SIZE - 1) /
+            PARALLEL_GROUP_SIZE;
+    if (n_groups < 1)
+        return 1;
+    if (n_groups > PARALLEL_MAX_GROUPS)
+        return PARALLEL_MAX_GROUPS;
+    return n_groups;
+}
+
+static void renameLocalSymbols(LLVMModuleRef module)
+{
+    LLVMMemoryBufferRef bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+    CacheKey hash = CacheHash(CACHE_KEY_INIT, LLVMGetBufferStart(bitcode),
+            LLVMGetBufferSize(bitcode));
+    LLVMDisposeMemoryBuffer(bitcode);
+
+    char suffix[32];
+    sprintf(suffix, ".%016llx", (unsigned long long)hash.hash);
+
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    for (; function != NULL; function = LLVMGetNextFunction(function))
+        renameLocalSymbol(function, suffix);
+
+    LLVMValueRef global = LLVMGetFirstGlobal(module);
+    for (; global != NULL; global = LLVMGetNextGlobal(global))
+        renameLocalSymbol(global, suffix);
+}
+
+static void renameLocalSymbol(LLVMValueRef global, const char* suffix)
+{
+    LLVMLinkage linkage = LLVMGetLinkage(global);
+    if (linkage != LLVMInternalLinkage && linkage != LLVMPrivateLinkage)
+        return;
+
+    // Unnamed symbols, like the string literals, get a common prefix and
+    // LLVM numbers them
+    size_t length = 0;
+    const char* name = LLVMGetValueName2(global, &length);
+    if (length == 0)
+        name = "monga";
+
+    char* new_name = NEW_ARRAY(char, strlen(name) + strlen(suffix) + 1);
+    sprintf(new_name, "%s%s", name, suffix);
+    LLVMSetValueName2(global, new_name, strlen(new_name));
+    free(new_name);
+}
+
+static void storeGroup(LLVMModuleRef group, int index, void* data)
+{
+    // The context isn't thread safe, so the threads receive bitcode
+    ParallelJob* job = data;
+    job->groups[index] = LLVMWriteBitcodeToMemoryBuffer(group);
+    LLVMDisposeModule(group);
+}
+
+static void* compileGroups(void* data)
+{
+    ParallelJob* job = data;
+    for (;;) {
+        pthread_mutex_lock(&job->mutex);
+        int index = job->next_group++;
+        pthread_mutex_unlock(&job->mutex);
+        if (index >= job->n_groups)
+            break;
+
+        LLVMMemoryBufferRef bitcode = job->groups[index];
+        job->groups[index] = compileGroup(bitcode, job->level);
+        LLVMDisposeMemoryBuffer(bitcode);
+    }
+    return NULL;
+}
+
+static LLVMMemoryBufferRef compileGroup(LLVMMemoryBufferRef bitcode,
+        int level)
+{
+    LLVMContextRef context = LLVMContextCreate();
+    LLVMModuleRef module = NULL;
+    if (LLVMParseBitcodeInContext2(context, bitcode, &module) != 0)
+        Error("unable to read a group of functions");
+
+    LLVMMemoryBufferRef object = TargetEmitObjectBuffer(module, level);
+    LLVMDisposeModule(module);
+    LLVMContextDispose(context);
+    return object;
+}
+
+static void linkGroups(ParallelJob* job, const char* path)
+{
+    // The objects are linked in the groups' order, so the output doesn't
+    // depend on the threads
+    char** object_paths = NEW_ARRAY(char*, job->n_groups);
+    for (int i = 0; i < job->n_groups; ++i) {
+        object_paths[i] = NEW_ARRAY(char, strlen(path) + 64);
+        sprintf(object_paths[i], "%s.%ld.%d.o", path, (long)getpid(), i);
+        writeBuffer(job->groups[i], object_paths[i]);
+    }
+
+    bool linked = TargetLinkRelocatable((const char**)object_paths,
+            job->n_groups, path);
+
+    for (int i = 0; i < job->n_groups; ++i) {
+        remove(object_paths[i]);
+        free(object_paths[i]);
+    }
+    free(object_paths);
+
+    if (!linked)
+        Error("failed to link '%s'", path);
+}
+
+static void writeBuffer(LLVMMemoryBufferRef buffer, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+        Error("unable to emit '%s'", path);
+    size_t size = LLVMGetBufferSize(buffer);
+    if (fwrite(LLVMGetBufferStart(buffer), 1, size, file) != size) {
+        fclose(file);
+        Error("unable to emit '%s'", path);
+    }
+    fclose(file);
+}
+
@@ -0,0 +1,25 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * parallel.h
+ * Parallel native code generation. The module is split in groups of
+ * functions, each group is compiled by a thread in its own LLVM context,
+ * and the objects are linked in a relocatable object. The groups depend
+ * only on the module, so the object is the same for any number of threads.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <llvm-c/Core.h>
+
+/* Max number of threads */
+#define PARALLEL_MAX_THREADS 256
+
+/* Emits the module as an object file, using up to n_threads threads */
+void ParallelEmitObject(LLVMModuleRef module, const char* path, int level,
+        int n_threads);
+
+#endif
+
@@ -0,0 +1,534 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * runtime.c
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "runtime.h"
+
+/* Number of runtime functions */
+#define N_FUNCTIONS 7
+
+/* State of the runtime compilation */
+typedef struct RuntimeState {
+    /* Module and context of the runtime */
+    LLVMModuleRef module;
+    LLVMContextRef context;
+
+    /* LLVM Builder */
+    LLVMBuilderRef builder;
+
+    /* Types of the context, size_t is 64 bits */
+    LLVMTypeRef void_type;
+    LLVMTypeRef char_type;
+    LLVMTypeRef int_type;
+    LLVMTypeRef size_type;
+    LLVMTypeRef string_type;
+
+    /* Output buffer and the number of bytes written in it */
+    LLVMValueRef buffer;
+    LLVMValueRef size;
+
+    /* Runtime functions being defined */
+    Runtime* runtime;
+} RuntimeState;
+
+/* Initializes the state of the module */
+static void initState(LLVMModuleRef module, Runtime* runtime,
+        RuntimeState* state);
+
+/* Copies the runtime functions to the array */
+static void getFunctions(Runtime* runtime, LLVMValueRef* functions);
+
+/* Adds the function, with the nounwind attribute */
+static LLVMValueRef addFunction(const char* name, LLVMTypeRef return_type,
+        LLVMTypeRef* parameters, unsigned n_parameters, RuntimeState* state);
+
+/* Obtains the C library function, declaring it if needed */
+static LLVMValueRef getLibraryFunction(const char* name,
+        LLVMTypeRef return_type, LLVMTypeRef* parameters,
+        unsigned n_parameters, bool variadic, RuntimeState* state);
+
+/* Obtains the C stdout stream */
+static LLVMValueRef getStdout(RuntimeState* state);
+
+/* Defines the global with the linkage and the initializer */
+static LLVMValueRef addGlobal(const char* name, LLVMTypeRef type,
+        LLVMValueRef initializer, LLVMLinkage linkage, RuntimeState* state);
+
+/* Defines each runtime function */
+static void defineFlush(RuntimeState* state);
+static void defineWriteBytes(RuntimeState* state);
+static void defineWriteString(RuntimeState* state);
+static void defineWriteBool(RuntimeState* state);
+static void defineWriteInt(RuntimeState* state);
+
+/* Defines the function that writes its parameter with snprintf, the format
+ * has a single conversion whose output has less than max_length bytes */
+static void defineWriteFormatted(LLVMValueRef function, const char* format,
+        int max_length, RuntimeState* state);
+
+/* Registers the flush as a global destructor */
+static void addFlushDestructor(RuntimeState* state);
+
+/* Appends a block to the function */
+static LLVMBasicBlockRef appendBlock(LLVMValueRef function, const char* name,
+        RuntimeState* state);
+
+/* Flushes the buffer if it hasn't the space, the builder continues in a new
+ * block. Returns the size after the flush. */
+static LLVMValueRef buildReserve(LLVMValueRef function, int space,
+        RuntimeState* state);
+
+/* Returns the address of the buffer's byte */
+static LLVMValueRef buildBufferAt(LLVMValueRef index, RuntimeState* state);
+
+/* Returns a constant int */
+static LLVMValueRef constInt(LLVMTypeRef type, unsigned long long value);
+
+void RuntimeDeclare(LLVMModuleRef module, Runtime* runtime)
+{
+    RuntimeState state_data;
+    RuntimeState* state = &state_data;
+    initState(module, runtime, state);
+
+    LLVMTypeRef int_type = state->int_type;
+    LLVMTypeRef float_type = LLVMFloatTypeInContext(state->context);
+    LLVMTypeRef bool_type = LLVMInt1TypeInContext(state->context);
+    LLVMTypeRef string_type = state->string_type;
+    LLVMTypeRef bytes_types[] = {string_type, int_type};
+    runtime->write_int = addFunction("monga_write_int", state->void_type,
+            &int_type, 1, state);
+    runtime->write_float = addFunction("monga_write_float", state->void_type,
+            &float_type, 1, state);
+    runtime->write_bool = addFunction("monga_write_bool", state->void_type,
+            &bool_type, 1, state);
+    runtime->write_string = addFunction("monga_write_str", state->void_type,
+            &string_type, 1, state);
+    runtime->write_bytes = addFunction("monga_write_bytes", state->void_type,
+            bytes_types, 2, state);
+    runtime->write_pointer = addFunction("monga_write_pointer",
+            state->void_type, &string_type, 1, state);
+    runtime->flush = addFunction("monga_flush", state->void_type, NULL, 0,
+            state);
+
+    LLVMDisposeBuilder(state->builder);
+}
+
+void RuntimeDefine(LLVMModuleRef module, LLVMLinkage linkage,
+        Runtime* runtime)
+{
+    RuntimeState state_data;
+    RuntimeState* state = &state_data;
+    initState(module, runtime, state);
+
+    LLVMTypeRef buffer_type =
+            LLVMArrayType(state->char_type, RUNTIME_BUFFER_SIZE);
+    state->buffer = addGlobal("monga_output_buffer", buffer_type,
+            LLVMConstNull(buffer_type), linkage, state);
+    state->size = addGlobal("monga_output_size", state->int_type,
+            constInt(state->int_type, 0), linkage, state);
+
+    LLVMValueRef functions[N_FUNCTIONS];
+    getFunctions(runtime, functions);
+    for (int i = 0; i < N_FUNCTIONS; ++i)
+        LLVMSetLinkage(functions[i], linkage);
+
+    defineFlush(state);
+    defineWriteBytes(state);
+    defineWriteString(state);
+    defineWriteBool(state);
+    defineWriteInt(state);
+    defineWriteFormatted(runtime->write_float, "%f", 64, state);
+    defineWriteFormatted(runtime->write_pointer, "<pointer> (0x %p)", 64,
+            state);
+    addFlushDestructor(state);
+
+    LLVMDisposeBuilder(state->builder);
+}
+
+bool RuntimeIsUsed(Runtime* runtime)
+{
+    LLVMValueRef functions[N_FUNCTIONS];
+    getFunctions(runtime, functions);
+    for (int i = 0; i < N_FUNCTIONS; ++i) {
+        if (LLVMGetFirstUse(functions[i]) != NULL)
+            return true;
+    }
+    return false;
+}
+
+void RuntimeRemove(Runtime* runtime)
+{
+    LLVMValueRef functions[N_FUNCTIONS];
+    getFunctions(runtime, functions);
+    for (int i = 0; i < N_FUNCTIONS; ++i)
+        LLVMDeleteFunction(functions[i]);
+}
+
+static void initState(LLVMModuleRef module, Runtime* runtime,
+        RuntimeState* state)
+{
+    state->module = module;
+    state->context = LLVMGetModuleContext(module);
+    state->builder = LLVMCreateBuilderInContext(state->context);
+    state->void_type = LLVMVoidTypeInContext(state->context);
+    state->char_type = LLVMInt8TypeInContext(state->context);
+    state->int_type = LLVMInt32TypeInContext(state->context);
+    state->size_type = LLVMInt64TypeInContext(state->context);
+    state->string_type = LLVMPointerType(state->char_type, 0);
+    state->buffer = NULL;
+    state->size = NULL;
+    state->runtime = runtime;
+}
+
+static void getFunctions(Runtime* runtime, LLVMValueRef* functions)
+{
+    functions[0] = runtime->write_int;
+    functions[1] = runtime->write_float;
+    functions[2] = runtime->write_bool;
+    functions[3] = runtime->write_string;
+    functions[4] = runtime->write_bytes;
+    functions[5] = runtime->write_pointer;
+    functions[6] = runtime->flush;
+}
+
+static LLVMValueRef addFunction(const char* name, LLVMTypeRef return_type,
+        LLVMTypeRef* parameters, unsigned n_parameters, RuntimeState* state)
+{
+    LLVMTypeRef type = LLVMFunctionType(return_type, parameters,
+            n_parameters, false);
+    LLVMValueRef function = LLVMAddFunction(state->module, name, type);
+    unsigned kind = LLVMGetEnumAttributeKindForName("nounwind",
+            strlen("nounwind"));
+    LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex,
+            LLVMCreateEnumAttribute(state->context, kind, 0));
+    return function;
+}
+
+static LLVMValueRef getLibraryFunction(const char* name,
+        LLVMTypeRef return_type, LLVMTypeRef* parameters,
+        unsigned n_parameters, bool variadic, RuntimeState* state)
+{
+    LLVMValueRef function = LLVMGetNamedFunction(state->module, name);
+    if (function != NULL)
+        return function;
+
+    LLVMTypeRef type = LLVMFunctionType(return_type, parameters,
+            n_parameters, variadic);
+    return LLVMAddFunction(state->module, name, type);
+}
+
+static LLVMValueRef getStdout(RuntimeState* state)
+{
+    LLVMValueRef stream = LLVMGetNamedGlobal(state->module, "stdout");
+    if (stream == NULL)
+        stream = LLVMAddGlobal(state->module, state->string_type, "stdout");
+    return LLVMBuildLoad(state->builder, stream, "");
+}
+
+static LLVMValueRef addGlobal(const char* name, LLVMTypeRef type,
+        LLVMValueRef initializer, LLVMLinkage linkage, RuntimeState* state)
+{
+    LLVMValueRef global = LLVMAddGlobal(state->module, type, name);
+    LLVMSetInitializer(global, initializer);
+    LLVMSetLinkage(global, linkage);
+    return global;
+}
+
+static void defineFlush(RuntimeState* state)
+{
+    // The stream is flushed too, so the output keeps its order with the
+    // other writers of stdout
+    LLVMValueRef function = state->runtime->flush;
+    LLVMBasicBlockRef entry_block = appendBlock(function, "entry", state);
+    LLVMBasicBlockRef write_block = appendBlock(function, "write", state);
+    LLVMBasicBlockRef out_block = appendBlock(function, "out", state);
+
+    LLVMPositionBuilderAtEnd(state->builder, entry_block);
+    LLVMValueRef size = LLVMBuildLoad(state->builder, state->size, "");
+    LLVMValueRef empty = LLVMBuildICmp(state->builder, LLVMIntEQ, size,
+            constInt(state->int_type, 0), "");
+    LLVMBuildCondBr(state->builder, empty, out_block, write_block);
+
+    LLVMPositionBuilderAtEnd(state->builder, write_block);
+    LLVMTypeRef fwrite_types[] = {state->string_type, state->size_type,
+            state->size_type, state->string_type};
+    LLVMValueRef fwrite = getLibraryFunction("fwrite", state->size_type,
+            fwrite_types, 4, false, state);
+    LLVMValueRef fflush = getLibraryFunction("fflush", state->int_type,
+            &state->string_type, 1, false, state);
+    LLVMValueRef stream = getStdout(state);
+    LLVMValueRef fwrite_arguments[] = {
+        buildBufferAt(constInt(state->int_type, 0), state),
+        constInt(state->size_type, 1),
+        LLVMBuildZExt(state->builder, size, state->size_type, ""),
+        stream
+    };
+    LLVMBuildCall(state->builder, fwrite, fwrite_arguments, 4, "");
+    LLVMBuildCall(state->builder, fflush, &stream, 1, "");
+    LLVMBuildStore(state->builder, constInt(state->int_type, 0), state->size);
+    LLVMBuildBr(state->builder, out_block);
+
+    LLVMPositionBuilderAtEnd(state->builder, out_block);
+    LLVMBuildRetVoid(state->builder);
+}
+
+static void defineWriteBytes(RuntimeState* state)
+{
+    // The bytes that don't fit in an empty buffer are written directly
+    LLVMValueRef function = state->runtime->write_bytes;
+    LLVMValueRef bytes = LLVMGetParam(function, 0);
+    LLVMValueRef length = LLVMGetParam(function, 1);
+    LLVMBasicBlockRef entry_block = appendBlock(function, "entry", state);
+    LLVMBasicBlockRef flush_block = appendBlock(function, "flush", state);
+    LLVMBasicBlockRef direct_block = appendBlock(function, "direct", state);
+    LLVMBasicBlockRef copy_block = appendBlock(function, "copy", state);
+
+    LLVMPositionBuilderAtEnd(state->builder, entry_block);
+    LLVMValueRef size = LLVMBuildLoad(state->builder, state->size, "");
+    LLVMValueRef space = LLVMBuildSub(state->builder,
+            constInt(state->int_type, RUNTIME_BUFFER_SIZE), size, "");
+    LLVMValueRef fits = LLVMBuildICmp(state->builder, LLVMIntULE, length,
+            space, "");
+    LLVMBuildCondBr(state->builder, fits, copy_block, flush_block);
+
+    LLVMPositionBuilderAtEnd(state->builder, flush_block);
+    LLVMBuildCall(state->builder, state->runtime->flush, NULL, 0, "");
+    LLVMValueRef large = LLVMBuildICmp(state->builder, LLVMIntUGT, length,
+            constInt(state->int_type, RUNTIME_BUFFER_SIZE), "");
+    LLVMBuildCondBr(state->builder, large, direct_block, copy_block);
+
+    LLVMPositionBuilderAtEnd(state->builder, direct_block);
+    LLVMTypeRef fwrite_types[] = {state->string_type, state->size_type,
+            state->size_type, state->string_type};
+    LLVMValueRef fwrite = getLibraryFunction("fwrite", state->size_type,
+            fwrite_types, 4, false, state);
+    LLVMValueRef fwrite_arguments[] = {
+        bytes,
+        constInt(state->size_type, 1),
+        LLVMBuildZExt(state->builder, length, state->size_type, ""),
+        getStdout(state)
+    };
+    LLVMBuildCall(state->builder, fwrite, fwrite_arguments, 4, "");
+    LLVMBuildRetVoid(state->builder);
+
+    LLVMPositionBuilderAtEnd(state->builder, copy_block);
+    LLVMValueRef copy_size = LLVMBuildLoad(state->builder, state->size, "");
+    LLVMBuildMemCpy(state->builder, buildBufferAt(copy_size, state), 1,
+            bytes, 1, length);
+    LLVMBuildStore(state->builder,
+            LLVMBuildAdd(state->builder, copy_size, length, ""), state->size);
+    LLVMBuildRetVoid(state->builder);
+}
+
+static void defineWriteString(RuntimeState* state)
+{
+    // The null string is written as printf does
+    LLVMValueRef function = state->runtime->write_string;
+    LLVMValueRef parameter = LLVMGetParam(function, 0);
+    LLVMPositionBuilderAtEnd(state->builder,
+            appendBlock(function, "entry", state));
+
+    LLVMValueRef null = LLVMBuildIsNull(state->builder, parameter, "");
+    LLVMValueRef string = LLVMBuildSelect(state->builder, null,
+            LLVMBuildGlobalStringPtr(state->builder, "(null)", ""), parameter,
+            "");
+    LLVMValueRef strlen = getLibraryFunction("strlen", state->size_type,
+            &state->string_type, 1, false, state);
+    LLVMValueRef length = LLVMBuildCall(state->builder, strlen, &string, 1,
+            "");
+    LLVMValueRef arguments[] = {
+        string,
+        LLVMBuildTrunc(state->builder, length, state->int_type, "")
+    };
+    LLVMBuildCall(state->builder, state->runtime->write_bytes, arguments, 2,
+            "");
+    LLVMBuildRetVoid(state->builder);
+}
+
+static void defineWriteBool(RuntimeState* state)
+{
+    LLVMValueRef function = state->runtime->write_bool;
+    LLVMValueRef value = LLVMGetParam(function, 0);
+    LLVMPositionBuilderAtEnd(state->builder,
+            appendBlock(function, "entry", state));
+
+    LLVMValueRef true_string = LLVMBuildGlobalStringPtr(state->builder,
+            "true", "");
+    LLVMValueRef false_string = LLVMBuildGlobalStringPtr(state->builder,
+            "false", "");
+    LLVMValueRef arguments[] = {
+        LLVMBuildSelect(state->builder, value, true_string, false_string, ""),
+        LLVMBuildSelect(state->builder, value, constInt(state->int_type, 4),
+                constInt(state->int_type, 5), "")
+    };
+    LLVMBuildCall(state->builder, state->runtime->write_bytes, arguments, 2,
+            "");
+    LLVMBuildRetVoid(state->builder);
+}
+
+static void defineWriteInt(RuntimeState* state)
+{
+    // Writes the minus sign, which the digits overwrite if the value isn't
+    // negative, counts the digits and writes them from the last one
+    // The absolute value is unsigned, so INT_MIN has no special case
+    LLVMValueRef function = state->runtime->write_int;
+    LLVMValueRef value = LLVMGetParam(function, 0);
+    LLVMTypeRef int_type = state->int_type;
+    LLVMValueRef zero = constInt(int_type, 0);
+    LLVMValueRef one = constInt(int_type, 1);
+    LLVMValueRef ten = constInt(int_type, 10);
+    LLVMBasicBlockRef entry_block = appendBlock(function, "entry", state);
+    LLVMPositionBuilderAtEnd(state->builder, entry_block);
+    LLVMValueRef size = buildReserve(function, 12, state);
+    LLVMBasicBlockRef start_block = LLVMGetInsertBlock(state->builder);
+    LLVMBasicBlockRef count_block = appendBlock(function, "count", state);
+    LLVMBasicBlockRef digits_block = appendBlock(function, "digits", state);
+    LLVMBasicBlockRef out_block = appendBlock(function, "out", state);
+
+    LLVMValueRef negative = LLVMBuildICmp(state->builder, LLVMIntSLT, value,
+            zero, "");
+    LLVMValueRef absolute = LLVMBuildSelect(state->builder, negative,
+            LLVMBuildSub(state->builder, zero, value, ""), value, "");
+    LLVMBuildStore(state->builder, constInt(state->char_type, '-'),
+            buildBufferAt(size, state));
+    LLVMValueRef first = LLVMBuildAdd(state->builder, size,
+            LLVMBuildZExt(state->builder, negative, int_type, ""), "");
+    LLVMBuildBr(state->builder, count_block);
+
+    LLVMPositionBuilderAtEnd(state->builder, count_block);
+    LLVMValueRef count_value = LLVMBuildPhi(state->builder, int_type, "");
+    LLVMValueRef n_digits = LLVMBuildPhi(state->builder, int_type, "");
+    LLVMValueRef next_value = LLVMBuildUDiv(state->builder, count_value, ten,
+            "");
+    LLVMValueRef next_n_digits = LLVMBuildAdd(state->builder, n_digits, one,
+            "");
+    LLVMValueRef end = LLVMBuildAdd(state->builder, first, n_digits, "");
+    LLVMValueRef more_digits = LLVMBuildICmp(state->builder, LLVMIntUGE,
+            count_value, ten, "");
+    LLVMBuildCondBr(state->builder, more_digits, count_block, digits_block);
+    LLVMValueRef count_values[] = {absolute, next_value};
+    LLVMValueRef n_digits_values[] = {one, next_n_digits};
+    LLVMBasicBlockRef count_blocks[] = {start_block, count_block};
+    LLVMAddIncoming(count_value, count_values, count_blocks, 2);
+    LLVMAddIncoming(n_digits, n_digits_values, count_blocks, 2);
+
+    LLVMPositionBuilderAtEnd(state->builder, digits_block);
+    LLVMValueRef digits_value = LLVMBuildPhi(state->builder, int_type, "");
+    LLVMValueRef position = LLVMBuildPhi(state->builder, int_type, "");
+    LLVMValueRef next_position = LLVMBuildSub(state->builder, position, one,
+            "");
+    LLVMValueRef digit = LLVMBuildTrunc(state->builder,
+            LLVMBuildURem(state->builder, digits_value, ten, ""),
+            state->char_type, "");
+    LLVMBuildStore(state->builder,
+            LLVMBuildAdd(state->builder, digit,
+                    constInt(state->char_type, '0'), ""),
+            buildBufferAt(next_position, state));
+    LLVMValueRef remaining = LLVMBuildUDiv(state->builder, digits_value, ten,
+            "");
+    LLVMValueRef more = LLVMBuildICmp(state->builder, LLVMIntNE, remaining,
+            zero, "");
+    LLVMBuildCondBr(state->builder, more, digits_block, out_block);
+    LLVMValueRef digits_values[] = {absolute, remaining};
+    LLVMValueRef positions[] = {end, next_position};
+    LLVMBasicBlockRef digits_blocks[] = {count_block, digits_block};
+    LLVMAddIncoming(digits_value, digits_values, digits_blocks, 2);
+    LLVMAddIncoming(position, positions, digits_blocks, 2);
+
+    LLVMPositionBuilderAtEnd(state->builder, out_block);
+    LLVMBuildStore(state->builder, end, state->size);
+    LLVMBuildRetVoid(state->builder);
+}
+
+static void defineWriteFormatted(LLVMValueRef function, const char* format,
+        int max_length, RuntimeState* state)
+{
+    LLVMValueRef value = LLVMGetParam(function, 0);
+    LLVMPositionBuilderAtEnd(state->builder,
+            appendBlock(function, "entry", state));
+    LLVMValueRef size = buildReserve(function, max_length, state);
+
+    // The C variadic functions receive the floats as doubles
+    if (LLVMGetTypeKind(LLVMTypeOf(value)) == LLVMFloatTypeKind)
+        value = LLVMBuildFPExt(state->builder, value,
+                LLVMDoubleTypeInContext(state->context), "");
+
+    LLVMTypeRef snprintf_types[] = {state->string_type, state->size_type,
+            state->string_type};
+    LLVMValueRef snprintf = getLibraryFunction("snprintf", state->int_type,
+            snprintf_types, 3, true, state);
+    LLVMValueRef arguments[] = {
+        buildBufferAt(size, state),
+        constInt(state->size_type, max_length),
+        LLVMBuildGlobalStringPtr(state->builder, format, ""),
+        value
+    };
+    LLVMValueRef length = LLVMBuildCall(state->builder, snprintf, arguments,
+            4, "");
+    LLVMBuildStore(state->builder,
+            LLVMBuildAdd(state->builder, size, length, ""), state->size);
+    LLVMBuildRetVoid(state->builder);
+}
+
+static void addFlushDestructor(RuntimeState* state)
+{
+    // The JIT doesn't run the destructors, so main flushes too
+    LLVMTypeRef flush_type = LLVMTypeOf(state->runtime->flush);
+    LLVMTypeRef fields[] = {state->int_type, flush_type, state->string_type};
+    LLVMTypeRef entry_type = LLVMStructTypeInContext(state->context, fields,
+            3, false);
+    LLVMValueRef values[] = {
+        constInt(state->int_type, 65535),
+        state->runtime->flush,
+        LLVMConstNull(state->string_type)
+    };
+    LLVMValueRef entry = LLVMConstNamedStruct(entry_type, values, 3);
+    LLVMTypeRef array_type = LLVMArrayType(entry_type, 1);
+    LLVMValueRef destructors = LLVMAddGlobal(state->module, array_type,
+            "llvm.global_dtors");
+    LLVMSetInitializer(destructors, LLVMConstArray(entry_type, &entry, 1));
+    LLVMSetLinkage(destructors, LLVMAppendingLinkage);
+}
+
+static LLVMBasicBlockRef appendBlock(LLVMValueRef function, const char* name,
+        RuntimeState* state)
+{
+    return LLVMAppendBasicBlockInContext(state->context, function, name);
+}
+
+static LLVMValueRef buildReserve(LLVMValueRef function, int space,
+        RuntimeState* state)
+{
+    LLVMBasicBlockRef flush_block = appendBlock(function, "flush", state);
+    LLVMBasicBlockRef out_block = appendBlock(function, "reserved", state);
+
+    LLVMValueRef size = LLVMBuildLoad(state->builder, state->size, "");
+    LLVMValueRef full = LLVMBuildICmp(state->builder, LLVMIntUGT, size,
+            constInt(state->int_type, RUNTIME_BUFFER_SIZE - space), "");
+    LLVMBuildCondBr(state->builder, full, flush_block, out_block);
+
+    LLVMPositionBuilderAtEnd(state->builder, flush_block);
+    LLVMBuildCall(state->builder, state->runtime->flush, NULL, 0, "");
+    LLVMBuildBr(state->builder, out_block);
+
+    LLVMPositionBuilderAtEnd(state->builder, out_block);
+    return LLVMBuildLoad(state->builder, state->size, "");
+}
+
+static LLVMValueRef buildBufferAt(LLVMValueRef index, RuntimeState* state)
+{
+    LLVMValueRef indices[] = {constInt(state->int_type, 0), index};
+    return LLVMBuildInBoundsGEP(state->builder, state->buffer, indices, 2, "");
+}
+
+static LLVMValueRef constInt(LLVMTypeRef type, unsigned long long value)
+{
+    return LLVMConstInt(type, value, false);
+}
+
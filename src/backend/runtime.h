@@ -0,0 +1,49 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * runtime.h
+ * Output runtime of the print statement, compiled in LLVM IR. The values are
+ * written by typed functions into a buffer, instead of formatted by printf.
+ * The buffer is written to stdout when it is full, when main returns, before
+ * the calls to external functions and by a global destructor.
+ */
+
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stdbool.h>
+
+#include <llvm-c/Core.h>
+
+/* Size of the output buffer, in bytes */
+#define RUNTIME_BUFFER_SIZE (1 << 16)
+
+/* Functions of the runtime in a module */
+typedef struct Runtime {
+    LLVMValueRef write_int;         /* void (i32) */
+    LLVMValueRef write_float;       /* void (float), like %f */
+    LLVMValueRef write_bool;        /* void (i1) */
+    LLVMValueRef write_string;      /* void (i8*), terminated by zero */
+    LLVMValueRef write_bytes;       /* void (i8*, i32) */
+    LLVMValueRef write_pointer;     /* void (i8*) */
+    LLVMValueRef flush;             /* void () */
+} Runtime;
+
+/* Declares the runtime functions in the module */
+void RuntimeDeclare(LLVMModuleRef module, Runtime* runtime);
+
+/* Defines the declared functions and the buffer in the module
+ * The linkage is linkonce_odr for the modules that may be linked together,
+ * so the program has only one buffer. */
+void RuntimeDefine(LLVMModuleRef module, LLVMLinkage linkage,
+        Runtime* runtime);
+
+/* Returns true if the module uses some runtime function */
+bool RuntimeIsUsed(Runtime* runtime);
+
+/* Removes the declarations of the runtime functions */
+void RuntimeRemove(Runtime* runtime);
+
+#endif
+
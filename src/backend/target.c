@@ -0,0 +1,234 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * target.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include <llvm-c/Target.h>
+
+#include "target.h"
+
+#include "backend/extension.h"
+#include "backend/parallel.h"
+#include "util/error.h"
+#include "util/new.h"
+
+/* Environment of the linker process */
+extern char** environ;
+
+/* Linker used when the CC environment variable isn't set */
+static const char* DEFAULT_LINKER = "cc";
+
+/* CPU and features of the generated code, empty for the generic CPU */
+static char* target_cpu = "";
+static char* target_features = "";
+
+/* Threads of the object files' code generation, zero for no threads */
+static int target_threads = 0;
+
+/* Adds a string attribute to the function */
+static void addStringAttribute(LLVMValueRef function, const char* key,
+        const char* value);
+
+/* Runs the linker, the first argument is replaced by the linker name
+ * Returns true if the linker succeeds */
+static bool runLinker(char* arguments[]);
+
+void TargetSelectCpu(const char* cpu, const char* features)
+{
+    if (features == NULL)
+        features = "";
+
+    if (cpu == NULL || strcmp(cpu, TARGET_NATIVE_CPU) != 0) {
+        // LLVM only warns about unknown CPUs, and then it may abort
+        char* triple = LLVMGetDefaultTargetTriple();
+        bool valid = cpu == NULL || ExtensionIsCpuValid(triple, cpu);
+        LLVMDisposeMessage(triple);
+        if (!valid)
+            Error("unknown CPU '%s'", cpu);
+        target_cpu = strdup(cpu != NULL ? cpu : "");
+        target_features = strdup(features);
+        return;
+    }
+
+    // The requested features are applied over the host ones
+    target_cpu = LLVMGetHostCPUName();
+    char* host_features = LLVMGetHostCPUFeatures();
+    size_t length = strlen(host_features) + strlen(features) + 2;
+    target_features = NEW_ARRAY(char, length);
+    if (*features != '\0')
+        sprintf(target_features, "%s,%s", host_features, features);
+    else
+        sprintf(target_features, "%s", host_features);
+    LLVMDisposeMessage(host_features);
+}
+
+const char* TargetGetCpu()
+{
+    return target_cpu;
+}
+
+const char* TargetGetFeatures()
+{
+    return target_features;
+}
+
+void TargetSelectThreads(int n_threads)
+{
+    target_threads = n_threads;
+}
+
+void TargetSetModuleCpu(LLVMModuleRef module)
+{
+    if (*target_cpu == '\0' && *target_features == '\0')
+        return;
+
+    // The backends select the subtarget of each function by its attributes,
+    // so the CPU also reaches the JIT, that has no CPU option
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    for (; function != NULL; function = LLVMGetNextFunction(function)) {
+        if (LLVMIsDeclaration(function))
+            continue;
+        if (*target_cpu != '\0')
+            addStringAttribute(function, "target-cpu", target_cpu);
+        if (*target_features != '\0')
+            addStringAttribute(function, "target-features", target_features);
+    }
+}
+
+LLVMTargetMachineRef TargetCreateHostMachine(int level)
+{
+    char* triple = LLVMGetDefaultTargetTriple();
+    LLVMTargetRef target = NULL;
+    char* error_msg = NULL;
+    if (LLVMGetTargetFromTriple(triple, &target, &error_msg) != 0)
+        Error("unable to find the host target: %s", error_msg);
+
+    LLVMCodeGenOptLevel codegen_level = LLVMCodeGenLevelDefault;
+    if (level <= 0)
+        codegen_level = LLVMCodeGenLevelNone;
+    else if (level == 1)
+        codegen_level = LLVMCodeGenLevelLess;
+    else if (level >= 3)
+        codegen_level = LLVMCodeGenLevelAggressive;
+
+    LLVMTargetMachineRef machine = LLVMCreateTargetMachine(target, triple,
+            target_cpu, target_features, codegen_level, LLVMRelocPIC,
+            LLVMCodeModelDefault);
+    LLVMDisposeMessage(triple);
+    return machine;
+}
+
+void TargetSetModuleMachine(LLVMModuleRef module, LLVMTargetMachineRef machine)
+{
+    char* triple = LLVMGetTargetMachineTriple(machine);
+    LLVMTargetDataRef data_layout = LLVMCreateTargetDataLayout(machine);
+    LLVMSetTarget(module, triple);
+    LLVMSetModuleDataLayout(module, data_layout);
+    LLVMDisposeTargetData(data_layout);
+    LLVMDisposeMessage(triple);
+}
+
+void TargetEmitFile(LLVMModuleRef module, const char* path,
+        LLVMCodeGenFileType file_type, int level)
+{
+    LLVMInitializeNativeAsmPrinter();
+    if (file_type == LLVMObjectFile && target_threads > 0) {
+        ParallelEmitObject(module, path, level, target_threads);
+        return;
+    }
+
+    LLVMTargetMachineRef machine = TargetCreateHostMachine(level);
+    TargetSetModuleMachine(module, machine);
+
+    char* error_msg = NULL;
+    if (LLVMTargetMachineEmitToFile(machine, module, (char*)path, file_type,
+            &error_msg) != 0)
+        Error("unable to emit '%s': %s", path, error_msg);
+
+    LLVMDisposeTargetMachine(machine);
+}
+
+LLVMMemoryBufferRef TargetEmitObjectBuffer(LLVMModuleRef module, int level)
+{
+    LLVMTargetMachineRef machine = TargetCreateHostMachine(level);
+    TargetSetModuleMachine(module, machine);
+
+    LLVMMemoryBufferRef object = NULL;
+    char* error_msg = NULL;
+    if (LLVMTargetMachineEmitToMemoryBuffer(machine, module, LLVMObjectFile,
+            &error_msg, &object) != 0)
+        Error("unable to emit the object: %s", error_msg);
+
+    LLVMDisposeTargetMachine(machine);
+    return object;
+}
+
+void TargetLinkExecutable(const char* object_path, const char* path)
+{
+    char* arguments[] = {NULL, "-o", (char*)path, (char*)object_path, NULL};
+    if (!runLinker(arguments))
+        Error("failed to link '%s'", path);
+}
+
+bool TargetLinkSharedObject(const char* object_path, const char* path)
+{
+    // Binds the program's calls to its own functions, not to the host's
+    char* arguments[] = {NULL, "-shared", "-Wl,-Bsymbolic", "-o", (char*)path,
+            (char*)object_path, NULL};
+    return runLinker(arguments);
+}
+
+bool TargetLinkRelocatable(const char** object_paths, int n_objects,
+        const char* path)
+{
+    // The C runtime is linked later, with the program
+    char** arguments = NEW_ARRAY(char*, n_objects + 6);
+    arguments[0] = NULL;
+    arguments[1] = "-r";
+    arguments[2] = "-nostdlib";
+    arguments[3] = "-o";
+    arguments[4] = (char*)path;
+    for (int i = 0; i < n_objects; ++i)
+        arguments[5 + i] = (char*)object_paths[i];
+    arguments[5 + n_objects] = NULL;
+    bool linked = runLinker(arguments);
+    free(arguments);
+    return linked;
+}
+
+static void addStringAttribute(LLVMValueRef function, const char* key,
+        const char* value)
+{
+    LLVMContextRef context =
+            LLVMGetModuleContext(LLVMGetGlobalParent(function));
+    LLVMAttributeRef attribute = LLVMCreateStringAttribute(context, key,
+            strlen(key), value, strlen(value));
+    LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, attribute);
+}
+
+static bool runLinker(char* arguments[])
+{
+    const char* linker = getenv("CC");
+    if (linker == NULL || *linker == '\0')
+        linker = DEFAULT_LINKER;
+    arguments[0] = (char*)linker;
+
+    pid_t pid;
+    if (posix_spawnp(&pid, linker, NULL, NULL, arguments, environ) != 0)
+        return false;
+
+    int status = 0;
+    return waitpid(pid, &status, 0) >= 0 && WIFEXITED(status) &&
+           WEXITSTATUS(status) == 0;
+}
+
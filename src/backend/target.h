@@ -0,0 +1,62 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * target.h
+ * Host target machine, native code emission and linking.
+ */
+
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <stdbool.h>
+
+#include <llvm-c/Core.h>
+#include <llvm-c/TargetMachine.h>
+
+/* CPU name that selects the host CPU and its features */
+#define TARGET_NATIVE_CPU "native"
+
+/* Selects the CPU and the features (like "+avx2,-fma") of the generated
+ * code. NULL keeps the generic CPU, TARGET_NATIVE_CPU detects the host. */
+void TargetSelectCpu(const char* cpu, const char* features);
+
+/* Obtains the selected CPU and features, after the host detection */
+const char* TargetGetCpu();
+const char* TargetGetFeatures();
+
+/* Selects the number of threads of the object files' code generation
+ * Zero, the default, emits the whole module in the calling thread. */
+void TargetSelectThreads(int n_threads);
+
+/* Sets the selected CPU and features as attributes of the module's functions
+ * It must be called before the optimization and the code generation */
+void TargetSetModuleCpu(LLVMModuleRef module);
+
+/* Creates the target machine for the host with the optimization level
+ * The code is position independent, so it can be linked as PIE */
+LLVMTargetMachineRef TargetCreateHostMachine(int level);
+
+/* Sets the module triple and data layout to the ones of the machine */
+void TargetSetModuleMachine(LLVMModuleRef module, LLVMTargetMachineRef machine);
+
+/* Emits the module as an assembly or object file */
+void TargetEmitFile(LLVMModuleRef module, const char* path,
+        LLVMCodeGenFileType file_type, int level);
+
+/* Emits the module as an object in memory, it is thread safe if each
+ * thread has its own context */
+LLVMMemoryBufferRef TargetEmitObjectBuffer(LLVMModuleRef module, int level);
+
+/* Links the object file with the C runtime, creating an executable */
+void TargetLinkExecutable(const char* object_path, const char* path);
+
+/* Links the object file as a shared object, returns false if it fails */
+bool TargetLinkSharedObject(const char* object_path, const char* path);
+
+/* Links the object files in a relocatable object, returns false if it fails */
+bool TargetLinkRelocatable(const char** object_paths, int n_objects,
+        const char* path);
+
+#endif
+
@@ -0,0 +1,76 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * compiler.c
+ */
+
+#include <stdlib.h>
+
+#include "compiler.h"
+
+#include "backend/ir.h"
+#include "parser/parser.h"
+#include "scanner/scanner.h"
+#include "semantic/effects.h"
+#include "semantic/escape.h"
+#include "semantic/fold.h"
+#include "semantic/semantic.h"
+#include "util/new.h"
+#include "util/table.h"
+
+struct MongaCompiler {
+    /* Identifiers and literal strings of the trees */
+    TableRef pool;
+
+    /* Context of the modules */
+    LLVMContextRef context;
+};
+
+MongaCompiler* CompilerCreate()
+{
+    MongaCompiler* compiler = NEW(MongaCompiler);
+    compiler->pool = ScannerCreatePool();
+    compiler->context = LLVMContextCreate();
+    return compiler;
+}
+
+void CompilerDestroy(MongaCompiler* compiler)
+{
+    LLVMContextDispose(compiler->context);
+    TableDestroy(compiler->pool);
+    free(compiler);
+}
+
+LLVMContextRef CompilerGetContext(MongaCompiler* compiler)
+{
+    return compiler->context;
+}
+
+AstDeclaration* CompilerParse(MongaCompiler* compiler, FILE* input,
+        const char* file_name)
+{
+    Scanner* scanner = ScannerCreate(input, file_name, compiler->pool);
+    AstDeclaration* tree = ParserParse(scanner);
+    ScannerDestroy(scanner);
+    return tree;
+}
+
+void CompilerAnalyse(MongaCompiler* compiler, AstDeclaration* tree,
+        const char* file_name)
+{
+    (void)compiler;
+    SemanticAnalyseTree(tree, file_name);
+    FoldTree(tree);
+    EffectsAnalyseTree(tree);
+    EscapeAnalyseTree(tree);
+}
+
+LLVMModuleRef CompilerGenerate(MongaCompiler* compiler, AstDeclaration* tree,
+        const char* file_name, bool lazy)
+{
+    if (lazy)
+        return IRCompileLazyModule(tree, compiler->context);
+    return IRCompileModule(tree, file_name, compiler->context);
+}
+
@@ -0,0 +1,53 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * compiler.h
+ * Context of a compilation. It owns the pool of identifiers used by the
+ * trees and the LLVM context of the modules, so many programs can be
+ * compiled at the same time, each one in its own thread. The errors are
+ * reported at the file given to each phase, they still exit the process.
+ */
+
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <llvm-c/Core.h>
+
+#include "ast/ast.h"
+
+/* Context of a compilation */
+typedef struct MongaCompiler MongaCompiler;
+
+/* Creates a compilation context */
+MongaCompiler* CompilerCreate();
+
+/* Destroys the context, its trees' identifiers and its LLVM context
+ * The modules that aren't owned by the context, like the ones given to an
+ * execution engine, must be disposed before. */
+void CompilerDestroy(MongaCompiler* compiler);
+
+/* Obtains the LLVM context of the compilation */
+LLVMContextRef CompilerGetContext(MongaCompiler* compiler);
+
+/* Parses the input, returns the AST. The file name is NULL for the standard
+ * input. */
+AstDeclaration* CompilerParse(MongaCompiler* compiler, FILE* input,
+        const char* file_name);
+
+/* Makes the semantic analysis, the folding, the effect analysis and the
+ * escape analysis in the AST. The file name is NULL for the standard input. */
+void CompilerAnalyse(MongaCompiler* compiler, AstDeclaration* tree,
+        const char* file_name);
+
+/* Compiles the LLVM IR module from the analysed AST, in the compilation's
+ * context. If lazy is true, the module is the lazy compilation one. The file
+ * name is NULL for the standard input. */
+LLVMModuleRef CompilerGenerate(MongaCompiler* compiler, AstDeclaration* tree,
+        const char* file_name, bool lazy);
+
+#endif
+
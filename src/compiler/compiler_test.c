@@ -0,0 +1,91 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * compiler_test.c
+ * Compiles the standard input and each file of the arguments at the same
+ * time, each one in its own thread with its own compilation context.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <llvm-c/Analysis.h>
+
+#include "compiler/compiler.h"
+#include "util/error.h"
+#include "util/new.h"
+
+/* Program compiled by a thread */
+typedef struct Program {
+    /* NULL for the standard input */
+    const char* file_name;
+
+    /* Number of functions defined by the module */
+    int n_functions;
+} Program;
+
+/* Compiles the program, run by each thread */
+static void* compileProgram(void* data);
+
+int main(int argc, char* argv[])
+{
+    int n_programs = argc;
+    Program* programs = NEW_ARRAY(Program, n_programs);
+    pthread_t* threads = NEW_ARRAY(pthread_t, n_programs);
+    programs[0].file_name = NULL;
+    for (int i = 1; i < n_programs; ++i)
+        programs[i].file_name = argv[i];
+
+    for (int i = 0; i < n_programs; ++i) {
+        if (pthread_create(&threads[i], NULL, compileProgram,
+                &programs[i]) != 0)
+            Error("unable to create a compilation thread");
+    }
+    for (int i = 0; i < n_programs; ++i)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < n_programs; ++i) {
+        const char* name = programs[i].file_name;
+        printf("monga: %s compiled, %d functions\n",
+                name ? name : "stdin", programs[i].n_functions);
+    }
+    free(threads);
+    free(programs);
+    return 0;
+}
+
+static void* compileProgram(void* data)
+{
+    Program* program = (Program*)data;
+    FILE* input = stdin;
+    if (program->file_name != NULL) {
+        input = fopen(program->file_name, "r");
+        if (input == NULL)
+            Error("unable to open '%s'", program->file_name);
+    }
+
+    MongaCompiler* compiler = CompilerCreate();
+    AstDeclaration* tree = CompilerParse(compiler, input, program->file_name);
+    CompilerAnalyse(compiler, tree, program->file_name);
+    LLVMModuleRef module = CompilerGenerate(compiler, tree,
+            program->file_name, false);
+    if (input != stdin)
+        fclose(input);
+
+    if (LLVMVerifyModule(module, LLVMReturnStatusAction, NULL))
+        Error("invalid module of '%s'",
+                program->file_name ? program->file_name : "stdin");
+
+    program->n_functions = 0;
+    LLVMValueRef function = LLVMGetFirstFunction(module);
+    for (; function != NULL; function = LLVMGetNextFunction(function)) {
+        if (!LLVMIsDeclaration(function))
+            program->n_functions++;
+    }
+
+    LLVMDisposeModule(module);
+    CompilerDestroy(compiler);
+    return NULL;
+}
@@ -5,29 +5,120 @@
  * monga.c
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
 #include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+#include <llvm/Config/llvm-config.h>
 
 #include "ast/ast.h"
+#include "backend/cache.h"
 #include "backend/ir.h"
-#include "parser/parser.h"
-#include "semantic/semantic.h"
+#include "backend/jit.h"
+#include "backend/optimize.h"
+#include "backend/parallel.h"
+#include "backend/target.h"
+#include "compiler/compiler.h"
+#include "server/server.h"
 #include "util/error.h"
+#include "util/new.h"
+#include "util/phase.h"
+#include "util/timer.h"
 
 /* Argument options */
 bool generate_bytecode = false;
 bool dump_module = false;
 bool execute_module = true;
+int optimization_level = 0;
+const char* object_file = NULL;
+const char* assembly_file = NULL;
+const char* executable_file = NULL;
+bool report_jit_time = false;
+bool lazy_compilation = false;
+bool use_cache = false;
+const char* cache_directory = NULL;
+long cache_size = CACHE_DEFAULT_SIZE;
+bool report_cache_statistics = false;
+const char* server_socket = NULL;
+bool time_phases = false;
+const char* target_cpu = NULL;
+const char* target_features = NULL;
+int codegen_threads = 0;
+bool wrapv = false;
+bool check_restrict = false;
+bool bounds_check = false;
+unsigned fast_math = 0;
+bool debug_info = false;
+bool time_phases_json = false;
+const char** input_files = NULL;
+int n_input_files = 0;
+
+/* True if the native program is cached, not only the files' modules */
+bool cache_programs = false;
+
+/* Arguments of the compile server, the requests' options are parsed over
+ * them */
+int server_argc = 0;
+char** server_argv = NULL;
+
+/* Source file read by the compiler */
+typedef struct Source {
+    /* File name, NULL for the standard input */
+    const char* name;
+
+    /* Contents of the file */
+    char* buffer;
+    size_t size;
+
+    /* Tree of the file, NULL if its module is cached */
+    AstDeclaration* tree;
+} Source;
+
+/* Compiler version, part of the cache key */
+static const char* VERSION =
+        "monga " __DATE__ " " __TIME__ " llvm " LLVM_VERSION_STRING;
 
 /* Parses then main arguments */
 static void parseArguments(int argc, char* argv[]);
 
+/* Adds a file to the input files */
+static void addInputFile(const char* name);
+
+/* Returns true if the argument is one of the input files */
+static bool isInputFile(const char* argument);
+
+/* Compiles the program, measuring the phases if it is requested */
+static int runCompiler(int argc, char* argv[], FILE* input);
+
+/* Compiles the inputs and executes or emits the program
+ * The input stream is used if there are no input files */
+static int compileProgram(int argc, char* argv[], FILE* input);
+
+/* Reads the input files, the number of sources is returned by parameter */
+static Source* readSources(FILE* input, int* n_sources);
+
+/* Compiles each source to a module and links them */
+static LLVMModuleRef compileSources(MongaCompiler* compiler, Source* sources,
+        int n_sources, CacheKey options_key);
+
+/* Compiles a source, reusing its cached module if possible */
+static LLVMModuleRef compileSource(MongaCompiler* compiler, Source* source,
+        CacheKey options_key);
+
+/* Handles a request of the compile server */
+static int handleServerRequest(int argc, char* argv[], FILE* input);
+
+/* Returns true if the argument is -O0, -O1, -O2 or -O3 */
+static bool isOptimizationOption(const char* argument);
+
 /* Prints the help message */
 static void printHelpMessage();
 
@@ -37,16 +128,109 @@ static void exportModule(LLVMModuleRef module);
 /* Prints in stdio the LLVM Module */
 static void dumpModule(LLVMModuleRef module);
 
-/* Executes a LLVM module */
-static int executeModule(LLVMModuleRef module);
+/* Emits the native files requested by -c, -S and -o */
+static void emitModule(LLVMModuleRef module);
+
+/* Returns the argument of an option, exits if it is missing */
+static const char* getOptionArgument(int argc, char* argv[], int* i);
+
+/* Parses the comma separated fast math flags, exits if one is unknown */
+static unsigned parseFastMathFlags(const char* list);
+
+/* Executes the main function of the module with the JIT
+ * The lazy compilation needs the program tree and its file name */
+static int executeModule(LLVMModuleRef module, AstDeclaration* tree,
+        const char* file_name);
+
+/* Returns true if the option doesn't change the compiled code */
+static bool isNeutralOption(const char* argument);
+
+/* Reads the whole input, the size is returned by the parameter */
+static char* readInput(FILE* input, size_t* size);
+
+/* Computes the cache key with the version and the options, without the
+ * neutral options and the input files
+ * The server's options are part of its requests' keys */
+static CacheKey computeOptionsKey(int argc, char* argv[]);
+
+/* Combines the key with the options that change the compiled code */
+static CacheKey hashOptions(CacheKey key, int argc, char* argv[]);
+
+/* Combines the key with the source's file name and the working directory,
+ * the debug info embeds them in the module */
+static CacheKey hashSourceFile(CacheKey key, Source* source);
+
+/* Calls the cached main function, measuring it like the JIT */
+static int executeCachedMain(CacheMainFunction main_function);
+
+/* Prints the cache statistics in stderr */
+static void printCacheStatistics();
 
 int main(int argc, char* argv[])
 {
+    // The target must be known before the options select its CPU
+    LLVMInitializeNativeTarget();
     parseArguments(argc, argv);
 
-    yyparse();
-    SemanticAnalyseTree(parser_ast);
-    LLVMModuleRef module = IRCompileModule(parser_ast);
+    if (server_socket) {
+        server_argc = argc;
+        server_argv = argv;
+        JitInitialize(optimization_level);
+        ServerRun(server_socket, handleServerRequest);
+    }
+
+    return runCompiler(argc, argv, stdin);
+}
+
+static int runCompiler(int argc, char* argv[], FILE* input)
+{
+    if (time_phases)
+        PhaseEnable(time_phases_json);
+    int return_value = compileProgram(argc, argv, input);
+    if (use_cache && report_cache_statistics)
+        printCacheStatistics();
+    PhaseReport();
+    return return_value;
+}
+
+static int compileProgram(int argc, char* argv[], FILE* input)
+{
+    PhaseBegin("read");
+    int n_sources = 0;
+    Source* sources = readSources(input, &n_sources);
+    PhaseEnd();
+
+    CacheKey options_key = computeOptionsKey(argc, argv);
+    if (use_cache)
+        CacheOpen(cache_directory, cache_size);
+
+    // A cache hit skips the compilation
+    CacheKey program_key = options_key;
+    if (cache_programs) {
+        for (int i = 0; i < n_sources; ++i) {
+            program_key = CacheHash(program_key, &sources[i].size,
+                    sizeof(size_t));
+            program_key = CacheHash(program_key, sources[i].buffer,
+                    sources[i].size);
+            program_key = hashSourceFile(program_key, &sources[i]);
+        }
+        PhaseBegin("cache");
+        CacheMainFunction main_function = CacheLoad(program_key);
+        CacheRecordAccess(main_function != NULL);
+        PhaseEnd();
+        if (main_function != NULL)
+            return executeCachedMain(main_function);
+    }
+
+    // The modules live in the compiler's context until the program ends
+    MongaCompiler* compiler = CompilerCreate();
+    LLVMModuleRef module = compileSources(compiler, sources, n_sources,
+            options_key);
+    TargetSetModuleCpu(module);
+
+    PhaseBegin("optimize");
+    OptimizeModule(module, optimization_level);
+    PhaseEnd();
 
     if (generate_bytecode)
         exportModule(module);
@@ -54,13 +238,127 @@ int main(int argc, char* argv[])
     if (dump_module)
         dumpModule(module);
 
+    PhaseBegin("codegen");
+    emitModule(module);
+    PhaseEnd();
+
+    CacheMainFunction main_function = NULL;
+    if (cache_programs) {
+        PhaseBegin("codegen");
+        bool stored = CacheStore(program_key, module, optimization_level);
+        PhaseEnd();
+        main_function = stored ? CacheLoad(program_key) : NULL;
+    }
+
     int return_value = 0;
-    if (execute_module)
-        return_value = executeModule(module);
+    if (main_function != NULL)
+        return_value = executeCachedMain(main_function);
+    else if (execute_module)
+        return_value = executeModule(module, sources[0].tree,
+                sources[0].name);
 
+    CompilerDestroy(compiler);
     return return_value;
 }
 
+static Source* readSources(FILE* input, int* n_sources)
+{
+    if (n_input_files == 0) {
+        Source* source = NEW(Source);
+        source->name = NULL;
+        source->buffer = readInput(input, &source->size);
+        source->tree = NULL;
+        *n_sources = 1;
+        return source;
+    }
+
+    Source* sources = NEW_ARRAY(Source, n_input_files);
+    for (int i = 0; i < n_input_files; ++i) {
+        sources[i].tree = NULL;
+        if (strcmp(input_files[i], "-") == 0) {
+            sources[i].name = NULL;
+            sources[i].buffer = readInput(input, &sources[i].size);
+            continue;
+        }
+
+        FILE* file = fopen(input_files[i], "r");
+        if (file == NULL)
+            Error("unable to open '%s'", input_files[i]);
+        sources[i].name = input_files[i];
+        sources[i].buffer = readInput(file, &sources[i].size);
+        fclose(file);
+    }
+    *n_sources = n_input_files;
+    return sources;
+}
+
+static LLVMModuleRef compileSources(MongaCompiler* compiler, Source* sources,
+        int n_sources, CacheKey options_key)
+{
+    LLVMModuleRef module = NULL;
+    for (int i = 0; i < n_sources; ++i) {
+        LLVMModuleRef source_module = compileSource(compiler, &sources[i],
+                options_key);
+        if (module == NULL) {
+            module = source_module;
+            continue;
+        }
+
+        PhaseBegin("link");
+        if (LLVMLinkModules2(module, source_module) != 0)
+            Error("failed to link '%s'", sources[i].name ? sources[i].name :
+                    "stdin");
+        PhaseEnd();
+    }
+
+    // The calls between the files don't need to flush the output
+    if (n_sources > 1) {
+        PhaseBegin("link");
+        IRRemoveLinkedFlushes(module);
+        PhaseEnd();
+    }
+    return module;
+}
+
+static LLVMModuleRef compileSource(MongaCompiler* compiler, Source* source,
+        CacheKey options_key)
+{
+    // The module depends only on its file, other files are seen by extern
+    CacheKey key = CacheHash(options_key, source->buffer, source->size);
+    key = hashSourceFile(key, source);
+    if (use_cache) {
+        PhaseBegin("cache");
+        LLVMModuleRef module =
+                CacheLoadModule(key, CompilerGetContext(compiler));
+        CacheRecordAccess(module != NULL);
+        PhaseEnd();
+        if (module != NULL)
+            return module;
+    }
+
+    PhaseBegin("parse");
+    FILE* input = fmemopen(source->buffer, source->size, "r");
+    source->tree = CompilerParse(compiler, input, source->name);
+    fclose(input);
+    PhaseEnd();
+
+    PhaseBegin("semantic");
+    CompilerAnalyse(compiler, source->tree, source->name);
+    PhaseEnd();
+
+    PhaseBegin("ir");
+    LLVMModuleRef module = CompilerGenerate(compiler, source->tree,
+            source->name, lazy_compilation);
+    PhaseEnd();
+
+    if (use_cache) {
+        PhaseBegin("cache");
+        CacheStoreModule(key, module);
+        PhaseEnd();
+    }
+    return module;
+}
+
 static void parseArguments(int argc, char* argv[])
 {
 	for (int i = 1; i < argc; ++i) {
@@ -72,9 +370,151 @@ static void parseArguments(int argc, char* argv[])
             dump_module = true;
         else if (strcmp(argv[i], "-no-execution") == 0)
             execute_module = false;
+        else if (isOptimizationOption(argv[i]))
+            optimization_level = argv[i][2] - '0';
+        else if (strcmp(argv[i], "-jit-time") == 0)
+            report_jit_time = true;
+        else if (strcmp(argv[i], "-lazy") == 0)
+            lazy_compilation = true;
+        else if (strcmp(argv[i], "-cache") == 0)
+            use_cache = true;
+        else if (strcmp(argv[i], "-cache-dir") == 0)
+            cache_directory = getOptionArgument(argc, argv, &i);
+        else if (strcmp(argv[i], "-cache-size") == 0)
+            cache_size = atol(getOptionArgument(argc, argv, &i)) * 1024 * 1024;
+        else if (strcmp(argv[i], "-cache-stats") == 0)
+            report_cache_statistics = true;
+        else if (strcmp(argv[i], "-time-phases") == 0)
+            time_phases = true;
+        else if (strcmp(argv[i], "-time-phases=json") == 0)
+            time_phases = time_phases_json = true;
+        else if (strncmp(argv[i], "-mcpu=", strlen("-mcpu=")) == 0)
+            target_cpu = argv[i] + strlen("-mcpu=");
+        else if (strncmp(argv[i], "-march=", strlen("-march=")) == 0)
+            target_cpu = argv[i] + strlen("-march=");
+        else if (strncmp(argv[i], "-mattr=", strlen("-mattr=")) == 0)
+            target_features = argv[i] + strlen("-mattr=");
+        else if (strcmp(argv[i], "-j") == 0)
+            codegen_threads = atoi(getOptionArgument(argc, argv, &i));
+        else if (strcmp(argv[i], "-fwrapv") == 0)
+            wrapv = true;
+        else if (strcmp(argv[i], "-fcheck-restrict") == 0)
+            check_restrict = true;
+        else if (strcmp(argv[i], "-fbounds-check") == 0)
+            bounds_check = true;
+        else if (strcmp(argv[i], "-ffast-math") == 0)
+            fast_math = IR_FAST_MATH_ALL;
+        else if (strncmp(argv[i], "-ffast-math=", strlen("-ffast-math=")) == 0)
+            fast_math = parseFastMathFlags(argv[i] + strlen("-ffast-math="));
+        else if (strcmp(argv[i], "-g") == 0)
+            debug_info = true;
+        else if (strcmp(argv[i], "-server") == 0)
+            server_socket = getOptionArgument(argc, argv, &i);
+        else if (strcmp(argv[i], "-c") == 0)
+            object_file = getOptionArgument(argc, argv, &i);
+        else if (strcmp(argv[i], "-S") == 0)
+            assembly_file = getOptionArgument(argc, argv, &i);
+        else if (strcmp(argv[i], "-o") == 0)
+            executable_file = getOptionArgument(argc, argv, &i);
+        else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0)
+            addInputFile(argv[i]);
         else
             Error("Unknown option: %s", argv[i]);
 	}
+
+    // Native outputs replace the execution, like a regular compiler
+    if (object_file || assembly_file || executable_file) {
+        if (lazy_compilation)
+            Error("-lazy can't be used with native outputs");
+        execute_module = false;
+    }
+
+    // The lazy compilation needs the trees of the functions
+    if (lazy_compilation) {
+        if (n_input_files > 1)
+            Error("-lazy can't be used with multiple files");
+        use_cache = false;
+    }
+
+    TargetSelectCpu(target_cpu, target_features);
+
+    if (codegen_threads < 0 || codegen_threads > PARALLEL_MAX_THREADS)
+        Error("invalid number of threads, the limit is %d",
+                PARALLEL_MAX_THREADS);
+    TargetSelectThreads(codegen_threads);
+    IRSelectWrapv(wrapv);
+    IRSelectCheckRestrict(check_restrict);
+    IRSelectBoundsCheck(bounds_check);
+    OptimizeSelectRangeCheckElimination(bounds_check);
+    IRSelectFastMath(fast_math);
+    IRSelectDebugInfo(debug_info);
+    JitSelectProfiling(debug_info);
+
+    // The native program is cached only when it replaces the execution
+    cache_programs = use_cache && execute_module && !generate_bytecode &&
+            !dump_module;
+}
+
+static void addInputFile(const char* name)
+{
+    input_files = NewRealloc(input_files,
+            sizeof(const char*) * (n_input_files + 1));
+    input_files[n_input_files++] = name;
+}
+
+static bool isInputFile(const char* argument)
+{
+    for (int i = 0; i < n_input_files; ++i) {
+        if (input_files[i] == argument)
+            return true;
+    }
+    return false;
+}
+
+static const char* getOptionArgument(int argc, char* argv[], int* i)
+{
+    if (*i + 1 >= argc)
+        Error("Missing argument for option: %s", argv[*i]);
+    return argv[++(*i)];
+}
+
+static unsigned parseFastMathFlags(const char* list)
+{
+    const struct {
+        const char* name;
+        unsigned flag;
+    } flags[] = {
+        {"reassoc", IR_FAST_MATH_REASSOC},
+        {"contract", IR_FAST_MATH_CONTRACT},
+        {"nnan", IR_FAST_MATH_NNAN},
+        {"ninf", IR_FAST_MATH_NINF},
+        {"nsz", IR_FAST_MATH_NSZ},
+        {"arcp", IR_FAST_MATH_ARCP},
+        {"afn", IR_FAST_MATH_AFN}
+    };
+    size_t n_flags = sizeof(flags) / sizeof(flags[0]);
+
+    unsigned fast_math_flags = 0;
+    while (*list != '\0') {
+        size_t length = strcspn(list, ",");
+        size_t i = 0;
+        while (i < n_flags && (strlen(flags[i].name) != length ||
+                strncmp(list, flags[i].name, length) != 0))
+            ++i;
+        if (i == n_flags)
+            Error("unknown fast math flag '%.*s'", (int)length, list);
+        fast_math_flags |= flags[i].flag;
+        list += length;
+        if (*list == ',')
+            list++;
+    }
+    return fast_math_flags;
+}
+
+static bool isOptimizationOption(const char* argument)
+{
+    return strlen(argument) == 3 && argument[0] == '-' && argument[1] == 'O' &&
+           argument[2] >= '0' && argument[2] <= '0' + OPTIMIZE_MAX_LEVEL;
 }
 
 static void printHelpMessage()
@@ -82,12 +522,54 @@ static void printHelpMessage()
     printf(
     "Usage:\n"
     "    monga [options] < [input]\n"
+    "    monga [options] [files]\n"
+    "\n"
+    "Files are compiled separately and linked, they share symbols with\n"
+    "extern declarations. The file '-' is the standard input.\n"
+    "\n"
+    "Array parameters and locals declared restrict, like\n"
+    "'float[] restrict a', must be the only variables that access their\n"
+    "elements, of any dimension, in the function.\n"
+    "\n"
+    "While loops accept optimization annotations, like\n"
+    "'@unroll(4) @vectorize(width=8) while (...)'. The annotations are\n"
+    "@unroll, @unroll(count), @nounroll, @vectorize, @vectorize(width),\n"
+    "@novectorize and @interleave(count). Function definitions annotated\n"
+    "with @fastmath use all the fast math flags.\n"
     "\n"
     "Options:\n"
     "    -h             Shows this message\n"
     "    -bc            Exports the llvm bytecode file\n"
     "    -dump          Dumps the llvm module\n"
-    "    -no-execution  Doesn't execute the monga program\n");
+    "    -no-execution  Doesn't execute the monga program\n"
+    "    -O<level>      Optimization level, from 0 (default) to 3\n"
+    "    -jit-time      Prints the JIT compile and run times in stderr\n"
+    "    -mcpu=<cpu>    Generates code for the CPU, like skylake or native\n"
+    "    -march=<cpu>   Same as -mcpu, -march=native uses the host CPU\n"
+    "    -mattr=<attrs> Enables or disables CPU features, like +avx2,-fma\n"
+    "    -j <n>         Generates the native code in n threads\n"
+    "    -fwrapv        Signed integer overflow wraps, instead of undefined\n"
+    "    -fcheck-restrict Traps if a restrict array argument is equal to\n"
+    "                   other argument\n"
+    "    -fbounds-check Traps if an array index is out of the bounds\n"
+    "    -ffast-math    Float arithmetic may be reassociated and contracted,\n"
+    "                   and assumes no NaNs, infinities or signed zeros\n"
+    "    -ffast-math=<f> Uses only the fast math flags of the list, like\n"
+    "                   reassoc,contract. The flags are reassoc, contract,\n"
+    "                   nnan, ninf, nsz, arcp and afn\n"
+    "    -g             Emits the DWARF lines of the functions and writes the\n"
+    "                   JIT's functions to /tmp/perf-<pid>.map for perf\n"
+    "    -time-phases   Prints the time and memory of each phase in stderr\n"
+    "    -time-phases=json Prints the phases' measures as JSON\n"
+    "    -lazy          Compiles each function on its first call\n"
+    "    -cache         Reuses the programs and modules of previous runs\n"
+    "    -cache-dir <d> Cache directory, default $XDG_CACHE_HOME/monga\n"
+    "    -cache-size <n> Cache size limit in MB, default 64\n"
+    "    -cache-stats   Prints the cache statistics in stderr\n"
+    "    -server <s>    Runs a compile server at the Unix socket\n"
+    "    -c <file>      Emits a native object file\n"
+    "    -S <file>      Emits a native assembly file\n"
+    "    -o <file>      Emits a native executable, the program needs main\n");
 }
 
 static void exportModule(LLVMModuleRef module)
@@ -104,25 +586,156 @@ static void dumpModule(LLVMModuleRef module)
     LLVMDisposeMessage(str);
 }
 
-static int executeModule(LLVMModuleRef module)
+static void emitModule(LLVMModuleRef module)
 {
-    LLVMExecutionEngineRef engine;
-    char* error_msg = NULL;
-    LLVMLinkInJIT();
-    LLVMInitializeNativeTarget();
-    if (LLVMCreateExecutionEngineForModule(&engine, module, &error_msg) != 0) {
-        Error("failed to create execution engine");
+    if (object_file)
+        TargetEmitFile(module, object_file, LLVMObjectFile, optimization_level);
+
+    if (assembly_file) {
+        TargetEmitFile(module, assembly_file, LLVMAssemblyFile,
+                optimization_level);
+    }
+
+    if (executable_file) {
+        if (LLVMGetNamedFunction(module, "main") == NULL)
+            Error("main function not found");
+
+        size_t length = strlen(executable_file);
+        char temporary_object[length + 3];
+        sprintf(temporary_object, "%s.o", executable_file);
+        TargetEmitFile(module, temporary_object, LLVMObjectFile,
+                optimization_level);
+        TargetLinkExecutable(temporary_object, executable_file);
+        remove(temporary_object);
+    }
+}
+
+static int executeModule(LLVMModuleRef module, AstDeclaration* tree,
+        const char* file_name)
+{
+    JitStatistics statistics;
+    int return_value = 0;
+    if (lazy_compilation) {
+        return_value = JitExecuteLazyModule(module, tree, file_name,
+                optimization_level, &statistics);
+    } else {
+        return_value = JitExecuteModule(module, optimization_level,
+                &statistics);
     }
-    if (error_msg != NULL) {
-        LLVMDisposeMessage(error_msg);
-        Error("error: %s", error_msg);
+
+    if (report_jit_time) {
+        fflush(stdout);
+        fprintf(stderr, "monga: jit compile time %f s, run time %f s, "
+                "compiled %d of %d functions\n", statistics.compile_time,
+                statistics.run_time, statistics.n_compiled_functions,
+                statistics.n_functions);
     }
-    LLVMValueRef main_function = LLVMGetNamedFunction(module, "main");
-    if (main_function == NULL) {
-        Error("main function not found");
+
+    return return_value;
+}
+
+static int handleServerRequest(int argc, char* argv[], FILE* input)
+{
+    // The request's options are parsed over the server's options
+    parseArguments(argc, argv);
+    return runCompiler(argc, argv, input);
+}
+
+static bool isNeutralOption(const char* argument)
+{
+    return strncmp(argument, "-cache", strlen("-cache")) == 0 ||
+           strcmp(argument, "-server") == 0 ||
+           strncmp(argument, "-time-phases", strlen("-time-phases")) == 0 ||
+           strcmp(argument, "-jit-time") == 0 ||
+           strcmp(argument, "-j") == 0;
+}
+
+static char* readInput(FILE* input, size_t* size)
+{
+    size_t capacity = 4096;
+    char* buffer = NEW_ARRAY(char, capacity);
+    *size = 0;
+    size_t n_read = 0;
+    while ((n_read = fread(buffer + *size, 1, capacity - *size, input)) > 0) {
+        *size += n_read;
+        if (*size == capacity) {
+            capacity *= 2;
+            buffer = NewRealloc(buffer, capacity);
+        }
     }
-    LLVMGenericValueRef result = LLVMRunFunction(engine, main_function, 0, NULL);
-    LLVMDisposeExecutionEngine(engine);
-    return (int)LLVMGenericValueToInt(result, 0);
+    return buffer;
+}
+
+static CacheKey computeOptionsKey(int argc, char* argv[])
+{
+    CacheKey key = CACHE_KEY_INIT;
+    key = CacheHash(key, VERSION, strlen(VERSION) + 1);
+
+    // The host CPU may change, even if the options don't
+    const char* cpu = TargetGetCpu();
+    const char* features = TargetGetFeatures();
+    key = CacheHash(key, cpu, strlen(cpu) + 1);
+    key = CacheHash(key, features, strlen(features) + 1);
+
+    // The server's arguments are empty outside the server
+    key = hashOptions(key, server_argc, server_argv);
+    return hashOptions(key, argc, argv);
+}
+
+static CacheKey hashOptions(CacheKey key, int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (isNeutralOption(argv[i])) {
+            // Skips the option's argument too
+            if (strcmp(argv[i], "-cache-dir") == 0 ||
+                strcmp(argv[i], "-cache-size") == 0 ||
+                strcmp(argv[i], "-server") == 0 ||
+                strcmp(argv[i], "-j") == 0)
+                ++i;
+            continue;
+        }
+        if (!isInputFile(argv[i]))
+            key = CacheHash(key, argv[i], strlen(argv[i]) + 1);
+    }
+
+    // Separates the server's options from the request's
+    return CacheHash(key, "", 1);
+}
+
+static CacheKey hashSourceFile(CacheKey key, Source* source)
+{
+    if (!debug_info)
+        return key;
+
+    // Same names as the debug info's file
+    const char* name = source->name != NULL ? source->name : "<stdin>";
+    char directory[PATH_MAX];
+    if (getcwd(directory, sizeof(directory)) == NULL)
+        strcpy(directory, ".");
+    key = CacheHash(key, name, strlen(name) + 1);
+    return CacheHash(key, directory, strlen(directory) + 1);
+}
+
+static int executeCachedMain(CacheMainFunction main_function)
+{
+    PhaseBegin("run");
+    double run_start = TimerWallTime();
+    int return_value = main_function();
+    double run_time = TimerWallTime() - run_start;
+    PhaseEnd();
+
+    fflush(stdout);
+    if (report_jit_time)
+        fprintf(stderr, "monga: cached native code, run time %f s\n", run_time);
+    return return_value;
+}
+
+static void printCacheStatistics()
+{
+    CacheStatistics statistics;
+    CacheGetStatistics(&statistics);
+    fprintf(stderr, "monga: cache hits %ld, misses %ld, entries %ld, "
+            "size %ld bytes\n", statistics.hits, statistics.misses,
+            statistics.entries, statistics.size);
 }
 
@@ -11,12 +11,12 @@
 
 #include "ast/ast.h"
 #include "parser/parser.tab.h"
+#include "scanner/scanner.h"
 
-/* Yacc parser function prototype, returns 0 on success */
-int yyparse();
-
-/* AST generated by the parser */
-extern AstDeclaration* parser_ast;
+/* Parses the scanner's input, returns the AST
+ * Syntax errors exit the program. The parser keeps its state in the stack,
+ * so many inputs can be parsed at the same time. */
+AstDeclaration* ParserParse(Scanner* scanner);
 
 #endif
 
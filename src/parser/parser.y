@@ -10,13 +10,57 @@
 #include <string.h>
 
 #include "ast/ast.h"
+#include "parser/parser.h"
 #include "scanner/scanner.h"
 #include "util/error.h"
+%}
 
-void yyerror(const char* message);
+%code requires {
+#include "ast/ast.h"
 
-AstDeclaration* parser_ast = NULL;
-%}
+struct Scanner;
+}
+
+%code {
+/* Reads the tokens from the scanner */
+static int yylex(YYSTYPE* value, struct Scanner* scanner);
+
+/* Reports a syntax error, exits the program */
+static void yyerror(struct Scanner* scanner, AstDeclaration** tree,
+        const char* message);
+
+/* Annotations, the loop ones are written before while statements and the
+ * others before function definitions. The parameter is the name of the
+ * value, NULL if the annotation doesn't have a value. */
+static const struct {
+    const char* name;
+    int tag;
+    const char* parameter;
+    bool optional;
+    bool loop;
+} annotations[] = {
+    {"unroll", AST_ANNOTATION_UNROLL, "count", true, true},
+    {"nounroll", AST_ANNOTATION_NOUNROLL, NULL, true, true},
+    {"vectorize", AST_ANNOTATION_VECTORIZE, "width", true, true},
+    {"novectorize", AST_ANNOTATION_NOVECTORIZE, NULL, true, true},
+    {"interleave", AST_ANNOTATION_INTERLEAVE, "count", false, true},
+    {"fastmath", AST_ANNOTATION_FASTMATH, NULL, true, false}
+};
+
+/* Creates the annotation, exits the program if it isn't valid
+ * The parameter is NULL if the value isn't named */
+static AstAnnotation* createAnnotation(struct Scanner* scanner, char* name,
+        char* parameter, int value, bool has_value, int line);
+
+/* Verifies if the annotations are of loops or of functions */
+static void checkAnnotations(struct Scanner* scanner, AstAnnotation* list,
+        bool loop);
+}
+
+%define api.pure
+%lex-param {struct Scanner* scanner}
+%parse-param {struct Scanner* scanner}
+%parse-param {AstDeclaration** tree}
 
 %token <int_> TK_VOID
 %token <int_> TK_BOOL
@@ -33,6 +77,8 @@ AstDeclaration* parser_ast = NULL;
 %token <int_> TK_NULL
 %token <int_> TK_TRUE
 %token <int_> TK_FALSE
+%token <int_> TK_EXTERN
+%token <int_> TK_RESTRICT
 
 %token <int_> TK_EQUALS
 %token <int_> TK_NOT_EQUALS
@@ -60,6 +106,7 @@ AstDeclaration* parser_ast = NULL;
     AstStatement* AstStatement_;
     AstExpression* AstExpression_;
     AstVariable* AstVariable_;
+    AstAnnotation* AstAnnotation_;
 };
 
 %nonassoc TKX_IF
@@ -77,16 +124,17 @@ AstDeclaration* parser_ast = NULL;
 %type <int_> '<' '>' '+' '-' '*' '/' '{' '!' ';' '[' '='
 %type <Type_> base_type type
 %type <AstDeclaration_> declarations variable_declaration identifier_list function_declaration
-                    parameters parameters_list variables_block
+                    extern_declaration parameters parameters_list variables_block declarator
 %type <AstStatement_> block commands_block command
 %type <AstExpression_> call expression expression_list
 %type <AstVariable_> variable
+%type <AstAnnotation_> annotations annotation
 
 %%
 
 program             : declarations
                         {
-                            parser_ast = $1;
+                            *tree = $1;
                         }
                     ;
 
@@ -98,6 +146,16 @@ declarations        : declarations variable_declaration
                         {
                             $$ = AST_CONCAT($1, $2);
                         }
+                    | declarations extern_declaration
+                        {
+                            $$ = AST_CONCAT($1, $2);
+                        }
+                    | declarations annotations function_declaration
+                        {
+                            checkAnnotations(scanner, $2, false);
+                            $3->u.function_.annotations = $2;
+                            $$ = AST_CONCAT($1, $3);
+                        }
                     | /* empty */
                         {
                             $$ = NULL;
@@ -109,7 +167,8 @@ variable_declaration: type identifier_list ';'
                             AstDeclaration* node = $2;
                             $$ = $2;
                             while (node) {
-                                node->type = $1;
+                                node->type.tag = $1.tag;
+                                node->type.pointers = $1.pointers;
                                 node = node->next;
                             }
                         }
@@ -144,18 +203,27 @@ base_type           : TK_BOOL
                         }
                     ;
 
-identifier_list     : identifier_list ',' TK_ID
+identifier_list     : identifier_list ',' declarator
                         {
-                            Type type = TypeCreate(TYPE_UNDEFINED, 0);
-                            AstDeclaration* node = AstDeclarationVariable(
-                                    type, $3.str, $3.line);
-                            $$ = AST_CONCAT($1, node);
+                            $$ = AST_CONCAT($1, $3);
                         }
-                    | TK_ID
+                    | declarator
+                        {
+                            $$ = $1;
+                        }
+                    ;
+
+declarator          : TK_ID
                         {
                             Type type = TypeCreate(TYPE_UNDEFINED, 0);
                             $$ = AstDeclarationVariable(type, $1.str, $1.line);
                         }
+                    | TK_RESTRICT TK_ID
+                        {
+                            Type type = TypeCreate(TYPE_UNDEFINED, 0);
+                            type.restricted = true;
+                            $$ = AstDeclarationVariable(type, $2.str, $2.line);
+                        }
                     ;
 
 function_declaration: type TK_ID '(' parameters ')' block
@@ -169,6 +237,28 @@ function_declaration: type TK_ID '(' parameters ')' block
                         }
                     ;
 
+extern_declaration  : TK_EXTERN variable_declaration
+                        {
+                            AstDeclaration* node = $2;
+                            $$ = $2;
+                            while (node) {
+                                node->external = true;
+                                node = node->next;
+                            }
+                        }
+                    | TK_EXTERN type TK_ID '(' parameters ')' ';'
+                        {
+                            $$ = AstDeclarationFunction($2, $3.str, $3.line, $5, NULL);
+                            $$->external = true;
+                        }
+                    | TK_EXTERN TK_VOID TK_ID '(' parameters ')' ';'
+                        {
+                            Type type = TypeCreate(TYPE_VOID, 0);
+                            $$ = AstDeclarationFunction(type, $3.str, $3.line, $5, NULL);
+                            $$->external = true;
+                        }
+                    ;
+
 parameters          : parameters_list
                         {
                             $$ = $1;
@@ -179,14 +269,17 @@ parameters          : parameters_list
                         }
                     ;
 
-parameters_list     : parameters_list ',' type TK_ID
+parameters_list     : parameters_list ',' type declarator
                         {
-                            AstDeclaration* node = AstDeclarationVariable($3, $4.str, $4.line);
-                            $$ = AST_CONCAT($1, node);
+                            $4->type.tag = $3.tag;
+                            $4->type.pointers = $3.pointers;
+                            $$ = AST_CONCAT($1, $4);
                         }
-                    | type TK_ID
+                    | type declarator
                         {
-                            $$ = AstDeclarationVariable($1, $2.str, $2.line);
+                            $2->type.tag = $1.tag;
+                            $2->type.pointers = $1.pointers;
+                            $$ = $2;
                         }
                     ;
 
@@ -228,6 +321,12 @@ command             : TK_IF '(' expression ')' command %prec TKX_IF
                         {
                             $$ = AstStatementWhile($3, $5, $1);
                         }
+                    | annotations TK_WHILE '(' expression ')' command
+                        {
+                            checkAnnotations(scanner, $1, true);
+                            $$ = AstStatementWhile($4, $6, $2);
+                            $$->u.while_.annotations = $1;
+                        }
                     | variable '=' expression ';'
                         {
                             $$ = AstStatementAssign($1, $3, $2);
@@ -258,6 +357,33 @@ command             : TK_IF '(' expression ')' command %prec TKX_IF
                         }
                     ;
 
+annotations         : annotations annotation
+                        {
+                            $$ = AST_CONCAT($1, $2);
+                        }
+                    | annotation
+                        {
+                            $$ = $1;
+                        }
+                    ;
+
+annotation          : '@' TK_ID
+                        {
+                            $$ = createAnnotation(scanner, $2.str, NULL, 0,
+                                    false, $2.line);
+                        }
+                    | '@' TK_ID '(' TK_KINT ')'
+                        {
+                            $$ = createAnnotation(scanner, $2.str, NULL, $4,
+                                    true, $2.line);
+                        }
+                    | '@' TK_ID '(' TK_ID '=' TK_KINT ')'
+                        {
+                            $$ = createAnnotation(scanner, $2.str, $4.str,
+                                    $6, true, $2.line);
+                        }
+                    ;
+
 variable            : TK_ID
                         {
                             $$ = AstVariableReference($1.str, $1.line);
@@ -388,13 +514,71 @@ expression_list     : expression_list ',' expression
 
 %%
 
-void yyerror(const char* s)
+AstDeclaration* ParserParse(Scanner* scanner)
 {
-    char* token = ScannerGetCurrentToken();
-    int line = ScannerGetCurrentLine();
+    AstDeclaration* tree = NULL;
+    yyparse(scanner, &tree);
+    return tree;
+}
+
+static int yylex(YYSTYPE* value, struct Scanner* scanner)
+{
+    return ScannerNextToken(scanner, value);
+}
+
+static void yyerror(struct Scanner* scanner, AstDeclaration** tree,
+        const char* s)
+{
+    (void)tree;
+    char* token = ScannerGetCurrentToken(scanner);
+    const char* file_name = ScannerGetFileName(scanner);
+    int line = ScannerGetCurrentLine(scanner);
     if (*token == '\0')
-        ErrorL(line, "%s, unexpected end of file", s);
+        ErrorL(file_name, line, "%s, unexpected end of file", s);
     else
-        ErrorL(line, "%s, unexpected token '%s'", s, token);
+        ErrorL(file_name, line, "%s, unexpected token '%s'", s, token);
+}
+
+static AstAnnotation* createAnnotation(struct Scanner* scanner, char* name,
+        char* parameter, int value, bool has_value, int line)
+{
+    const char* file_name = ScannerGetFileName(scanner);
+    size_t n = sizeof(annotations) / sizeof(annotations[0]);
+    for (size_t i = 0; i < n; ++i) {
+        if (strcmp(name, annotations[i].name) != 0)
+            continue;
+        const char* expected = annotations[i].parameter;
+        if (has_value && expected == NULL)
+            ErrorL(file_name, line, "annotation '@%s' doesn't have a value",
+                    name);
+        if (!has_value && !annotations[i].optional)
+            ErrorL(file_name, line, "annotation '@%s' requires a %s", name,
+                    expected);
+        if (parameter != NULL && strcmp(parameter, expected) != 0)
+            ErrorL(file_name, line, "unknown parameter '%s' of annotation "
+                    "'@%s'", parameter, name);
+        if (has_value && value <= 0)
+            ErrorL(file_name, line, "%s of annotation '@%s' must be positive",
+                    expected, name);
+        return AstAnnotationCreate(annotations[i].tag, value, line);
+    }
+    ErrorL(file_name, line, "unknown annotation '@%s'", name);
+    return NULL;
+}
+
+static void checkAnnotations(struct Scanner* scanner, AstAnnotation* list,
+        bool loop)
+{
+    size_t n = sizeof(annotations) / sizeof(annotations[0]);
+    AST_FOREACH(AstAnnotation, annotation, list) {
+        for (size_t i = 0; i < n; ++i) {
+            if (annotations[i].tag == (int)annotation->tag &&
+                annotations[i].loop != loop)
+                ErrorL(ScannerGetFileName(scanner), annotation->line,
+                        "annotation '@%s' must be written before a %s",
+                        annotations[i].name, annotations[i].loop ? "while" :
+                            "function definition");
+        }
+    }
 }
 
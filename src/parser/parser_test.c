@@ -11,8 +11,10 @@
 
 int main()
 {
-    if (!yyparse())
-        printf("monga: parse succeeded\n");
+    Scanner* scanner = ScannerCreate(stdin, NULL, NULL);
+    ParserParse(scanner);
+    printf("monga: parse succeeded\n");
+    ScannerDestroy(scanner);
     return 0;
 }
 
@@ -3,25 +3,44 @@
  * Author: Gabriel de Quadros Ligneul
  *
  * scanner.h
- * Reads the stdin and converts it to tokens.
+ * Reads an input and converts it to tokens. Each scanner has its own state,
+ * so many inputs can be scanned at the same time.
  */
 
 #ifndef SCANNER_H
 #define SCANNER_H
 
-#include "util/vector.h"
+#include <stdio.h>
+
+#include "parser/parser.tab.h"
+#include "util/table.h"
+
+/* Scanner of an input */
+typedef struct Scanner Scanner;
+
+/* Creates a scanner that reads the input from its first line
+ * The file name is the one of the errors, NULL for the standard input.
+ * Identifiers and literal strings are kept in the pool, that must live as
+ * long as the trees. If the pool is NULL, the scanner creates its own. */
+Scanner* ScannerCreate(FILE* input, const char* file_name, TableRef pool);
+
+/* Destroys the scanner and its own pool */
+void ScannerDestroy(Scanner* scanner);
+
+/* Creates a pool of identifiers and literal strings */
+TableRef ScannerCreatePool();
+
+/* Reads the next token and its value, returns 0 at the end of the input */
+int ScannerNextToken(Scanner* scanner, YYSTYPE* value);
 
 /* Obtains the current line in scanner input */
-int ScannerGetCurrentLine();
+int ScannerGetCurrentLine(Scanner* scanner);
 
 /* Obtains the last token read */
-char* ScannerGetCurrentToken();
-
-/* Obtains the literals strings */
-Vector* ScannerGetStrings();
+char* ScannerGetCurrentToken(Scanner* scanner);
 
-/* Lex scanner prototype, returns the token read */
-int yylex();
+/* Obtains the name of the input file, NULL for the standard input */
+const char* ScannerGetFileName(Scanner* scanner);
 
 #endif
 
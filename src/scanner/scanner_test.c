@@ -12,15 +12,15 @@
 
 #include "parser/parser.h"
 
-YYSTYPE yylval;
-
 static const char* tokenToString(int token);
 
 int main()
 {
+    Scanner* scanner = ScannerCreate(stdin, NULL, NULL);
+    YYSTYPE yylval;
     int token;
     for (;;) {
-        token = yylex();
+        token = ScannerNextToken(scanner, &yylval);
         if (!token)
             break;
 
@@ -45,6 +45,7 @@ int main()
         }
         printf("\n");
     }
+    ScannerDestroy(scanner);
     return 0;
 }
 
@@ -66,6 +67,8 @@ static const char* tokenToString(int token)
     case TK_NULL:           return "TK_NULL";
     case TK_TRUE:           return "TK_TRUE";
     case TK_FALSE:          return "TK_FALSE";
+    case TK_EXTERN:         return "TK_EXTERN";
+    case TK_RESTRICT:       return "TK_RESTRICT";
     case TK_EQUALS:         return "TK_EQUALS";
     case TK_NOT_EQUALS:     return "TK_NOT_EQUALS";
     case TK_LESS_EQUALS:    return "TK_LESS_EQUALS";
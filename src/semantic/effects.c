@@ -0,0 +1,319 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * effects.c
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "effects.h"
+
+#include "util/table.h"
+#include "util/vector.h"
+
+/* State of the analysis, passed throughout the analyse functions */
+typedef struct EffectsState {
+    /* Function being analysed */
+    AstDeclaration* function;
+
+    /* True if some result has grown in the current pass */
+    bool changed;
+
+    /* Maps the functions to the vector of the functions they call
+     * It is only filled in the first pass, it is NULL in the others */
+    TableRef callees;
+} EffectsState;
+
+/* Returns true if the function is defined in the tree */
+static bool isDefinition(AstDeclaration* function);
+
+/* Returns true if the function may call itself, directly or by other
+ * functions. Functions of other files may call any function. */
+static bool mayRecurse(AstDeclaration* function, TableRef callees);
+
+/* Returns the parameter of the current function, if the expression is
+ * a reference to it, otherwise returns NULL */
+static AstDeclaration* getParameter(AstExpression* expression,
+        EffectsState* state);
+
+/* Adds the effect to the current function */
+static void addEffect(AstEffect effect, EffectsState* state);
+
+/* Marks the parameter as captured or written, a captured parameter may be
+ * written through its copies */
+static void markParameter(AstDeclaration* parameter, bool captured,
+        bool written, EffectsState* state);
+
+/* Analyses the statements */
+static void analyseStatements(AstStatement* statements, EffectsState* state);
+
+/* Analyses the expression, the parameters used as values are captured */
+static void analyseExpression(AstExpression* expression,
+        EffectsState* state);
+
+/* Analyses the location of an array access */
+static void analyseLocation(AstExpression* location, bool write,
+        EffectsState* state);
+
+/* Analyses the variable, write is true if it is assigned */
+static void analyseVariable(AstVariable* variable, bool write,
+        EffectsState* state);
+
+/* Analyses the call, the callee's results are propagated to the arguments */
+static void analyseCall(AstExpression* call, EffectsState* state);
+
+void EffectsAnalyseTree(AstDeclaration* tree)
+{
+    // The results start optimistic and only grow until nothing changes
+    TableRef callees = TableCreate(TableDummyDestroy,
+            (TableDestroyFunction)VectorDestroy, TableDummyCopy,
+            TableDummyCopy, TableDummyLess);
+    EffectsState state_data = {NULL, false, callees};
+    EffectsState* state = &state_data;
+    AST_FOREACH(AstDeclaration, function, tree) {
+        if (!isDefinition(function))
+            continue;
+        function->u.function_.effect = AST_EFFECT_NONE;
+        AST_FOREACH(AstDeclaration, parameter,
+                function->u.function_.parameters) {
+            parameter->u.variable_.captured = false;
+            parameter->u.variable_.written = false;
+        }
+        TableInsert(callees, function, VectorCreate());
+    }
+
+    do {
+        state->changed = false;
+        AST_FOREACH(AstDeclaration, function, tree) {
+            if (!isDefinition(function))
+                continue;
+            state->function = function;
+            analyseStatements(function->u.function_.block, state);
+        }
+        state->callees = NULL;
+    } while (state->changed);
+
+    AST_FOREACH(AstDeclaration, function, tree) {
+        if (isDefinition(function))
+            function->u.function_.recursive = mayRecurse(function, callees);
+    }
+    TableDestroy(callees);
+}
+
+static bool isDefinition(AstDeclaration* function)
+{
+    return function->tag == AST_DECLARATION_FUNCTION && !function->external;
+}
+
+static bool mayRecurse(AstDeclaration* function, TableRef callees)
+{
+    Vector* stack = VectorCreate();
+    TableRef visited = TableCreateDummy();
+    VectorPush(stack, function);
+    bool recurse = false;
+    while (!VectorEmpty(stack) && !recurse) {
+        AstDeclaration* caller = VectorPop(stack);
+        Vector* called = TableFind(callees, caller).data;
+        for (size_t i = 0; i < VectorSize(called) && !recurse; ++i) {
+            AstDeclaration* callee = VectorGet(called, i);
+            recurse = callee == function || !isDefinition(callee);
+            if (TableFind(visited, callee).key == NULL) {
+                TableInsert(visited, callee, callee);
+                VectorPush(stack, callee);
+            }
+        }
+    }
+    TableDestroy(visited);
+    VectorDestroy(stack);
+    return recurse;
+}
+
+static AstDeclaration* getParameter(AstExpression* expression,
+        EffectsState* state)
+{
+    if (expression->tag != AST_EXPRESSION_VARIABLE ||
+        expression->u.variable_->tag != AST_VARIABLE_REFERENCE)
+        return NULL;
+
+    // The parameters have the first slots of the function
+    AstDeclaration* declaration =
+            expression->u.variable_->u.reference_.u.declaration_;
+    if (declaration->u.variable_.global || declaration->u.variable_.offset >=
+            state->function->u.function_.n_parameters)
+        return NULL;
+    return declaration;
+}
+
+static void addEffect(AstEffect effect, EffectsState* state)
+{
+    if (effect > state->function->u.function_.effect) {
+        state->function->u.function_.effect = effect;
+        state->changed = true;
+    }
+}
+
+static void markParameter(AstDeclaration* parameter, bool captured,
+        bool written, EffectsState* state)
+{
+    if (captured && !parameter->u.variable_.captured) {
+        parameter->u.variable_.captured = true;
+        state->changed = true;
+    }
+    if ((captured || written) && !parameter->u.variable_.written) {
+        parameter->u.variable_.written = true;
+        state->changed = true;
+    }
+}
+
+static void analyseStatements(AstStatement* statements, EffectsState* state)
+{
+    AST_FOREACH(AstStatement, statement, statements) {
+        switch (statement->tag) {
+        case AST_STATEMENT_BLOCK:
+            analyseStatements(statement->u.block_.statements, state);
+            break;
+        case AST_STATEMENT_IF:
+            analyseExpression(statement->u.if_.expression, state);
+            analyseStatements(statement->u.if_.then_statement, state);
+            analyseStatements(statement->u.if_.else_statement, state);
+            break;
+        case AST_STATEMENT_WHILE:
+            analyseExpression(statement->u.while_.expression, state);
+            analyseStatements(statement->u.while_.statement, state);
+            break;
+        case AST_STATEMENT_ASSIGN:
+            analyseExpression(statement->u.assign_.expression, state);
+            analyseVariable(statement->u.assign_.variable, true, state);
+            break;
+        case AST_STATEMENT_DELETE:
+            addEffect(AST_EFFECT_WRITE, state);
+            analyseExpression(statement->u.delete_.expression, state);
+            break;
+        case AST_STATEMENT_PRINT:
+            // The output runtime only reads the strings
+            addEffect(AST_EFFECT_WRITE, state);
+            AST_FOREACH(AstExpression, expression,
+                    statement->u.print_.expressions) {
+                if (getParameter(expression, state) == NULL)
+                    analyseExpression(expression, state);
+            }
+            break;
+        case AST_STATEMENT_RETURN:
+            if (statement->u.return_.expression != NULL)
+                analyseExpression(statement->u.return_.expression, state);
+            break;
+        case AST_STATEMENT_CALL:
+            analyseCall(statement->u.call_, state);
+            break;
+        }
+    }
+}
+
+static void analyseExpression(AstExpression* expression,
+        EffectsState* state)
+{
+    switch (expression->tag) {
+    case AST_EXPRESSION_KBOOL:
+    case AST_EXPRESSION_KINT:
+    case AST_EXPRESSION_KFLOAT:
+    case AST_EXPRESSION_STRING:
+    case AST_EXPRESSION_NULL:
+        break;
+    case AST_EXPRESSION_CALL:
+        analyseCall(expression, state);
+        break;
+    case AST_EXPRESSION_VARIABLE: {
+        AstDeclaration* parameter = getParameter(expression, state);
+        if (parameter != NULL)
+            markParameter(parameter, true, true, state);
+        else
+            analyseVariable(expression->u.variable_, false, state);
+        break;
+    }
+    case AST_EXPRESSION_NEW:
+        addEffect(AST_EFFECT_WRITE, state);
+        analyseExpression(expression->u.new_.expression, state);
+        break;
+    case AST_EXPRESSION_UNARY:
+        analyseExpression(expression->u.unary_.expression, state);
+        break;
+    case AST_EXPRESSION_BINARY: {
+        // Comparing arrays doesn't capture them
+        AstBinaryOperator operator = expression->u.binary_.operator;
+        bool compare = operator == AST_OPERATOR_EQUALS ||
+                operator == AST_OPERATOR_NOT_EQUALS;
+        AstExpression* operands[] = {
+            expression->u.binary_.expression_left,
+            expression->u.binary_.expression_right
+        };
+        for (int i = 0; i < 2; ++i) {
+            if (!compare || getParameter(operands[i], state) == NULL)
+                analyseExpression(operands[i], state);
+        }
+        break;
+    }
+    case AST_EXPRESSION_CAST:
+        analyseExpression(expression->u.cast_.expression, state);
+        break;
+    }
+}
+
+static void analyseLocation(AstExpression* location, bool write,
+        EffectsState* state)
+{
+    AstDeclaration* parameter = getParameter(location, state);
+    if (parameter != NULL)
+        markParameter(parameter, false, write, state);
+    else
+        analyseExpression(location, state);
+}
+
+static void analyseVariable(AstVariable* variable, bool write,
+        EffectsState* state)
+{
+    switch (variable->tag) {
+    case AST_VARIABLE_REFERENCE: {
+        // Locals are values, not memory
+        AstDeclaration* declaration = variable->u.reference_.u.declaration_;
+        if (declaration->u.variable_.global)
+            addEffect(write ? AST_EFFECT_WRITE : AST_EFFECT_READ, state);
+        break;
+    }
+    case AST_VARIABLE_ARRAY:
+        addEffect(write ? AST_EFFECT_WRITE : AST_EFFECT_READ, state);
+        analyseLocation(variable->u.array_.location, write, state);
+        analyseExpression(variable->u.array_.offset, state);
+        break;
+    }
+}
+
+static void analyseCall(AstExpression* call, EffectsState* state)
+{
+    AstDeclaration* callee = call->u.call_.u.declaration_;
+    if (state->callees != NULL) {
+        Vector* called = TableFind(state->callees, state->function).data;
+        VectorPush(called, callee);
+    }
+
+    if (!isDefinition(callee)) {
+        addEffect(AST_EFFECT_WRITE, state);
+        AST_FOREACH(AstExpression, argument, call->u.call_.expressions)
+            analyseExpression(argument, state);
+        return;
+    }
+
+    addEffect(callee->u.function_.effect, state);
+    AstDeclaration* callee_parameter = callee->u.function_.parameters;
+    AST_FOREACH(AstExpression, argument, call->u.call_.expressions) {
+        AstDeclaration* parameter = getParameter(argument, state);
+        if (parameter != NULL)
+            markParameter(parameter, callee_parameter->u.variable_.captured,
+                    callee_parameter->u.variable_.written, state);
+        else
+            analyseExpression(argument, state);
+        callee_parameter = callee_parameter->next;
+    }
+}
+
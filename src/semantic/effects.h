@@ -0,0 +1,21 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * effects.h
+ * Effect analysis of the functions. Finds the memory effect of each
+ * function, if it may recurse, and which array parameters it may capture or
+ * write. Functions defined in other files are unknown, so they may do
+ * anything. The tree must be semantically analysed.
+ */
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include "ast/ast.h"
+
+/* Analyses the functions' effects and stores them in their declarations */
+void EffectsAnalyseTree(AstDeclaration* tree);
+
+#endif
+
@@ -0,0 +1,318 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * escape.c
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "escape.h"
+
+#include "util/new.h"
+#include "util/table.h"
+#include "util/vector.h"
+
+/* Arrays held by a local variable */
+typedef struct EscapeCandidate {
+    /* True if the variable may hold an array that outlives the function or
+     * that is allocated elsewhere */
+    bool escaped;
+
+    /* New expressions assigned to the variable */
+    Vector* news;
+
+    /* Delete statements of the variable */
+    Vector* deletes;
+} EscapeCandidate;
+
+/* State of the analysis, passed throughout the analyse functions */
+typedef struct EscapeState {
+    /* Function being analysed */
+    AstDeclaration* function;
+
+    /* Maps the local array variables to their candidates */
+    TableRef candidates;
+} EscapeState;
+
+/* Destroys the candidate, the nodes aren't destroyed */
+static void destroyCandidate(EscapeCandidate* candidate);
+
+/* Returns true if the function is defined in the tree */
+static bool isDefinition(AstDeclaration* function);
+
+/* Returns true if the expression is a new with a constant size that fits in
+ * the stack limit */
+static bool isStackable(AstExpression* expression);
+
+/* Returns the local array of the current function, if the variable is a
+ * reference to it, otherwise returns NULL */
+static AstDeclaration* getLocal(AstVariable* variable, EscapeState* state);
+
+/* Returns the local array if the expression is a reference to it */
+static AstDeclaration* getLocalReference(AstExpression* expression,
+        EscapeState* state);
+
+/* Returns the candidate of the local array, creating it if needed */
+static EscapeCandidate* getCandidate(AstDeclaration* local,
+        EscapeState* state);
+
+/* Marks the candidates that don't escape, their arrays go to the stack */
+static void markCandidates(EscapeState* state);
+
+/* Analyses the statements */
+static void analyseStatements(AstStatement* statements, EscapeState* state);
+
+/* Analyses the assignment, a local may only receive stackable arrays */
+static void analyseAssign(AstStatement* statement, EscapeState* state);
+
+/* Analyses the expression, the local arrays used as values escape */
+static void analyseExpression(AstExpression* expression, EscapeState* state);
+
+/* Analyses the location of an array access */
+static void analyseLocation(AstExpression* location, EscapeState* state);
+
+/* Analyses the call, the arguments escape if the callee may capture them */
+static void analyseCall(AstExpression* call, EscapeState* state);
+
+void EscapeAnalyseTree(AstDeclaration* tree)
+{
+    AST_FOREACH(AstDeclaration, function, tree) {
+        if (!isDefinition(function))
+            continue;
+        EscapeState state_data = {function, TableCreate(TableDummyDestroy,
+                (TableDestroyFunction)destroyCandidate, TableDummyCopy,
+                TableDummyCopy, TableDummyLess)};
+        EscapeState* state = &state_data;
+        analyseStatements(function->u.function_.block, state);
+        markCandidates(state);
+        TableDestroy(state->candidates);
+    }
+}
+
+static void destroyCandidate(EscapeCandidate* candidate)
+{
+    VectorDestroy(candidate->news);
+    VectorDestroy(candidate->deletes);
+    free(candidate);
+}
+
+static bool isDefinition(AstDeclaration* function)
+{
+    return function->tag == AST_DECLARATION_FUNCTION && !function->external;
+}
+
+static bool isStackable(AstExpression* expression)
+{
+    if (expression->tag != AST_EXPRESSION_NEW ||
+        expression->u.new_.expression->tag != AST_EXPRESSION_KINT)
+        return false;
+
+    // The negative sizes keep the error of the heap allocation
+    Type type = expression->u.new_.type;
+    int element_size = 4;
+    if (TypeIsArray(type))
+        element_size = 8;
+    else if (TypeIsChar(type) || TypeIsBool(type))
+        element_size = 1;
+    int size = expression->u.new_.expression->u.kint_;
+    return size >= 0 && size <= ESCAPE_STACK_LIMIT / element_size;
+}
+
+static AstDeclaration* getLocal(AstVariable* variable, EscapeState* state)
+{
+    if (variable->tag != AST_VARIABLE_REFERENCE)
+        return NULL;
+
+    // The parameters have the first slots of the function
+    AstDeclaration* declaration = variable->u.reference_.u.declaration_;
+    if (declaration->u.variable_.global || !TypeIsArray(declaration->type) ||
+        declaration->u.variable_.offset <
+            state->function->u.function_.n_parameters)
+        return NULL;
+    return declaration;
+}
+
+static AstDeclaration* getLocalReference(AstExpression* expression,
+        EscapeState* state)
+{
+    if (expression->tag != AST_EXPRESSION_VARIABLE)
+        return NULL;
+    return getLocal(expression->u.variable_, state);
+}
+
+static EscapeCandidate* getCandidate(AstDeclaration* local,
+        EscapeState* state)
+{
+    EscapeCandidate* candidate = TableFind(state->candidates, local).data;
+    if (candidate == NULL) {
+        candidate = NEW(EscapeCandidate);
+        candidate->escaped = false;
+        candidate->news = VectorCreate();
+        candidate->deletes = VectorCreate();
+        TableInsert(state->candidates, local, candidate);
+    }
+    return candidate;
+}
+
+static void markCandidates(EscapeState* state)
+{
+    int n = TableSize(state->candidates);
+    TablePair* pairs = TableToArray(state->candidates);
+    for (int i = 0; i < n; ++i) {
+        EscapeCandidate* candidate = pairs[i].data;
+        if (candidate->escaped)
+            continue;
+        for (size_t j = 0; j < VectorSize(candidate->news); ++j) {
+            AstExpression* expression = VectorGet(candidate->news, j);
+            expression->u.new_.stack = true;
+        }
+        for (size_t j = 0; j < VectorSize(candidate->deletes); ++j) {
+            AstStatement* statement = VectorGet(candidate->deletes, j);
+            statement->u.delete_.stack = true;
+        }
+    }
+    free(pairs);
+}
+
+static void analyseStatements(AstStatement* statements, EscapeState* state)
+{
+    AST_FOREACH(AstStatement, statement, statements) {
+        switch (statement->tag) {
+        case AST_STATEMENT_BLOCK:
+            analyseStatements(statement->u.block_.statements, state);
+            break;
+        case AST_STATEMENT_IF:
+            analyseExpression(statement->u.if_.expression, state);
+            analyseStatements(statement->u.if_.then_statement, state);
+            analyseStatements(statement->u.if_.else_statement, state);
+            break;
+        case AST_STATEMENT_WHILE:
+            analyseExpression(statement->u.while_.expression, state);
+            analyseStatements(statement->u.while_.statement, state);
+            break;
+        case AST_STATEMENT_ASSIGN:
+            analyseAssign(statement, state);
+            break;
+        case AST_STATEMENT_DELETE: {
+            AstExpression* expression = statement->u.delete_.expression;
+            AstDeclaration* local = getLocalReference(expression, state);
+            if (local != NULL)
+                VectorPush(getCandidate(local, state)->deletes, statement);
+            else
+                analyseExpression(expression, state);
+            break;
+        }
+        case AST_STATEMENT_PRINT:
+            // The output runtime only reads the strings
+            AST_FOREACH(AstExpression, expression,
+                    statement->u.print_.expressions) {
+                if (getLocalReference(expression, state) == NULL)
+                    analyseExpression(expression, state);
+            }
+            break;
+        case AST_STATEMENT_RETURN:
+            if (statement->u.return_.expression != NULL)
+                analyseExpression(statement->u.return_.expression, state);
+            break;
+        case AST_STATEMENT_CALL:
+            analyseCall(statement->u.call_, state);
+            break;
+        }
+    }
+}
+
+static void analyseAssign(AstStatement* statement, EscapeState* state)
+{
+    AstVariable* variable = statement->u.assign_.variable;
+    AstExpression* expression = statement->u.assign_.expression;
+    if (variable->tag == AST_VARIABLE_ARRAY) {
+        analyseLocation(variable->u.array_.location, state);
+        analyseExpression(variable->u.array_.offset, state);
+        analyseExpression(expression, state);
+        return;
+    }
+
+    // Any other array could be deleted through the local
+    AstDeclaration* local = getLocal(variable, state);
+    if (local == NULL) {
+        analyseExpression(expression, state);
+    } else if (isStackable(expression)) {
+        VectorPush(getCandidate(local, state)->news, expression);
+    } else if (expression->tag != AST_EXPRESSION_NULL) {
+        getCandidate(local, state)->escaped = true;
+        analyseExpression(expression, state);
+    }
+}
+
+static void analyseExpression(AstExpression* expression, EscapeState* state)
+{
+    switch (expression->tag) {
+    case AST_EXPRESSION_KBOOL:
+    case AST_EXPRESSION_KINT:
+    case AST_EXPRESSION_KFLOAT:
+    case AST_EXPRESSION_STRING:
+    case AST_EXPRESSION_NULL:
+        break;
+    case AST_EXPRESSION_CALL:
+        analyseCall(expression, state);
+        break;
+    case AST_EXPRESSION_VARIABLE: {
+        AstVariable* variable = expression->u.variable_;
+        AstDeclaration* local = getLocalReference(expression, state);
+        if (local != NULL) {
+            getCandidate(local, state)->escaped = true;
+        } else if (variable->tag == AST_VARIABLE_ARRAY) {
+            analyseLocation(variable->u.array_.location, state);
+            analyseExpression(variable->u.array_.offset, state);
+        }
+        break;
+    }
+    case AST_EXPRESSION_NEW:
+        analyseExpression(expression->u.new_.expression, state);
+        break;
+    case AST_EXPRESSION_UNARY:
+        analyseExpression(expression->u.unary_.expression, state);
+        break;
+    case AST_EXPRESSION_BINARY: {
+        // Comparing arrays doesn't capture them
+        AstBinaryOperator operator = expression->u.binary_.operator;
+        bool compare = operator == AST_OPERATOR_EQUALS ||
+                operator == AST_OPERATOR_NOT_EQUALS;
+        AstExpression* operands[] = {
+            expression->u.binary_.expression_left,
+            expression->u.binary_.expression_right
+        };
+        for (int i = 0; i < 2; ++i) {
+            if (!compare || getLocalReference(operands[i], state) == NULL)
+                analyseExpression(operands[i], state);
+        }
+        break;
+    }
+    case AST_EXPRESSION_CAST:
+        analyseExpression(expression->u.cast_.expression, state);
+        break;
+    }
+}
+
+static void analyseLocation(AstExpression* location, EscapeState* state)
+{
+    if (getLocalReference(location, state) == NULL)
+        analyseExpression(location, state);
+}
+
+static void analyseCall(AstExpression* call, EscapeState* state)
+{
+    // The tail calls can't access the caller's frame
+    AstDeclaration* callee = call->u.call_.u.declaration_;
+    bool known = isDefinition(callee) && !call->u.call_.tail;
+    AstDeclaration* callee_parameter = callee->u.function_.parameters;
+    AST_FOREACH(AstExpression, argument, call->u.call_.expressions) {
+        if (!known || callee_parameter->u.variable_.captured ||
+            getLocalReference(argument, state) == NULL)
+            analyseExpression(argument, state);
+        callee_parameter = callee_parameter->next;
+    }
+}
+
@@ -0,0 +1,26 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * escape.h
+ * Escape analysis of the local arrays. An array that is only assigned to a
+ * local variable, with a small constant size, and that isn't returned,
+ * stored, or passed to a function that may capture it, can be allocated in
+ * the function's frame, then deleting it does nothing. The tree must be
+ * analysed by the effects analysis.
+ */
+
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include "ast/ast.h"
+
+/* Maximum size of an array allocated in the function's frame, in bytes */
+#define ESCAPE_STACK_LIMIT 4096
+
+/* Marks the new expressions and the delete statements of the arrays that
+ * don't escape their functions */
+void EscapeAnalyseTree(AstDeclaration* tree);
+
+#endif
+
@@ -0,0 +1,536 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * fold.c
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "fold.h"
+
+/* Folds the list of statements, returns true if it returns
+ * The statements after a returned one are removed */
+static bool foldStatements(AstStatement* statements);
+
+/* Folds the statement, returns true if it returns */
+static bool foldStatement(AstStatement* statement);
+
+/* Replaces the if or while by the statement, or by an empty block if it is
+ * NULL. The position in the list is kept. */
+static void replaceStatement(AstStatement* statement,
+        AstStatement* replacement);
+
+/* Folds the expression and its subexpressions */
+static void foldExpression(AstExpression* expression);
+
+/* Folds the array access' expressions */
+static void foldVariable(AstVariable* variable);
+
+/* Folds the unary expression, the operand is already folded */
+static void foldUnary(AstExpression* expression);
+
+/* Folds the binary expression, the operands are already folded */
+static void foldBinary(AstExpression* expression);
+
+/* Folds the comparison of constants */
+static void foldComparison(AstExpression* expression);
+
+/* Simplifies the int expression with one constant operand */
+static void simplifyInt(AstExpression* expression);
+
+/* Simplifies the float expression with one constant operand, only the
+ * identities that hold for every value, signed zeros included */
+static void simplifyFloat(AstExpression* expression);
+
+/* Folds the cast of a constant */
+static void foldCast(AstExpression* expression);
+
+/* Returns true if the expression is a constant of the tag */
+static bool isConstant(AstExpression* expression, int tag);
+
+/* Returns true if the expression is the int constant */
+static bool isInt(AstExpression* expression, int value);
+
+/* Returns true if the expression is the float constant */
+static bool isFloat(AstExpression* expression, float value);
+
+/* Returns true if removing the expression doesn't change the program */
+static bool isRemovable(AstExpression* expression);
+
+/* Replaces the expression by a constant, the type and the position in the
+ * list are kept */
+static void replaceByBool(AstExpression* expression, bool value);
+static void replaceByInt(AstExpression* expression, int value);
+static void replaceByFloat(AstExpression* expression, float value);
+
+/* Replaces the expression by its operand, keeping the position in the list
+ * Nothing is done if the operand has other type */
+static void replaceByOperand(AstExpression* expression,
+        AstExpression* operand);
+
+void FoldTree(AstDeclaration* tree)
+{
+    AST_FOREACH(AstDeclaration, function, tree) {
+        if (function->tag == AST_DECLARATION_FUNCTION && !function->external)
+            foldStatement(function->u.function_.block);
+    }
+}
+
+static bool foldStatements(AstStatement* statements)
+{
+    AST_FOREACH(AstStatement, statement, statements) {
+        if (foldStatement(statement)) {
+            statement->next = NULL;
+            statements->last = statement;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool foldStatement(AstStatement* statement)
+{
+    if (statement == NULL)
+        return false;
+
+    switch (statement->tag) {
+    case AST_STATEMENT_BLOCK:
+        statement->returned = foldStatements(statement->u.block_.statements);
+        break;
+    case AST_STATEMENT_IF: {
+        AstExpression* expression = statement->u.if_.expression;
+        foldExpression(expression);
+        AstStatement* then_statement = statement->u.if_.then_statement;
+        AstStatement* else_statement = statement->u.if_.else_statement;
+        bool then_returned = foldStatements(then_statement);
+        bool else_returned = foldStatements(else_statement);
+        if (isConstant(expression, AST_EXPRESSION_KBOOL))
+            replaceStatement(statement, expression->u.kbool_ ?
+                    then_statement : else_statement);
+        else
+            statement->returned = then_returned && else_returned;
+        break;
+    }
+    case AST_STATEMENT_WHILE: {
+        AstExpression* expression = statement->u.while_.expression;
+        foldExpression(expression);
+        foldStatements(statement->u.while_.statement);
+        if (isConstant(expression, AST_EXPRESSION_KBOOL) &&
+            !expression->u.kbool_)
+            replaceStatement(statement, NULL);
+        break;
+    }
+    case AST_STATEMENT_ASSIGN:
+        foldVariable(statement->u.assign_.variable);
+        foldExpression(statement->u.assign_.expression);
+        break;
+    case AST_STATEMENT_DELETE:
+        foldExpression(statement->u.delete_.expression);
+        break;
+    case AST_STATEMENT_PRINT:
+        AST_FOREACH(AstExpression, expression, statement->u.print_.expressions)
+            foldExpression(expression);
+        break;
+    case AST_STATEMENT_RETURN:
+        if (statement->u.return_.expression != NULL)
+            foldExpression(statement->u.return_.expression);
+        break;
+    case AST_STATEMENT_CALL:
+        foldExpression(statement->u.call_);
+        break;
+    }
+
+    return statement->returned;
+}
+
+static void replaceStatement(AstStatement* statement,
+        AstStatement* replacement)
+{
+    AstStatement* next = statement->next;
+    AstStatement* last = statement->last;
+    if (replacement != NULL) {
+        *statement = *replacement;
+    } else {
+        statement->tag = AST_STATEMENT_BLOCK;
+        statement->returned = false;
+        statement->u.block_.variables = NULL;
+        statement->u.block_.statements = NULL;
+    }
+    statement->next = next;
+    statement->last = last;
+}
+
+static void foldExpression(AstExpression* expression)
+{
+    switch (expression->tag) {
+    case AST_EXPRESSION_KBOOL:
+    case AST_EXPRESSION_KINT:
+    case AST_EXPRESSION_KFLOAT:
+    case AST_EXPRESSION_STRING:
+    case AST_EXPRESSION_NULL:
+        break;
+    case AST_EXPRESSION_CALL:
+        AST_FOREACH(AstExpression, argument, expression->u.call_.expressions)
+            foldExpression(argument);
+        break;
+    case AST_EXPRESSION_VARIABLE:
+        foldVariable(expression->u.variable_);
+        break;
+    case AST_EXPRESSION_NEW:
+        foldExpression(expression->u.new_.expression);
+        break;
+    case AST_EXPRESSION_UNARY:
+        foldExpression(expression->u.unary_.expression);
+        foldUnary(expression);
+        break;
+    case AST_EXPRESSION_BINARY:
+        foldExpression(expression->u.binary_.expression_left);
+        foldExpression(expression->u.binary_.expression_right);
+        foldBinary(expression);
+        break;
+    case AST_EXPRESSION_CAST:
+        foldExpression(expression->u.cast_.expression);
+        foldCast(expression);
+        break;
+    }
+}
+
+static void foldVariable(AstVariable* variable)
+{
+    if (variable->tag == AST_VARIABLE_ARRAY) {
+        foldExpression(variable->u.array_.location);
+        foldExpression(variable->u.array_.offset);
+    }
+}
+
+static void foldUnary(AstExpression* expression)
+{
+    AstExpression* operand = expression->u.unary_.expression;
+    AstUnaryOperator operator = expression->u.unary_.operator;
+
+    // -(-x) and !(!x) are x
+    if (operand->tag == AST_EXPRESSION_UNARY &&
+        operand->u.unary_.operator == operator) {
+        replaceByOperand(expression, operand->u.unary_.expression);
+        return;
+    }
+
+    // The int negation wraps, its overflow is undefined in the IR
+    if (operator == AST_OPERATOR_NEGATE &&
+        isConstant(operand, AST_EXPRESSION_KINT))
+        replaceByInt(expression, (int)(0u - (unsigned)operand->u.kint_));
+    else if (operator == AST_OPERATOR_NEGATE &&
+             isConstant(operand, AST_EXPRESSION_KFLOAT))
+        replaceByFloat(expression, -operand->u.kfloat_);
+    else if (operator == AST_OPERATOR_NOT &&
+             isConstant(operand, AST_EXPRESSION_KBOOL))
+        replaceByBool(expression, !operand->u.kbool_);
+}
+
+static void foldBinary(AstExpression* expression)
+{
+    AstBinaryOperator operator = expression->u.binary_.operator;
+    AstExpression* left = expression->u.binary_.expression_left;
+    AstExpression* right = expression->u.binary_.expression_right;
+
+    // The right operand of the short circuit is only removed with the left
+    if (operator == AST_OPERATOR_AND || operator == AST_OPERATOR_OR) {
+        if (!isConstant(left, AST_EXPRESSION_KBOOL))
+            return;
+        if (left->u.kbool_ == (operator == AST_OPERATOR_OR))
+            replaceByBool(expression, left->u.kbool_);
+        else
+            replaceByOperand(expression, right);
+        return;
+    }
+
+    if (TypeIsBool(expression->type)) {
+        foldComparison(expression);
+    } else if (TypeIsInt(expression->type)) {
+        if (!isConstant(left, AST_EXPRESSION_KINT) ||
+            !isConstant(right, AST_EXPRESSION_KINT)) {
+            simplifyInt(expression);
+            return;
+        }
+
+        // Computes with the wrapping arithmetic, the division by zero and
+        // its overflow are left to the run time
+        unsigned a = (unsigned)left->u.kint_;
+        unsigned b = (unsigned)right->u.kint_;
+        switch (operator) {
+        case AST_OPERATOR_ADD:
+            replaceByInt(expression, (int)(a + b));
+            break;
+        case AST_OPERATOR_SUB:
+            replaceByInt(expression, (int)(a - b));
+            break;
+        case AST_OPERATOR_MUL:
+            replaceByInt(expression, (int)(a * b));
+            break;
+        case AST_OPERATOR_DIV:
+            if (right->u.kint_ != 0 &&
+                !(left->u.kint_ == INT_MIN && right->u.kint_ == -1))
+                replaceByInt(expression, left->u.kint_ / right->u.kint_);
+            break;
+        default:
+            break;
+        }
+    } else if (TypeIsFloat(expression->type)) {
+        if (!isConstant(left, AST_EXPRESSION_KFLOAT) ||
+            !isConstant(right, AST_EXPRESSION_KFLOAT)) {
+            simplifyFloat(expression);
+            return;
+        }
+
+        // The float arithmetic is the same of the IR's, IEEE single precision
+        float a = left->u.kfloat_;
+        float b = right->u.kfloat_;
+        switch (operator) {
+        case AST_OPERATOR_ADD:
+            replaceByFloat(expression, a + b);
+            break;
+        case AST_OPERATOR_SUB:
+            replaceByFloat(expression, a - b);
+            break;
+        case AST_OPERATOR_MUL:
+            replaceByFloat(expression, a * b);
+            break;
+        case AST_OPERATOR_DIV:
+            replaceByFloat(expression, a / b);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void foldComparison(AstExpression* expression)
+{
+    AstBinaryOperator operator = expression->u.binary_.operator;
+    AstExpression* left = expression->u.binary_.expression_left;
+    AstExpression* right = expression->u.binary_.expression_right;
+
+    // The float comparisons are ordered, like the IR's, so != is false
+    // if an operand is NaN
+    double a, b;
+    if (isConstant(left, AST_EXPRESSION_KINT) &&
+        isConstant(right, AST_EXPRESSION_KINT)) {
+        a = left->u.kint_;
+        b = right->u.kint_;
+    } else if (isConstant(left, AST_EXPRESSION_KFLOAT) &&
+               isConstant(right, AST_EXPRESSION_KFLOAT)) {
+        a = left->u.kfloat_;
+        b = right->u.kfloat_;
+    } else if (isConstant(left, AST_EXPRESSION_KBOOL) &&
+               isConstant(right, AST_EXPRESSION_KBOOL)) {
+        a = left->u.kbool_;
+        b = right->u.kbool_;
+    } else {
+        return;
+    }
+
+    switch (operator) {
+    case AST_OPERATOR_EQUALS:
+        replaceByBool(expression, a == b);
+        break;
+    case AST_OPERATOR_NOT_EQUALS:
+        replaceByBool(expression, a < b || a > b);
+        break;
+    case AST_OPERATOR_LESS:
+        replaceByBool(expression, a < b);
+        break;
+    case AST_OPERATOR_LESS_EQUALS:
+        replaceByBool(expression, a <= b);
+        break;
+    case AST_OPERATOR_GREATER:
+        replaceByBool(expression, a > b);
+        break;
+    case AST_OPERATOR_GREATER_EQUALS:
+        replaceByBool(expression, a >= b);
+        break;
+    default:
+        break;
+    }
+}
+
+static void simplifyInt(AstExpression* expression)
+{
+    AstBinaryOperator operator = expression->u.binary_.operator;
+    AstExpression* left = expression->u.binary_.expression_left;
+    AstExpression* right = expression->u.binary_.expression_right;
+
+    switch (operator) {
+    case AST_OPERATOR_ADD:
+        if (isInt(left, 0))
+            replaceByOperand(expression, right);
+        else if (isInt(right, 0))
+            replaceByOperand(expression, left);
+        break;
+    case AST_OPERATOR_SUB:
+        if (isInt(right, 0))
+            replaceByOperand(expression, left);
+        break;
+    case AST_OPERATOR_MUL:
+        if (isInt(left, 1))
+            replaceByOperand(expression, right);
+        else if (isInt(right, 1))
+            replaceByOperand(expression, left);
+        else if ((isInt(left, 0) && isRemovable(right)) ||
+                 (isInt(right, 0) && isRemovable(left)))
+            replaceByInt(expression, 0);
+        break;
+    case AST_OPERATOR_DIV:
+        if (isInt(right, 1))
+            replaceByOperand(expression, left);
+        break;
+    default:
+        break;
+    }
+    if (expression->tag != AST_EXPRESSION_BINARY ||
+        (operator != AST_OPERATOR_ADD && operator != AST_OPERATOR_SUB) ||
+        !isConstant(right, AST_EXPRESSION_KINT))
+        return;
+
+    // (x + c1) - c2 is x + (c1 - c2), if the new constant doesn't overflow,
+    // so the signed overflow stays undefined only where it was
+    AstExpression* inner = left;
+    if (inner->tag != AST_EXPRESSION_BINARY ||
+        (inner->u.binary_.operator != AST_OPERATOR_ADD &&
+         inner->u.binary_.operator != AST_OPERATOR_SUB) ||
+        !isConstant(inner->u.binary_.expression_right, AST_EXPRESSION_KINT))
+        return;
+
+    int64_t inner_constant = inner->u.binary_.expression_right->u.kint_;
+    if (inner->u.binary_.operator == AST_OPERATOR_SUB)
+        inner_constant = -inner_constant;
+    int64_t constant = right->u.kint_;
+    if (operator == AST_OPERATOR_SUB)
+        constant = -constant;
+    constant += inner_constant;
+    if (constant < INT_MIN || constant > INT_MAX)
+        return;
+
+    if (constant == 0) {
+        replaceByOperand(expression, inner->u.binary_.expression_left);
+    } else {
+        expression->u.binary_.operator = AST_OPERATOR_ADD;
+        expression->u.binary_.expression_left =
+                inner->u.binary_.expression_left;
+        replaceByInt(right, (int)constant);
+    }
+}
+
+static void simplifyFloat(AstExpression* expression)
+{
+    AstBinaryOperator operator = expression->u.binary_.operator;
+    AstExpression* left = expression->u.binary_.expression_left;
+    AstExpression* right = expression->u.binary_.expression_right;
+
+    // x + 0 isn't x if x is -0
+    switch (operator) {
+    case AST_OPERATOR_SUB:
+        if (isFloat(right, 0) && !signbit(right->u.kfloat_))
+            replaceByOperand(expression, left);
+        break;
+    case AST_OPERATOR_MUL:
+        if (isFloat(left, 1))
+            replaceByOperand(expression, right);
+        else if (isFloat(right, 1))
+            replaceByOperand(expression, left);
+        break;
+    case AST_OPERATOR_DIV:
+        if (isFloat(right, 1))
+            replaceByOperand(expression, left);
+        break;
+    default:
+        break;
+    }
+}
+
+static void foldCast(AstExpression* expression)
+{
+    AstExpression* operand = expression->u.cast_.expression;
+    switch (expression->u.cast_.tag) {
+    case AST_CAST_INT_TO_FLOAT:
+        if (isConstant(operand, AST_EXPRESSION_KINT))
+            replaceByFloat(expression, (float)operand->u.kint_);
+        break;
+    case AST_CAST_FLOAT_TO_INT: {
+        // The conversion of the floats out of the int range is undefined
+        if (!isConstant(operand, AST_EXPRESSION_KFLOAT))
+            break;
+        float value = operand->u.kfloat_;
+        if (value > -2147483904.0f && value < 2147483648.0f)
+            replaceByInt(expression, (int)value);
+        break;
+    }
+    }
+}
+
+static bool isConstant(AstExpression* expression, int tag)
+{
+    return (int)expression->tag == tag;
+}
+
+static bool isInt(AstExpression* expression, int value)
+{
+    return isConstant(expression, AST_EXPRESSION_KINT) &&
+           expression->u.kint_ == value;
+}
+
+static bool isFloat(AstExpression* expression, float value)
+{
+    return isConstant(expression, AST_EXPRESSION_KFLOAT) &&
+           expression->u.kfloat_ == value;
+}
+
+static bool isRemovable(AstExpression* expression)
+{
+    switch (expression->tag) {
+    case AST_EXPRESSION_KBOOL:
+    case AST_EXPRESSION_KINT:
+    case AST_EXPRESSION_KFLOAT:
+        return true;
+    case AST_EXPRESSION_VARIABLE:
+        return expression->u.variable_->tag == AST_VARIABLE_REFERENCE;
+    default:
+        return false;
+    }
+}
+
+static void replaceByBool(AstExpression* expression, bool value)
+{
+    expression->tag = AST_EXPRESSION_KBOOL;
+    expression->u.kbool_ = value;
+}
+
+static void replaceByInt(AstExpression* expression, int value)
+{
+    expression->tag = AST_EXPRESSION_KINT;
+    expression->u.kint_ = value;
+}
+
+static void replaceByFloat(AstExpression* expression, float value)
+{
+    expression->tag = AST_EXPRESSION_KFLOAT;
+    expression->u.kfloat_ = value;
+}
+
+static void replaceByOperand(AstExpression* expression,
+        AstExpression* operand)
+{
+    if (!TypeEquals(expression->type, operand->type))
+        return;
+
+    AstExpression* next = expression->next;
+    AstExpression* last = expression->last;
+    *expression = *operand;
+    expression->next = next;
+    expression->last = last;
+}
+
@@ -0,0 +1,20 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * fold.h
+ * Constant folding of the expressions, algebraic simplification and removal
+ * of the branches with constant conditions. The tree must be semantically
+ * analysed, the simplified expressions keep their types.
+ */
+
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast/ast.h"
+
+/* Simplifies the functions' bodies in place */
+void FoldTree(AstDeclaration* tree);
+
+#endif
+
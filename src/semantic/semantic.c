@@ -15,27 +15,64 @@
 #include "semantic/symbols.h"
 #include "util/error.h"
 
-/* Adds declarations to the symbol table */
-static void addDeclarationsToSymbolsTable(AstDeclaration* declarations);
+/* State of an analysis, passed throughout the analyse functions */
+typedef struct SemanticState {
+    /* Declarations visible in the current block */
+    Symbols* symbols;
+
+    /* Return type of current function */
+    Type return_type;
+
+    /* Current function, its parameters and locals receive dense slots */
+    AstDeclaration* function;
+
+    /* Name of the file of the errors, NULL for the standard input */
+    const char* file_name;
+} SemanticState;
+
+/* Adds the parameters or local variables to the symbol table and gives
+ * them the next slots of the current function */
+static void addDeclarationsToSymbolsTable(AstDeclaration* declarations,
+        SemanticState* state);
+
+/* Verifies that the restrict qualifier is only used with arrays */
+static void checkRestrict(AstDeclaration* declarations,
+        SemanticState* state);
 
 /* Analyse a function declaration */
-static void analyseFunction(AstDeclaration* declaration);
+static void analyseFunction(AstDeclaration* declaration, SemanticState* state);
 
 /* Analyse statements, check if all paths returned */
-static bool analyseStatement(AstStatement* statement);
-static bool analyseStatementBlock(AstStatement* statement);
-static bool analyseStatementIf(AstStatement* statement);
-static bool analyseStatementWhile(AstStatement* statement);
-static bool analyseStatementAssign(AstStatement* statement);
-static bool analyseStatementDelete(AstStatement* statement);
-static bool analyseStatementReturn(AstStatement* statement);
+static bool analyseStatement(AstStatement* statement, SemanticState* state);
+static bool analyseStatementBlock(AstStatement* statement,
+        SemanticState* state);
+static bool analyseStatementIf(AstStatement* statement, SemanticState* state);
+static bool analyseStatementWhile(AstStatement* statement,
+        SemanticState* state);
+static bool analyseStatementAssign(AstStatement* statement,
+        SemanticState* state);
+static bool analyseStatementDelete(AstStatement* statement,
+        SemanticState* state);
+static bool analyseStatementReturn(AstStatement* statement,
+        SemanticState* state);
+
+/* Returns true if the statement is a return without expression */
+static bool isEmptyReturn(AstStatement* statement);
+
+/* Marks the call as a tail call, the current function is tail recursive if
+ * it is the callee */
+static void markTailCall(AstExpression* call, SemanticState* state);
 
 /* Analyse expressions */
-static void analyseExpression(AstExpression* expression);
-static void analyseExpressionNew(AstExpression* expression);
-static void analyseExpressionCall(AstExpression* expression);
-static void analyseExpressionUnary(AstExpression* expression);
-static void analyseExpressionBinary(AstExpression* expression);
+static void analyseExpression(AstExpression* expression, SemanticState* state);
+static void analyseExpressionNew(AstExpression* expression,
+        SemanticState* state);
+static void analyseExpressionCall(AstExpression* expression,
+        SemanticState* state);
+static void analyseExpressionUnary(AstExpression* expression,
+        SemanticState* state);
+static void analyseExpressionBinary(AstExpression* expression,
+        SemanticState* state);
 
 /* Analyse specific binary expression, returns true if there is an error */
 static bool analyseExpressionArith(AstExpression* expression,
@@ -48,7 +85,7 @@ static bool analyseExpressionLogical(AstExpression* expression,
         AstExpression* left, AstExpression* right);
 
 /* Analyse a variable */
-static void analyseVariable(AstVariable* variable);
+static void analyseVariable(AstVariable* variable, SemanticState* state);
 
 /* Set the expression type if the expression is null and the type an array */
 static void setNullExpressionType(AstExpression* expression, Type type);
@@ -59,120 +96,160 @@ static void insertAssignmentCast(AstExpression* expression, Type variable);
 /* Add cast for float/int binary expressions, if necessary */
 static void insertNumericalCast(AstExpression* left, AstExpression* right);
 
-/* Return type of current function */
-static Type return_type = {TYPE_UNDEFINED, 0};
-
-AstDeclaration* SemanticAnalyseTree(AstDeclaration* ast)
+AstDeclaration* SemanticAnalyseTree(AstDeclaration* ast, const char* file_name)
 {
+    // Each file has its own global scope, other files are seen by extern
+    SemanticState state_data = {SymbolsCreate(file_name),
+            TypeCreate(TYPE_UNDEFINED, 0), NULL, file_name};
+    SemanticState* state = &state_data;
+    SymbolsOpenBlock(state->symbols);
     AST_FOREACH(AstDeclaration, declaration, ast) {
-        SymbolsAdd(declaration->identifier, declaration, declaration->line);
+        SymbolsAdd(state->symbols, declaration->identifier, declaration,
+                declaration->line);
         switch (declaration->tag) {
         case AST_DECLARATION_FUNCTION:
-            analyseFunction(declaration);
+            if (!declaration->external)
+                analyseFunction(declaration, state);
+            else
+                checkRestrict(declaration->u.function_.parameters, state);
             break;
         case AST_DECLARATION_VARIABLE:
+            if (declaration->type.restricted)
+                ErrorL(state->file_name, declaration->line,
+                        "global variable '%s' cannot be "
+                        "restrict", declaration->identifier);
             declaration->u.variable_.global = true;
             break;
         }
     }
+    SymbolsCloseBlock(state->symbols);
+    SymbolsDestroy(state->symbols);
 	return ast;
 }
 
-static void addDeclarationsToSymbolsTable(AstDeclaration* declarations)
+static void addDeclarationsToSymbolsTable(AstDeclaration* declarations,
+        SemanticState* state)
 {
+    checkRestrict(declarations, state);
     AST_FOREACH(AstDeclaration, declaration, declarations) {
-        SymbolsAdd(declaration->identifier, declaration, declaration->line);
+        SymbolsAdd(state->symbols, declaration->identifier, declaration,
+                declaration->line);
+        declaration->u.variable_.offset =
+                state->function->u.function_.space++;
     }
 }
 
-static void analyseFunction(AstDeclaration* function)
+static void checkRestrict(AstDeclaration* declarations,
+        SemanticState* state)
 {
-    SymbolsOpenBlock();
-    addDeclarationsToSymbolsTable(function->u.function_.parameters);
-    return_type = function->type;
+    AST_FOREACH(AstDeclaration, declaration, declarations) {
+        if (declaration->type.restricted && !TypeIsArray(declaration->type))
+            ErrorL(state->file_name, declaration->line,
+                    "restrict variable '%s' must be an "
+                    "array", declaration->identifier);
+    }
+}
+
+static void analyseFunction(AstDeclaration* function, SemanticState* state)
+{
+    SymbolsOpenBlock(state->symbols);
+    state->function = function;
+    function->u.function_.space = 0;
+    addDeclarationsToSymbolsTable(function->u.function_.parameters, state);
+    state->return_type = function->type;
     AstStatement* block = function->u.function_.block;
     AstDeclaration* variables = block->u.block_.variables;
     AstStatement* statements = block->u.block_.statements;
-    addDeclarationsToSymbolsTable(variables);
-    bool returned = analyseStatement(statements);
-    SymbolsCloseBlock();
+    addDeclarationsToSymbolsTable(variables, state);
+    bool returned = analyseStatement(statements, state);
+    SymbolsCloseBlock(state->symbols);
 
     if (!returned) {
-        if (TypeIsVoid(return_type)) {
+        if (TypeIsVoid(state->return_type)) {
+            AstStatement* last = statements != NULL ? statements->last : NULL;
             AST_CONCAT(statements, AstStatementReturn(NULL, -1));
+            if (last != NULL && last->tag == AST_STATEMENT_CALL)
+                markTailCall(last->u.call_, state);
         } else {
-            ErrorL(function->line, "there are branches of the function that "
+            ErrorL(state->file_name, function->line,
+                    "there are branches of the function that "
                     "don't return");
         }
     }
 }
 
-static bool analyseStatement(AstStatement* statement)
+static bool analyseStatement(AstStatement* statement, SemanticState* state)
 {
     if (statement == NULL)
         return false;
 
     switch (statement->tag) {
     case AST_STATEMENT_BLOCK:
-        analyseStatementBlock(statement);
+        analyseStatementBlock(statement, state);
         break;
     case AST_STATEMENT_IF:
-        analyseStatementIf(statement);
+        analyseStatementIf(statement, state);
         break;
     case AST_STATEMENT_WHILE:
-        analyseStatementWhile(statement);
+        analyseStatementWhile(statement, state);
         break;
     case AST_STATEMENT_ASSIGN:
-        analyseStatementAssign(statement);
+        analyseStatementAssign(statement, state);
         break;
     case AST_STATEMENT_DELETE:
-        analyseStatementDelete(statement);
+        analyseStatementDelete(statement, state);
         break;
     case AST_STATEMENT_PRINT:
-        analyseExpression(statement->u.print_.expressions);
+        analyseExpression(statement->u.print_.expressions, state);
         break;
     case AST_STATEMENT_RETURN:
-        analyseStatementReturn(statement);
+        analyseStatementReturn(statement, state);
         break;
     case AST_STATEMENT_CALL:
-        analyseExpression(statement->u.call_);
+        analyseExpression(statement->u.call_, state);
         break;
     }
 
     if (statement->returned) {
         if (statement->next != NULL)
-            ErrorL(statement->next->line, "unexpected statement after return");
+            ErrorL(state->file_name, statement->next->line,
+                    "unexpected statement after return");
         return true;
     }
 
-    return analyseStatement(statement->next);
+    // The call followed by an empty return is also in a tail position
+    if (statement->tag == AST_STATEMENT_CALL && isEmptyReturn(statement->next))
+        markTailCall(statement->u.call_, state);
+
+    return analyseStatement(statement->next, state);
 }
 
-static bool analyseStatementBlock(AstStatement* statement)
+static bool analyseStatementBlock(AstStatement* statement, SemanticState* state)
 {
-    SymbolsOpenBlock();
-    addDeclarationsToSymbolsTable(statement->u.block_.variables);
+    SymbolsOpenBlock(state->symbols);
+    addDeclarationsToSymbolsTable(statement->u.block_.variables, state);
     AstStatement* substatement = statement->u.block_.statements;
-    bool returned = analyseStatement(substatement);
-    SymbolsCloseBlock();
+    bool returned = analyseStatement(substatement, state);
+    SymbolsCloseBlock(state->symbols);
 
     statement->returned = returned;
     return returned;
 }
 
-static bool analyseStatementIf(AstStatement* statement)
+static bool analyseStatementIf(AstStatement* statement, SemanticState* state)
 {
     AstExpression* expression = statement->u.if_.expression;
-    analyseExpression(expression);
+    analyseExpression(expression, state);
 
     AstStatement* then_statement = statement->u.if_.then_statement;
-    bool then_returned = analyseStatement(then_statement);
+    bool then_returned = analyseStatement(then_statement, state);
 
     AstStatement* else_statement = statement->u.if_.else_statement;
-    bool else_returned = analyseStatement(else_statement);
+    bool else_returned = analyseStatement(else_statement, state);
 
     if (!TypeIsBool(expression->type)) {
-        ErrorL(statement->line, "mismatch type in if's expression, expected 'bool', "
+        ErrorL(state->file_name, statement->line,
+                "mismatch type in if's expression, expected 'bool', "
                 "read '%s'", TypeToString(expression->type));
     }
 
@@ -181,79 +258,104 @@ static bool analyseStatementIf(AstStatement* statement)
     return returned;
 }
 
-static bool analyseStatementWhile(AstStatement* statement)
+static bool analyseStatementWhile(AstStatement* statement, SemanticState* state)
 {
     AstExpression* expression = statement->u.while_.expression;
-    analyseExpression(expression);
+    analyseExpression(expression, state);
 
     AstStatement* substatement = statement->u.while_.statement;
-    analyseStatement(substatement);
+    analyseStatement(substatement, state);
 
     if (!TypeIsBool(expression->type)) {
-        ErrorL(statement->line, "mismatch type in while's expression, expected "
+        ErrorL(state->file_name, statement->line,
+                "mismatch type in while's expression, expected "
                 "'bool', read '%s'", TypeToString(expression->type));
     }
 
     return false;
 }
 
-static bool analyseStatementAssign(AstStatement* statement)
+static bool analyseStatementAssign(AstStatement* statement,
+        SemanticState* state)
 {
     AstVariable* variable = statement->u.assign_.variable;
-    analyseVariable(variable);
+    analyseVariable(variable, state);
 
     AstExpression* expression = statement->u.assign_.expression;
     setNullExpressionType(expression, variable->type);
-    analyseExpression(expression);
+    analyseExpression(expression, state);
 
     if (TypeIsAssignable(variable->type, expression->type)) {
         insertAssignmentCast(expression, variable->type);
     } else {
-        ErrorL(statement->line, "mismatch type in '%s = %s' assignment",
+        ErrorL(state->file_name, statement->line,
+                "mismatch type in '%s = %s' assignment",
                 TypeToString(variable->type), TypeToString(expression->type));
     }
 
     return false;
 }
 
-static bool analyseStatementDelete(AstStatement* statement)
+static bool analyseStatementDelete(AstStatement* statement,
+        SemanticState* state)
 {
     AstExpression* expression = statement->u.delete_.expression;
-    analyseExpression(expression);
+    analyseExpression(expression, state);
     if (!TypeIsArray(expression->type)) {
-        ErrorL(statement->line, "mismatch type in delete's expression, "
+        ErrorL(state->file_name, statement->line,
+                "mismatch type in delete's expression, "
                 "expected an array, read '%s'", TypeToString(expression->type));
     }
     return false;
 }
 
-static bool analyseStatementReturn(AstStatement* statement)
+static bool analyseStatementReturn(AstStatement* statement,
+        SemanticState* state)
 {
     AstExpression* expression = statement->u.return_.expression;
-    analyseExpression(expression);
+    analyseExpression(expression, state);
 
     const char* wrong_type = NULL;
     if (expression == NULL) {
-        if (!TypeIsVoid(return_type))
+        if (!TypeIsVoid(state->return_type))
             wrong_type = "void";
     } else {
-        setNullExpressionType(expression, return_type);
-        if (TypeIsAssignable(return_type, expression->type))
-            insertAssignmentCast(expression, return_type);
+        setNullExpressionType(expression, state->return_type);
+        if (TypeIsAssignable(state->return_type, expression->type))
+            insertAssignmentCast(expression, state->return_type);
         else
             wrong_type = TypeToString(expression->type);
     }
 
     if (wrong_type != NULL) {
-        ErrorL(statement->line, "mismatch type in return's expression, expected "
-                "'%s', read '%s'", TypeToString(return_type), wrong_type);
+        ErrorL(state->file_name, statement->line,
+                "mismatch type in return's expression, expected "
+                "'%s', read '%s'", TypeToString(state->return_type),
+                wrong_type);
     }
 
+    // The casted calls aren't in a tail position
+    if (expression != NULL && expression->tag == AST_EXPRESSION_CALL)
+        markTailCall(expression, state);
+
     statement->returned = true;
     return true;
 }
 
-static void analyseExpression(AstExpression* expression)
+static bool isEmptyReturn(AstStatement* statement)
+{
+    return statement != NULL && statement->tag == AST_STATEMENT_RETURN &&
+           statement->u.return_.expression == NULL;
+}
+
+static void markTailCall(AstExpression* call, SemanticState* state)
+{
+    call->u.call_.tail = true;
+    if (call->u.call_.u.declaration_ == state->function)
+        state->function->u.function_.tail_recursive = true;
+}
+
+static void analyseExpression(AstExpression* expression, SemanticState* state)
 {
     if (!expression) return;
 
@@ -274,22 +376,22 @@ static void analyseExpression(AstExpression* expression)
         expression->type = TypeCreate(TYPE_BOOL, 0);
         break;
     case AST_EXPRESSION_CALL:
-        analyseExpressionCall(expression);
+        analyseExpressionCall(expression, state);
         break;
     case AST_EXPRESSION_VARIABLE:
-        analyseVariable(expression->u.variable_);
+        analyseVariable(expression->u.variable_, state);
         expression->type = expression->u.variable_->type;
         if (TypeIsChar(expression->type))
             expression->type = TypeCreate(TYPE_INT, 0);
         break;
     case AST_EXPRESSION_NEW:
-        analyseExpressionNew(expression);
+        analyseExpressionNew(expression, state);
         break;
     case AST_EXPRESSION_UNARY:
-        analyseExpressionUnary(expression);
+        analyseExpressionUnary(expression, state);
         break;
     case AST_EXPRESSION_BINARY:
-        analyseExpressionBinary(expression);
+        analyseExpressionBinary(expression, state);
         break;
     case AST_EXPRESSION_CAST:
         // Unexpected case since cast will be added at this phase
@@ -297,39 +399,45 @@ static void analyseExpression(AstExpression* expression)
         break;
     }
 
-    analyseExpression(expression->next);
+    analyseExpression(expression->next, state);
 }
 
-static void analyseExpressionNew(AstExpression* expression)
+static void analyseExpressionNew(AstExpression* expression,
+        SemanticState* state)
 {
     Type array_type = expression->u.new_.type;
     AstExpression* array_size = expression->u.new_.expression;
-    analyseExpression(array_size);
+    analyseExpression(array_size, state);
     if (!TypeIsInt(array_size->type)) {
-        ErrorL(expression->line, "mismatch type in new expression, expected 'int', "
+        ErrorL(state->file_name, expression->line,
+                "mismatch type in new expression, expected 'int', "
                 "read '%s'", TypeToString(array_size->type));
     }
     expression->type = TypeCreate(array_type.tag, array_type.pointers + 1);
 }
 
-static void analyseExpressionCall(AstExpression* expression)
+static void analyseExpressionCall(AstExpression* expression,
+        SemanticState* state)
 {
     char* identifier = expression->u.call_.u.identifier_;
-    AstDeclaration* declaration = SymbolsFind(identifier, expression->line);
+    AstDeclaration* declaration = SymbolsFind(state->symbols, identifier,
+            expression->line);
     if (declaration->tag != AST_DECLARATION_FUNCTION) {
-        ErrorL(expression->line, "cannot call non-function symbol '%s'", 
+        ErrorL(state->file_name, expression->line,
+                "cannot call non-function symbol '%s'",
                 identifier);
     }
 
     AstDeclaration* declaration_parameter = declaration->u.function_.parameters;
     AstExpression* call_parameter = expression->u.call_.expressions;
-    analyseExpression(call_parameter);
+    analyseExpression(call_parameter, state);
     while (declaration_parameter != NULL && call_parameter != NULL) {
         Type declaration_type = declaration_parameter->type;
         setNullExpressionType(call_parameter, declaration_type);
         Type call_type = call_parameter->type;
         if (!TypeIsAssignable(declaration_type, call_type)) {
-            ErrorL(expression->line, "mismatch type in parameter of '%s' "
+            ErrorL(state->file_name, expression->line,
+                    "mismatch type in parameter of '%s' "
                     "function call, cannot assign '%s' to '%s'", identifier,
                     TypeToString(call_type), TypeToString(declaration_type));
         }
@@ -338,7 +446,8 @@ static void analyseExpressionCall(AstExpression* expression)
         call_parameter = call_parameter->next;
     }
     if (declaration_parameter != NULL || call_parameter != NULL) {
-        ErrorL(expression->line, "mismatch number of parameters in '%s' "
+        ErrorL(state->file_name, expression->line,
+                "mismatch number of parameters in '%s' "
                 "function call", identifier);
     }
 
@@ -349,10 +458,11 @@ static void analyseExpressionCall(AstExpression* expression)
     expression->u.call_.u.declaration_ = declaration;
 }
 
-static void analyseExpressionUnary(AstExpression* expression)
+static void analyseExpressionUnary(AstExpression* expression,
+        SemanticState* state)
 {
     AstExpression* subexpression = expression->u.unary_.expression;
-    analyseExpression(subexpression);
+    analyseExpression(subexpression, state);
     expression->type = subexpression->type;
 
     AstUnaryOperator operator = expression->u.unary_.operator;
@@ -369,18 +479,20 @@ static void analyseExpressionUnary(AstExpression* expression)
     }
 
     if (expected != NULL) {
-        ErrorL(expression->line, "mismatch type in '%s' unary operation, "
+        ErrorL(state->file_name, expression->line,
+                "mismatch type in '%s' unary operation, "
                 "expected '%s', read '%s'", AstPrintUnaryOperator(operator),
                 expected, TypeToString(subexpression->type));
     }
 }
 
-static void analyseExpressionBinary(AstExpression* expression)
+static void analyseExpressionBinary(AstExpression* expression,
+        SemanticState* state)
 {
     AstExpression* left = expression->u.binary_.expression_left;
-    analyseExpression(left);
+    analyseExpression(left, state);
     AstExpression* right = expression->u.binary_.expression_right;
-    analyseExpression(right);
+    analyseExpression(right, state);
 
     AstBinaryOperator operator = expression->u.binary_.operator;
     bool type_error = false;
@@ -408,7 +520,8 @@ static void analyseExpressionBinary(AstExpression* expression)
     }
 
     if (type_error) {
-        ErrorL(expression->line, "mismatch type in '%s %s %s' binary operation",
+        ErrorL(state->file_name, expression->line,
+                "mismatch type in '%s %s %s' binary operation",
                 TypeToString(left->type), AstPrintBinaryOperator(operator),
                 TypeToString(right->type));
     }
@@ -465,33 +578,39 @@ static bool analyseExpressionLogical(AstExpression* expression,
     return error;
 }
 
-static void analyseVariable(AstVariable* variable)
+static void analyseVariable(AstVariable* variable, SemanticState* state)
 {
     switch (variable->tag) {
     case AST_VARIABLE_REFERENCE: {
         char* identifier = variable->u.reference_.u.identifier_;
-        AstDeclaration* declaration = SymbolsFind(identifier, variable->line);
+        AstDeclaration* declaration = SymbolsFind(state->symbols, identifier,
+                variable->line);
         if (declaration->tag != AST_DECLARATION_VARIABLE) {
-            ErrorL(variable->line, "cannot access '%s' function's value",
+            ErrorL(state->file_name, variable->line,
+                    "cannot access '%s' function's value",
                     identifier);
         }
-        variable->type = declaration->type;
+        // The qualifiers belong to the declaration, not to its value
+        variable->type = TypeCreate(declaration->type.tag,
+                declaration->type.pointers);
         variable->u.reference_.u.declaration_ = declaration;
         variable->u.reference_.is_declaration = true;
         break;
     }
     case AST_VARIABLE_ARRAY: {
         AstExpression* location = variable->u.array_.location;
-        analyseExpression(location);
+        analyseExpression(location, state);
         if (!TypeIsArray(location->type)) {
-            ErrorL(variable->line, "mismatch type in left expression of "
+            ErrorL(state->file_name, variable->line,
+                    "mismatch type in left expression of "
                     "access, expected an array, read '%s'",
                     TypeToString(location->type));
         }
         AstExpression* offset = variable->u.array_.offset;
-        analyseExpression(offset);
+        analyseExpression(offset, state);
         if (!TypeIsInt(offset->type)) {
-            ErrorL(variable->line, "mismatch type in right expression of "
+            ErrorL(state->file_name, variable->line,
+                    "mismatch type in right expression of "
                     "access, expected 'int', read '%s'",
                     TypeToString(offset->type));
         }
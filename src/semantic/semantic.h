@@ -10,8 +10,9 @@
 
 #include "ast/ast.h"
 
-/* Makes the semantic analysis in the AST */
-AstDeclaration* SemanticAnalyseTree(AstDeclaration* ast);
+/* Makes the semantic analysis in the AST, the errors are reported at the file
+ * name (NULL for the standard input) */
+AstDeclaration* SemanticAnalyseTree(AstDeclaration* ast, const char* file_name);
 
 #endif
 
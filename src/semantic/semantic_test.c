@@ -11,10 +11,11 @@
 
 int main()
 {
-    if (!yyparse()) {
-        SemanticAnalyseTree(parser_ast);
-        AstPrintTree(parser_ast);
-    }
+    Scanner* scanner = ScannerCreate(stdin, NULL, NULL);
+    AstDeclaration* tree = ParserParse(scanner);
+    SemanticAnalyseTree(tree, NULL);
+    AstPrintTree(tree);
+    ScannerDestroy(scanner);
     return 0;
 }
 
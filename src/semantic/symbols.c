@@ -6,6 +6,7 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 
 #include "symbols.h"
 
@@ -18,65 +19,79 @@ typedef struct {
     AstDeclaration* declaration;
 } Symbol;
 
-Vector* symbols = NULL;
-Vector* blocks = NULL;
+struct Symbols {
+    Vector* symbols;
+    Vector* blocks;
+    const char* file_name;
+};
 
-static void init();
+Symbols* SymbolsCreate(const char* file_name)
+{
+    Symbols* table = NEW(Symbols);
+    table->symbols = VectorCreate();
+    table->blocks = VectorCreate();
+    table->file_name = file_name;
+    return table;
+}
+
+void SymbolsDestroy(Symbols* table)
+{
+    while (!VectorEmpty(table->symbols))
+        free(VectorPop(table->symbols));
+    VectorDestroy(table->symbols);
+    VectorDestroy(table->blocks);
+    free(table);
+}
 
-void SymbolsAdd(char* identifier, AstDeclaration* declaration, int line)
+void SymbolsAdd(Symbols* table, char* identifier, AstDeclaration* declaration,
+        int line)
 {
     int current = 0;
     int last = 0;
     Symbol* new_symbol = NULL;
 
-    if (!symbols)
-        init();
-
     /* Verifies if this declaration shadows a symbol in the current block */
-    if (!VectorEmpty(blocks))
-        last = (int)(intptr_t)VectorPeek(blocks);
-    for (current = VectorSize(symbols) - 1; current >= last; current--) {
-        Symbol* symbol = (Symbol*)VectorGet(symbols, current);
+    if (!VectorEmpty(table->blocks))
+        last = (int)(intptr_t)VectorPeek(table->blocks);
+    current = VectorSize(table->symbols) - 1;
+    for (; current >= last; current--) {
+        Symbol* symbol = (Symbol*)VectorGet(table->symbols, current);
         if (symbol->identifier == identifier)
-            ErrorL(line, "symbol '%s' is already declared", identifier);
+            ErrorL(table->file_name, line, "symbol '%s' is already declared",
+                    identifier);
     }
 
     /* Inserts the the symbol */
     new_symbol = NEW(Symbol);
     new_symbol->identifier = identifier;
     new_symbol->declaration = declaration;
-    VectorPush(symbols, new_symbol);
+    VectorPush(table->symbols, new_symbol);
 }
 
-AstDeclaration* SymbolsFind(char* identifier, int line)
+AstDeclaration* SymbolsFind(Symbols* table, char* identifier, int line)
 {
-    int current = VectorSize(symbols) - 1;
+    int current = VectorSize(table->symbols) - 1;
     for (; current >= 0; current--) {
-        Symbol* symbol = (Symbol*)VectorGet(symbols, current);
+        Symbol* symbol = (Symbol*)VectorGet(table->symbols, current);
         if (symbol->identifier == identifier)
             return symbol->declaration;
     }
-    ErrorL(line, "symbol '%s' is not declared", identifier);
+    ErrorL(table->file_name, line, "symbol '%s' is not declared",
+            identifier);
     return NULL;
 }
 
-void SymbolsOpenBlock()
+void SymbolsOpenBlock(Symbols* table)
 {
-    int next_block = VectorSize(symbols);
-    VectorPush(blocks, (void*)(intptr_t)next_block);
+    int next_block = VectorSize(table->symbols);
+    VectorPush(table->blocks, (void*)(intptr_t)next_block);
 }
 
-void SymbolsCloseBlock()
+void SymbolsCloseBlock(Symbols* table)
 {
     int current = 0;
-    int last = (int)(intptr_t)VectorPop(blocks);
-    for (current = VectorSize(symbols) - 1; current >= last; current--)
-        VectorPop(symbols);
-}
-
-static void init()
-{
-    symbols = VectorCreate();
-    blocks = VectorCreate();
+    int last = (int)(intptr_t)VectorPop(table->blocks);
+    for (current = VectorSize(table->symbols) - 1; current >= last; current--)
+        free(VectorPop(table->symbols));
 }
 
@@ -13,17 +13,28 @@
 
 #include "ast/ast.h"
 
+/* Table of symbols, each analysis has its own */
+typedef struct Symbols Symbols;
+
+/* Creates an empty table, its errors are reported at the file name (NULL for
+ * the standard input) */
+Symbols* SymbolsCreate(const char* file_name);
+
+/* Destroys the table, the declarations aren't destroyed */
+void SymbolsDestroy(Symbols* table);
+
 /* Adds a symbol to the table */
-void SymbolsAdd(char* identifier, AstDeclaration* declaration, int line);
+void SymbolsAdd(Symbols* table, char* identifier, AstDeclaration* declaration,
+        int line);
 
 /* Retrieves a symbol from the table */
-AstDeclaration* SymbolsFind(char* indentifer, int line);
+AstDeclaration* SymbolsFind(Symbols* table, char* indentifer, int line);
 
 /* Opens a block */
-void SymbolsOpenBlock();
+void SymbolsOpenBlock(Symbols* table);
 
 /* Closes a block */
-void SymbolsCloseBlock();
+void SymbolsCloseBlock(Symbols* table);
 
 #endif
 
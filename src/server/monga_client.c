@@ -0,0 +1,26 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * monga_client.c
+ * Client of the compile server. It doesn't link LLVM, so it starts much
+ * faster than the compiler.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "server/server.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage:\n    monga_client <socket> [options] "
+                "< [input]\n");
+        return 1;
+    }
+
+    // The remaining arguments are the compiler's options
+    return ServerRunClient(argv[1], argc - 2, argv + 2, stdin);
+}
+
@@ -0,0 +1,387 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * server.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "server.h"
+
+#include "util/error.h"
+#include "util/new.h"
+#include "util/timer.h"
+#include "util/vector.h"
+
+/* Max size of a frame's data, bigger sources are sent in many frames */
+#define SERVER_MAX_FRAME (1 << 20)
+
+/* Max number of pending connections */
+#define SERVER_BACKLOG 64
+
+/* Request received by the connection process */
+typedef struct ServerRequest {
+    Vector* arguments;
+    char* source;
+    size_t source_size;
+} ServerRequest;
+
+/* Socket path, removed when the server is killed */
+static const char* server_socket_path = NULL;
+
+/* Creates the address of the socket */
+static void createAddress(const char* socket_path, struct sockaddr_un* address);
+
+/* Removes the socket and exits, called by SIGINT and SIGTERM */
+static void stopServer(int signal_number);
+
+/* Receives a request, runs it and sends the answer, in its own process */
+static void handleConnection(int connection, ServerHandler handler,
+        long request_id);
+
+/* Receives the frames until the run frame, returns false if it fails */
+static bool readRequest(int connection, ServerRequest* request);
+
+/* Runs the handler with stdout and stderr redirected to the pipes */
+static void runWorker(ServerRequest* request, ServerHandler handler,
+        int output[2], int errors[2]);
+
+/* Sends the worker's output to the client until both pipes are closed */
+static void forwardOutput(int connection, int output, int errors);
+
+/* Writes a frame, returns false if the connection is closed */
+static bool writeFrame(int fd, char type, const void* data, uint32_t size);
+
+/* Reads a frame, the data must be freed by the caller
+ * Returns false if the connection is closed */
+static bool readFrame(int fd, char* type, char** data, uint32_t* size);
+
+/* Writes/reads exactly size bytes, returns false if it fails */
+static bool writeAll(int fd, const void* data, size_t size);
+static bool readAll(int fd, void* data, size_t size);
+
+void ServerRun(const char* socket_path, ServerHandler handler)
+{
+    struct sockaddr_un address;
+    createAddress(socket_path, &address);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
+        Error("unable to create the server socket");
+
+    // A socket left by a killed server would make bind fail
+    unlink(socket_path);
+    if (bind(server, (struct sockaddr*)&address, sizeof(address)) != 0)
+        Error("unable to bind the server socket '%s'", socket_path);
+    if (listen(server, SERVER_BACKLOG) != 0)
+        Error("unable to listen at '%s'", socket_path);
+
+    server_socket_path = socket_path;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+
+    // Connection processes are reaped by the system
+    signal(SIGCHLD, SIG_IGN);
+
+    fprintf(stderr, "monga: server listening at %s\n", socket_path);
+    for (long request_id = 1;; ++request_id) {
+        int connection = accept(server, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR)
+                continue;
+            Error("unable to accept a connection");
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(server);
+            handleConnection(connection, handler, request_id);
+            exit(0);
+        }
+        if (pid < 0)
+            fprintf(stderr, "monga: unable to fork request %ld\n", request_id);
+        close(connection);
+    }
+}
+
+int ServerRunClient(const char* socket_path, int argc, char* argv[],
+        FILE* input)
+{
+    struct sockaddr_un address;
+    createAddress(socket_path, &address);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0)
+        Error("unable to create the client socket");
+    if (connect(connection, (struct sockaddr*)&address, sizeof(address)) != 0)
+        Error("unable to connect to the server at '%s'", socket_path);
+
+    bool sent = true;
+    for (int i = 0; i < argc && sent; ++i)
+        sent = writeFrame(connection, SERVER_FRAME_ARGUMENT, argv[i],
+                strlen(argv[i]));
+
+    char* buffer = NEW_ARRAY(char, SERVER_MAX_FRAME);
+    size_t n_read = 0;
+    while (sent && (n_read = fread(buffer, 1, SERVER_MAX_FRAME, input)) > 0)
+        sent = writeFrame(connection, SERVER_FRAME_SOURCE, buffer, n_read);
+    free(buffer);
+
+    if (!sent || !writeFrame(connection, SERVER_FRAME_RUN, NULL, 0))
+        Error("connection to the server lost");
+
+    char type = 0;
+    char* data = NULL;
+    uint32_t size = 0;
+    while (readFrame(connection, &type, &data, &size)) {
+        if (type == SERVER_FRAME_STDOUT) {
+            fwrite(data, 1, size, stdout);
+        } else if (type == SERVER_FRAME_STDERR) {
+            fflush(stdout);
+            fwrite(data, 1, size, stderr);
+        } else if (type == SERVER_FRAME_EXIT && size == sizeof(int32_t)) {
+            int32_t exit_code = 0;
+            memcpy(&exit_code, data, sizeof(int32_t));
+            free(data);
+            close(connection);
+            return exit_code;
+        }
+        free(data);
+    }
+
+    Error("connection to the server lost");
+    return 1;
+}
+
+static void createAddress(const char* socket_path, struct sockaddr_un* address)
+{
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path))
+        Error("socket path '%s' is too long", socket_path);
+    strcpy(address->sun_path, socket_path);
+}
+
+static void stopServer(int signal_number)
+{
+    (void)signal_number;
+    unlink(server_socket_path);
+    _exit(0);
+}
+
+static void handleConnection(int connection, ServerHandler handler,
+        long request_id)
+{
+    double start = TimerWallTime();
+
+    // The connection process waits its worker, and a dead client must not
+    // kill it before the request is logged
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    ServerRequest request;
+    if (!readRequest(connection, &request)) {
+        fprintf(stderr, "monga: request %ld, bad request\n", request_id);
+        return;
+    }
+
+    int output[2], errors[2];
+    if (pipe(output) != 0 || pipe(errors) != 0)
+        Error("unable to create the request pipes");
+
+    pid_t worker = fork();
+    if (worker == 0) {
+        close(connection);
+        runWorker(&request, handler, output, errors);
+    }
+    if (worker < 0)
+        Error("unable to fork the request worker");
+
+    close(output[1]);
+    close(errors[1]);
+    forwardOutput(connection, output[0], errors[0]);
+
+    int status = 0;
+    waitpid(worker, &status, 0);
+    int32_t exit_code = 1;
+    if (WIFEXITED(status))
+        exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        exit_code = 128 + WTERMSIG(status);
+    writeFrame(connection, SERVER_FRAME_EXIT, &exit_code, sizeof(exit_code));
+    close(connection);
+
+    fprintf(stderr, "monga: request %ld, %zu bytes, exit code %d, "
+            "latency %.3f ms\n", request_id, request.source_size,
+            (int)exit_code, (TimerWallTime() - start) * 1000);
+}
+
+static bool readRequest(int connection, ServerRequest* request)
+{
+    request->arguments = VectorCreate();
+    request->source = NULL;
+    request->source_size = 0;
+
+    // The program name, like the argv of main
+    VectorPush(request->arguments, "monga");
+
+    char type = 0;
+    char* data = NULL;
+    uint32_t size = 0;
+    while (readFrame(connection, &type, &data, &size)) {
+        switch (type) {
+            case SERVER_FRAME_ARGUMENT:
+                VectorPush(request->arguments, data);
+                break;
+            case SERVER_FRAME_SOURCE:
+                request->source = NewRealloc(request->source,
+                        request->source_size + size);
+                memcpy(request->source + request->source_size, data, size);
+                request->source_size += size;
+                free(data);
+                break;
+            case SERVER_FRAME_RUN:
+                free(data);
+                VectorPush(request->arguments, NULL);
+                return true;
+            default:
+                free(data);
+                return false;
+        }
+    }
+    return false;
+}
+
+static void runWorker(ServerRequest* request, ServerHandler handler,
+        int output[2], int errors[2])
+{
+    close(output[0]);
+    close(errors[0]);
+    if (dup2(output[1], STDOUT_FILENO) < 0 ||
+        dup2(errors[1], STDERR_FILENO) < 0)
+        _exit(1);
+    close(output[1]);
+    close(errors[1]);
+
+    // An empty source still needs a valid stream
+    char empty_source = '\0';
+    FILE* input = request->source_size > 0 ?
+            fmemopen(request->source, request->source_size, "r") :
+            fmemopen(&empty_source, 1, "r");
+
+    int argc = VectorSize(request->arguments) - 1;
+    char** argv = NEW_ARRAY(char*, argc + 1);
+    for (int i = 0; i <= argc; ++i)
+        argv[i] = VectorGet(request->arguments, i);
+
+    exit(handler(argc, argv, input));
+}
+
+static void forwardOutput(int connection, int output, int errors)
+{
+    struct pollfd pipes[2] = {
+        {.fd = output, .events = POLLIN},
+        {.fd = errors, .events = POLLIN}
+    };
+    const char types[2] = {SERVER_FRAME_STDOUT, SERVER_FRAME_STDERR};
+    char* buffer = NEW_ARRAY(char, SERVER_MAX_FRAME);
+
+    int n_open = 2;
+    while (n_open > 0) {
+        if (poll(pipes, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (pipes[i].fd < 0 || pipes[i].revents == 0)
+                continue;
+            ssize_t n_read = read(pipes[i].fd, buffer, SERVER_MAX_FRAME);
+            if (n_read > 0) {
+                // A closed client doesn't stop the worker, the output is
+                // just discarded
+                writeFrame(connection, types[i], buffer, n_read);
+            } else if (n_read == 0 || errno != EINTR) {
+                close(pipes[i].fd);
+                pipes[i].fd = -1;
+                n_open--;
+            }
+        }
+    }
+
+    free(buffer);
+}
+
+static bool writeFrame(int fd, char type, const void* data, uint32_t size)
+{
+    char header[1 + sizeof(uint32_t)];
+    header[0] = type;
+    memcpy(header + 1, &size, sizeof(uint32_t));
+    return writeAll(fd, header, sizeof(header)) && writeAll(fd, data, size);
+}
+
+static bool readFrame(int fd, char* type, char** data, uint32_t* size)
+{
+    char header[1 + sizeof(uint32_t)];
+    if (!readAll(fd, header, sizeof(header)))
+        return false;
+    *type = header[0];
+    memcpy(size, header + 1, sizeof(uint32_t));
+    if (*size > SERVER_MAX_FRAME)
+        return false;
+
+    // Arguments are used as strings
+    *data = NEW_ARRAY(char, *size + 1);
+    (*data)[*size] = '\0';
+    if (!readAll(fd, *data, *size)) {
+        free(*data);
+        return false;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* bytes = data;
+    while (size > 0) {
+        ssize_t n_written = write(fd, bytes, size);
+        if (n_written < 0 && errno == EINTR)
+            continue;
+        if (n_written <= 0)
+            return false;
+        bytes += n_written;
+        size -= n_written;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t size)
+{
+    char* bytes = data;
+    while (size > 0) {
+        ssize_t n_read = read(fd, bytes, size);
+        if (n_read < 0 && errno == EINTR)
+            continue;
+        if (n_read <= 0)
+            return false;
+        bytes += n_read;
+        size -= n_read;
+    }
+    return true;
+}
+
@@ -0,0 +1,39 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * server.h
+ * Compile server over a Unix domain socket. The server keeps LLVM
+ * initialized and forks a process for each request, so clients don't pay
+ * the compiler startup. Messages are frames with a type byte, a 32 bits
+ * size and the data. The client sends its arguments and its source, the
+ * server answers with the program's stdout, stderr and exit code.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+
+/* Frame types */
+#define SERVER_FRAME_ARGUMENT 'a'
+#define SERVER_FRAME_SOURCE 's'
+#define SERVER_FRAME_RUN 'r'
+#define SERVER_FRAME_STDOUT 'o'
+#define SERVER_FRAME_STDERR 'e'
+#define SERVER_FRAME_EXIT 'x'
+
+/* Compiles and runs a request, with the same arguments of the command line
+ * Called in a child process, its stdout and stderr are sent to the client */
+typedef int (*ServerHandler)(int argc, char* argv[], FILE* input);
+
+/* Accepts requests at the socket until the process is killed */
+void ServerRun(const char* socket_path, ServerHandler handler);
+
+/* Sends the arguments and the input to the server, writes the answer in
+ * stdout and stderr, and returns the exit code */
+int ServerRunClient(const char* socket_path, int argc, char* argv[],
+        FILE* input);
+
+#endif
+
@@ -22,11 +22,15 @@ void Error(const char* formatedMessage, ...)
     exit(1);
 }
 
-void ErrorL(int line, const char* formatedMessage, ...)
+void ErrorL(const char* file_name, int line, const char* formatedMessage,
+        ...)
 {
     va_list args;
     va_start(args, formatedMessage);
-    fprintf(stderr, "monga: error at line %d, ", line);
+    if (file_name != NULL)
+        fprintf(stderr, "monga: error at %s:%d, ", file_name, line);
+    else
+        fprintf(stderr, "monga: error at line %d, ", line);
     vfprintf(stderr, formatedMessage, args);
     fprintf(stderr, "\n");
     va_end(args);
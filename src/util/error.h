@@ -13,8 +13,11 @@
 void Error(const char* formatedMessage, ...);
 
 /* Prints the message in stderr and exits the program
- * The message will be "mc: error at line %line, %formatedMessage\n" */
-void ErrorL(int line, const char* formatedMessage, ...);
+ * The message will be "mc: error at line %line, %formatedMessage\n"
+ * If the file name isn't NULL, it will be "mc: error at %file:%line, ..."
+ * The file name is NULL for the standard input. */
+void ErrorL(const char* file_name, int line, const char* formatedMessage,
+        ...);
 
 #endif
 
@@ -11,7 +11,7 @@
 #include <stdlib.h>
 
 #define NEW(type) (type*)NewMalloc(sizeof(type))
-#define NEW_ARRAY(type, size) (type*)NewMalloc(sizeof(type)*size)
+#define NEW_ARRAY(type, size) (type*)NewMalloc(sizeof(type)*(size))
 
 /* Calls malloc and verifies if the memory was allocated */
 void* NewMalloc(size_t size);
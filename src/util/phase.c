@@ -0,0 +1,159 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * phase.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "phase.h"
+
+#include "util/error.h"
+#include "util/timer.h"
+
+/* Max number of different phases and of nested phases */
+#define PHASE_MAX 32
+
+/* Measures of a phase */
+typedef struct Phase {
+    const char* name;
+    double wall_time;
+    double cpu_time;
+    long peak_memory;
+} Phase;
+
+static bool enabled = false;
+static bool json_output = false;
+
+/* Phases in the order they first began */
+static Phase phases[PHASE_MAX];
+static int n_phases = 0;
+
+/* Nested phases, the last is the current one */
+static int stack[PHASE_MAX];
+static int depth = 0;
+
+/* Start of the measuring and of the current phase's time slice */
+static double enable_wall_time = 0;
+static double enable_cpu_time = 0;
+static double slice_wall_time = 0;
+static double slice_cpu_time = 0;
+
+/* Obtains the phase's index, adding it if necessary */
+static int findPhase(const char* name);
+
+/* Adds the time since the last slice to the current phase */
+static void closeSlice();
+
+/* Prints a measure in the requested format */
+static void printMeasure(const char* name, double wall_time, double cpu_time,
+        long peak_memory, bool last);
+
+void PhaseEnable(bool json)
+{
+    enabled = true;
+    json_output = json;
+    n_phases = 0;
+    depth = 0;
+    enable_wall_time = slice_wall_time = TimerWallTime();
+    enable_cpu_time = slice_cpu_time = TimerCpuTime();
+}
+
+void PhaseBegin(const char* name)
+{
+    if (!enabled)
+        return;
+
+    closeSlice();
+    if (depth == PHASE_MAX)
+        Error("too many nested phases");
+    stack[depth++] = findPhase(name);
+}
+
+void PhaseEnd()
+{
+    if (!enabled || depth == 0)
+        return;
+
+    closeSlice();
+    depth--;
+}
+
+void PhaseReport()
+{
+    if (!enabled)
+        return;
+
+    closeSlice();
+    double wall_time = TimerWallTime() - enable_wall_time;
+    double cpu_time = TimerCpuTime() - enable_cpu_time;
+
+    // The program's output must come before the report
+    fflush(stdout);
+    if (json_output)
+        fprintf(stderr, "{\"phases\": [");
+    else
+        fprintf(stderr, "monga: %-12s %12s %12s %14s\n", "phase",
+                "wall (ms)", "cpu (ms)", "peak rss (KB)");
+
+    for (int i = 0; i < n_phases; ++i) {
+        printMeasure(phases[i].name, phases[i].wall_time, phases[i].cpu_time,
+                phases[i].peak_memory, i == n_phases - 1);
+    }
+
+    if (json_output)
+        fprintf(stderr, "], \"total\": ");
+    printMeasure("total", wall_time, cpu_time, TimerPeakMemory(), true);
+    if (json_output)
+        fprintf(stderr, "}\n");
+}
+
+static int findPhase(const char* name)
+{
+    for (int i = 0; i < n_phases; ++i) {
+        if (strcmp(phases[i].name, name) == 0)
+            return i;
+    }
+
+    if (n_phases == PHASE_MAX)
+        Error("too many phases");
+    Phase* phase = &phases[n_phases];
+    phase->name = name;
+    phase->wall_time = 0;
+    phase->cpu_time = 0;
+    phase->peak_memory = 0;
+    return n_phases++;
+}
+
+static void closeSlice()
+{
+    double wall_time = TimerWallTime();
+    double cpu_time = TimerCpuTime();
+    if (depth > 0) {
+        Phase* phase = &phases[stack[depth - 1]];
+        phase->wall_time += wall_time - slice_wall_time;
+        phase->cpu_time += cpu_time - slice_cpu_time;
+        long peak_memory = TimerPeakMemory();
+        if (peak_memory > phase->peak_memory)
+            phase->peak_memory = peak_memory;
+    }
+    slice_wall_time = wall_time;
+    slice_cpu_time = cpu_time;
+}
+
+static void printMeasure(const char* name, double wall_time, double cpu_time,
+        long peak_memory, bool last)
+{
+    if (json_output) {
+        fprintf(stderr, "{\"name\": \"%s\", \"wall_ms\": %.3f, "
+                "\"cpu_ms\": %.3f, \"peak_rss_kb\": %ld}%s", name,
+                wall_time * 1000, cpu_time * 1000, peak_memory,
+                last ? "" : ", ");
+    } else {
+        fprintf(stderr, "monga: %-12s %12.3f %12.3f %14ld\n", name,
+                wall_time * 1000, cpu_time * 1000, peak_memory);
+    }
+}
+
@@ -0,0 +1,29 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * phase.h
+ * Measures the wall time, the CPU time and the peak memory of the compiler
+ * phases. Phases can be nested, the time of the inner phase isn't counted
+ * in the outer one. Phases with the same name are accumulated.
+ */
+
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <stdbool.h>
+
+/* Starts measuring, the phases are ignored while it isn't enabled */
+void PhaseEnable(bool json);
+
+/* Begins a phase inside the current one */
+void PhaseBegin(const char* name);
+
+/* Ends the current phase */
+void PhaseEnd();
+
+/* Prints the measures in stderr, as a table or as a JSON object */
+void PhaseReport();
+
+#endif
+
@@ -0,0 +1,35 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * timer.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include "timer.h"
+
+double TimerWallTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+double TimerCpuTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+long TimerPeakMemory()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
@@ -0,0 +1,22 @@
+/*
+ * Monga Language
+ * Author: Gabriel de Quadros Ligneul
+ *
+ * timer.h
+ * Clock used to measure the compiler phases.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+/* Obtains the monotonic wall clock time in seconds */
+double TimerWallTime();
+
+/* Obtains the CPU time used by the process in seconds */
+double TimerCpuTime();
+
+/* Obtains the peak resident set size of the process in kilobytes */
+long TimerPeakMemory();
+
+#endif
+